@@ -54,21 +54,637 @@
 
 #include "reach-server.h"
 #include "cr_stack.h"
+#include "pb.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+    /// The payload buffers are slightly smaller than the CR_CODED_BUFFER_SIZE
+    /// so that the header can be added.
+    #define UNCODED_PAYLOAD_SIZE  (CR_CODED_BUFFER_SIZE-4)
+
+    /// The uncoded response must also hold the largest response structure,
+    /// which can be bigger than its encoding.
+    #define UNCODED_RESPONSE_SIZE \
+        ((sizeof(cr_ParameterInfoResponse) > UNCODED_PAYLOAD_SIZE) ? \
+          sizeof(cr_ParameterInfoResponse) : UNCODED_PAYLOAD_SIZE)
+
+    /// With ERROR_FORMAT_SHORT only the error code is sent.
+    #define SHORT_ERROR_BUF_LEN  16
+
+    /// Storage defining the state of a (file) data transfer
+    typedef PB_BYTES_ARRAY_T(REACH_BYTES_IN_A_FILE_PACKET) cr_FileTransferStateMachine_message_data_t;
+    typedef struct _cr_FileTransferStateMachine {
+        cr_FileTransferState    state;
+        uint32_t                transfer_id;    // determined on init
+        int32_t                 file_id;        // requested at init
+        int32_t                 timeout_in_ms;  // requested at init
+        uint32_t                request_offset; // requested at init
+        uint32_t                transfer_length;    // requested at init
+        uint8_t                 read_write;         // 0: read, 1: write.
+        uint32_t                message_number;     // rolling counter
+        int32_t                 checksum;
+        uint32_t                messages_per_ack;   // target, fixed
+        uint32_t                messages_until_ack; // current, counts down
+        uint32_t                bytes_transfered;   // to date
+        bool                    use_checksum;
+        uint32_t                transaction_id;     // of the latest prompt
+    } cr_FileTransferStateMachine;
+
+    #ifndef CR_NUM_SESSIONS
+      /// CR_NUM_SESSIONS can be set in reach-server.h to let more than one 
+      /// client (as identified by client_id and endpoint_id) use a stack
+      /// instance at the same time.  Each session costs the storage of its
+      /// continuations and parameter notifications.  With more than one
+      /// session the challenge key is honored per client, so each client
+      /// must send its own device info request.
+      #define CR_NUM_SESSIONS   1
+    #endif
+
+    /// The encoded client_id field (6 bytes) and endpoint_id field (up to 6).
+    #define CR_HEADER_TEMPLATE_SIZE     12
+
+    #ifndef CR_PROMPT_QUEUE_DEPTH
+      /// CR_PROMPT_QUEUE_DEPTH is the number of coded prompts that 
+      /// cr_store_coded_prompt() can hold before cr_process() takes them.
+      /// Must be a power of two.  The default of zero keeps the single 
+      /// prompt buffer, which cr_process() must empty before the next
+      /// prompt is stored.
+      #define CR_PROMPT_QUEUE_DEPTH   0
+    #endif
+    #if (CR_PROMPT_QUEUE_DEPTH & (CR_PROMPT_QUEUE_DEPTH - 1)) != 0
+      #error "CR_PROMPT_QUEUE_DEPTH must be a power of two."
+    #endif
+
+    #ifndef CR_PROMPT_BATCH_SIZE
+      /// The most queued prompts handled by one call to cr_process().
+      #define CR_PROMPT_BATCH_SIZE    CR_PROMPT_QUEUE_DEPTH
+    #endif
+
+    #ifndef CR_TX_QUEUE_DEPTH
+      /// CR_TX_QUEUE_DEPTH is the number of encoded frames the stack can 
+      /// hold while the transport is busy.  The default of zero sends each
+      /// frame directly from the buffer it was encoded in.
+      #define CR_TX_QUEUE_DEPTH       0
+    #endif
+
+    #ifndef CR_SPECULATIVE_PAGE
+      /// When CR_SPECULATIVE_PAGE is not zero the next page of a continued 
+      /// transaction is built into a spare buffer while the transmit queue
+      /// is full, so that it is ready to queue as soon as a slot is free.
+      /// Requires the transmit queue.  Off by default.
+      #define CR_SPECULATIVE_PAGE     0
+    #endif
+    #if CR_SPECULATIVE_PAGE && (CR_TX_QUEUE_DEPTH == 0)
+      #error "CR_SPECULATIVE_PAGE requires CR_TX_QUEUE_DEPTH."
+    #endif
+
+    #ifndef CR_DISCOVERY_CACHE_SIZE
+      /// CR_DISCOVERY_CACHE_SIZE is the number of bytes kept for the encoded 
+      /// responses to a complete discovery of parameters, extended parameters
+      /// or commands, so that a client discovering again is answered by a
+      /// copy.  The cache is emptied when crcb_compute_parameter_hash()
+      /// changes, so the application must override that to use it.  Each
+      /// stack instance has its own.  Zero disables the cache.
+      #define CR_DISCOVERY_CACHE_SIZE     0
+    #endif
+    #if CR_DISCOVERY_CACHE_SIZE > 0xFFFF
+      #error "CR_DISCOVERY_CACHE_SIZE must be less than 64k."
+    #endif
+
+    #ifndef CR_DISCOVERY_CACHE_PAGES
+      /// The number of response pages the discovery cache can hold.
+      #define CR_DISCOVERY_CACHE_PAGES    16
+    #endif
+
+    #ifndef CR_SCHED_WEIGHT_PROMPT
+      /// The share of the calls to cr_process() given to each class of work
+      /// (see cr_WorkClass) when more than one has work.  In each round a
+      /// class does up to its weight in units of work.  Within a round the
+      /// prompts go first, then the continuations and the notifications.
+      #define CR_SCHED_WEIGHT_PROMPT          4
+    #endif
+    #ifndef CR_SCHED_WEIGHT_CONTINUATION
+      #define CR_SCHED_WEIGHT_CONTINUATION    2
+    #endif
+    #ifndef CR_SCHED_WEIGHT_NOTIFICATION
+      #define CR_SCHED_WEIGHT_NOTIFICATION    1
+    #endif
+    #if (CR_SCHED_WEIGHT_PROMPT < 1) || (CR_SCHED_WEIGHT_PROMPT > 255) || \
+        (CR_SCHED_WEIGHT_CONTINUATION < 1) || (CR_SCHED_WEIGHT_CONTINUATION > 255) || \
+        (CR_SCHED_WEIGHT_NOTIFICATION < 1) || (CR_SCHED_WEIGHT_NOTIFICATION > 255)
+      #error "The CR_SCHED_WEIGHT_ values must be from 1 to 255."
+    #endif
+
+    /// Priority classes of transmitted frames, most urgent first.
+    typedef enum {
+        cr_TxClass_RESPONSE = 0,
+        cr_TxClass_ERROR,
+        cr_TxClass_NOTIFICATION,
+        cr_TxClass_CLI,
+        cr_TxClass_BULK,            ///< file and stream data
+        cr_TxClass_COUNT
+    } cr_TxClass;
+
+    /// The state of a slot in the transmit queue
+    typedef enum {
+        cr_TxSlot_FREE = 0,
+        cr_TxSlot_QUEUED,
+        cr_TxSlot_IN_FLIGHT
+    } cr_TxSlotState;
+
+    #ifndef CR_CURSOR_TIMEOUT_TICKS
+      /// A continued transaction that has produced no page and seen no 
+      /// prompt for this many ticks is closed, so that a client that went
+      /// away cannot hold its cursor.
+      #define CR_CURSOR_TIMEOUT_TICKS   10000
+    #endif
+
+    #ifndef CR_CURSORS_PER_SESSION
+      /// The number of continued transactions a client can have open at 
+      /// once, each with its own transaction_id.  For example a file read 
+      /// and a parameter discovery.
+      #define CR_CURSORS_PER_SESSION    2
+    #endif
+    #if (CR_CURSORS_PER_SESSION < 1) || (CR_CURSORS_PER_SESSION > 255)
+      #error "CR_CURSORS_PER_SESSION must be from 1 to 255."
+    #endif
+
+    #ifndef CR_RESPONSE_CACHE_ENTRIES
+      /// The number of recent responses kept so that a prompt sent again 
+      /// with the same transaction_id, as a client does when a response is
+      /// lost, is answered with the same bytes instead of being handled 
+      /// again.  Each costs CR_CODED_BUFFER_SIZE bytes per stack instance.
+      /// The default of zero disables it.
+      #define CR_RESPONSE_CACHE_ENTRIES     0
+    #endif
+    #ifndef CR_RESPONSE_CACHE_TICKS
+      /// A cached response is only used for this many ticks, so that a 
+      /// client reusing a transaction_id later is answered afresh.
+      #define CR_RESPONSE_CACHE_TICKS       2000
+    #endif
+    #if CR_RESPONSE_CACHE_ENTRIES > 255
+      #error "CR_RESPONSE_CACHE_ENTRIES must be less than 256."
+    #endif
+
+    #ifndef CR_PARAM_NOTIFY_POLL
+      /// When 1 each parameter with a notification is read once per 
+      /// minimum_notification_period to look for a change.  Set it to 0 
+      /// when the application calls cr_param_changed() on every change.  A
+      /// parameter is then only read when signalled or when its 
+      /// maximum_notification_period has passed.
+      #define CR_PARAM_NOTIFY_POLL      1
+    #endif
+    #ifndef CR_PARAM_CHANGE_FLAGS
+      /// The number of flags that cr_param_changed() sets, chosen by the 
+      /// parameter ID.  The notifications of all parameters that share the
+      /// flag are checked.
+      #define CR_PARAM_CHANGE_FLAGS     32
+    #endif
+    #if (CR_PARAM_CHANGE_FLAGS < 1) || (CR_PARAM_CHANGE_FLAGS > 0xFFFF)
+      #error "CR_PARAM_CHANGE_FLAGS must be from 1 to 65535."
+    #endif
+    #if defined(NUM_SUPPORTED_PARAM_NOTIFY) && (NUM_SUPPORTED_PARAM_NOTIFY >= 0xFFFF)
+      #error "NUM_SUPPORTED_PARAM_NOTIFY must be less than 65535."
+    #endif
+    /// The notify_heap_pos of a slot that is not in the heap.
+    #define CR_NOTIFY_NOT_SCHEDULED     0xFFFF
+
+    #ifndef CR_PARAM_REGISTRY_SIZE
+      /// CR_PARAM_REGISTRY_SIZE is the most parameters cr_init() can index 
+      /// from the table of crcb_get_parameter_table(), at six bytes each.  
+      /// With the index a parameter is found by its ID in the same time 
+      /// however many there are.  Zero disables it, and parameters are found
+      /// through crcb_parameter_discover_reset() and 
+      /// crcb_parameter_discover_next().
+      #define CR_PARAM_REGISTRY_SIZE    0
+    #endif
+    #if CR_PARAM_REGISTRY_SIZE > MAX_NUM_PARAM_ID
+      #error "CR_PARAM_REGISTRY_SIZE must not be more than MAX_NUM_PARAM_ID."
+    #endif
+
+    /**
+    * @brief   cr_cursor_t 
+    * @details The position of a continued transaction, one whose response 
+    *          is sent as several pages.  The handler of the prompt opens the
+    *          cursor by setting its message_type, and the descriptor of that
+    *          type produces the following pages from it until no objects
+    *          remain.  It is closed when done, cancelled or expired.
+    */
+    typedef struct
+    {
+        cr_ReachMessageTypes message_type;  ///< of the pages, INVALID when closed
+        uint32_t    transaction_id;         ///< of the prompt that opened it
+        uint32_t    num_remaining_objects;
+        uint32_t    last_active;            ///< ticks, for the expiry
+
+        /// A discovery answered with pages already encoded, from the 
+        /// discovery cache or built into the application.  NULL otherwise.
+        const cr_EncodedPage *replay_pages;
+        uint16_t    replay_count;
+        uint16_t    replay_next;        ///< the next page to send
+        cr_ReachMessageTypes replay_type;
+        bool        replay_cached;      ///< the pages are in the discovery cache
+        uint32_t    replay_generation;  ///< of the cache when the replay began
+
+      #ifdef INCLUDE_COMMAND_SERVICE
+        unsigned int requested_command_index;
+      #endif
+      #ifdef INCLUDE_WIFI_SERVICE
+        uint8_t     requested_wifi_index;
+      #endif
+      #ifdef INCLUDE_PARAMETER_SERVICE
+        uint32_t    num_ex_this_pid;
+        int16_t     requested_param_array[REACH_COUNT_PARAMS_IN_REQUEST];
+        uint8_t     requested_param_info_count;
+        uint8_t     requested_param_index;
+        uint16_t    requested_notify_count;
+        uint16_t    requested_notify_index;
+        uint8_t     requested_param_read_count;
+        bool        discover_all_notifications;
+      #endif  // def INCLUDE_PARAMETER_SERVICE
+    } cr_cursor_t;
+
+  #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+    /**
+    * @brief   cr_NotifyValue 
+    * @details The last notified value of a parameter, in the size of its 
+    *          type.  Strings and byte arrays are kept as a hash, which is 
+    *          enough to see that they changed.  Unused bytes are zero, so 
+    *          that two values are the same when their bits are.
+    */
+    typedef union
+    {
+        uint32_t    uint32_value;
+        int32_t     int32_value;
+        float       float32_value;
+        uint64_t    uint64_value;
+        int64_t     int64_value;
+        double      float64_value;
+        bool        bool_value;
+        uint32_t    hash;           ///< of a string or bytes value
+        uint64_t    bits;           ///< all of it, to compare as one word
+    } cr_NotifyValue;
+  #endif
+
+    /**
+    * @brief   cr_session_t 
+    * @details The state of one client conversation, keyed by the client_id and 
+    *          endpoint_id of the message header.  Continued transactions,
+    *          parameter notifications and the challenge key state are held
+    *          per session so that one client cannot disturb another.
+    */
+    typedef struct
+    {
+        bool        in_use;
+        uint32_t    client_id;
+        uint32_t    endpoint_id;
+        uint32_t    last_used;      ///< ticks, to choose a session to reuse
+        bool        challenge_key_valid;
+
+        uint32_t    transaction_id; ///< of the prompt being handled
+        uint8_t     client_protocol_version[3];
+
+        /// The client_id and endpoint_id fields of the Ahsoka header sent to
+        /// this client, encoded when first needed.  
+        uint8_t     header_template[CR_HEADER_TEMPLATE_SIZE];
+        uint8_t     header_template_size;
+
+        // The continued transactions of this client.
+        cr_cursor_t cursors[CR_CURSORS_PER_SESSION];
+        uint8_t     next_cursor;    ///< round robin of continuations
+
+      #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+        uint32_t    num_notifications_sent;
+        /// The parameter notifications as parallel arrays, which lose no 
+        /// space to padding.  Slots 0 to notify_count - 1 are in use.  A 
+        /// disabled slot is replaced by the last one.
+        uint16_t    notify_count;
+        uint32_t    notify_pid[NUM_SUPPORTED_PARAM_NOTIFY];
+        uint32_t    notify_min_period[NUM_SUPPORTED_PARAM_NOTIFY];
+        uint32_t    notify_max_period[NUM_SUPPORTED_PARAM_NOTIFY];
+        float       notify_min_delta[NUM_SUPPORTED_PARAM_NOTIFY];
+        /// The ticks and value of the last notification of each slot.
+        uint32_t    notify_last_ticks[NUM_SUPPORTED_PARAM_NOTIFY];
+        cr_NotifyValue notify_last[NUM_SUPPORTED_PARAM_NOTIFY];
+        /// The slots in order of parameter ID, to find the slot of an ID
+        /// with a binary search.
+        uint16_t    notify_by_pid[NUM_SUPPORTED_PARAM_NOTIFY];
+        /// The list need not be checked again before notify_due, the due
+        /// ticks of the first entry of the heap.  Cleared when the heap
+        /// may have changed.
+        bool        notify_due_valid;
+        uint32_t    notify_due;
+        /// A min-heap of the notification slots ordered by the ticks
+        /// at which each is next checked, and the position of each slot in 
+        /// it or CR_NOTIFY_NOT_SCHEDULED.  Rebuilt when not valid.
+        uint16_t    notify_heap[NUM_SUPPORTED_PARAM_NOTIFY];
+        uint16_t    notify_heap_pos[NUM_SUPPORTED_PARAM_NOTIFY];
+        uint32_t    notify_slot_due[NUM_SUPPORTED_PARAM_NOTIFY];
+        uint16_t    notify_heap_count;
+        bool        notify_heap_valid;
+      #endif
+
+      #ifdef INCLUDE_FILE_SERVICE
+        cr_FileTransferStateMachine file_xfer_state;
+        // Timeout watchdog used in the file write sequences.
+        bool        watchdog_is_active;
+        uint32_t    watchdog_period;
+        uint32_t    watchdog_target;
+      #endif  // def INCLUDE_FILE_SERVICE
+    } cr_session_t;
+
+    /// The discovery responses that can be sent from pages already encoded.
+    typedef enum {
+        cr_DiscoverySlot_PARAMETERS = 0,
+        cr_DiscoverySlot_PARAM_EX,
+        cr_DiscoverySlot_COMMANDS,
+        cr_DiscoverySlot_COUNT
+    } cr_DiscoverySlot;
+
+  #if CR_DISCOVERY_CACHE_SIZE > 0
+    /// The pages of one cached discovery.
+    typedef struct {
+        bool        complete;
+        bool        too_large;          ///< not tried again until the cache is emptied
+        bool        key_valid;          ///< the challenge key state it was built with
+        uint8_t     first_page;
+        uint8_t     num_pages;
+    } cr_CacheEntry;
+
+    /// The discovery responses recorded by a stack instance.  The pages are 
+    /// stored in the order they are encoded.  Only one discovery is recorded
+    /// at a time, so an unfinished one is always at the end.
+    typedef struct {
+        bool            hash_valid;
+        uint32_t        hash;           ///< crcb_compute_parameter_hash() when filled
+        uint32_t        generation;     ///< counts the times the cache was emptied
+        cr_CacheEntry   entries[cr_DiscoverySlot_COUNT];
+        cr_EncodedPage  pages[CR_DISCOVERY_CACHE_PAGES];
+        uint8_t         num_pages;
+        uint16_t        used;
+        // The session whose responses are being recorded, or NULL.
+        cr_session_t   *fill_session;
+        cr_DiscoverySlot fill_slot;
+        uint8_t         pool[CR_DISCOVERY_CACHE_SIZE];
+    } cr_DiscoveryCache;
+  #endif
+
+  #if CR_RESPONSE_CACHE_ENTRIES > 0
+    /// A response kept in case its prompt is sent again.
+    typedef struct {
+        const cr_session_t *session;    ///< NULL if unused
+        uint32_t    client_id;
+        uint32_t    transaction_id;
+        int32_t     message_type;       ///< of the prompt
+        uint32_t    prompt_hash;        ///< of the coded prompt payload
+        size_t      prompt_size;
+        uint32_t    stored_ticks;
+        cr_ReachMessageTypes response_type;
+        size_t      response_size;      ///< 0 if the prompt had no response
+        uint16_t    response_header_size;
+        uint8_t     response[CR_CODED_BUFFER_SIZE];
+    } cr_ResponseCacheEntry;
+
+    /// The most recent responses of the sessions of a stack instance, 
+    /// replaced oldest first.
+    typedef struct {
+        cr_ResponseCacheEntry entries[CR_RESPONSE_CACHE_ENTRIES];
+        uint8_t     next;
+    } cr_ResponseCache;
+  #endif
+
+    /**
+    * @brief   cr_stack_s 
+    * @details Everything that the Reach stack needs to remember between calls 
+    *          to cr_process() lives here rather than in file-static variables.
+    *          One instance serves one communication link.  The instances are
+    *          allocated statically, CR_NUM_STACK_INSTANCES of them, and the
+    *          public API sees only the opaque cr_stack_t.
+    */
+    struct cr_stack_s
+    {
+        bool        in_use;
+        void       *app_context;    ///< handed to cr_stack_create()
+
+        // the fully encoded message is received in the encoded_message_buffer. 
+        uint8_t     encoded_message_buffer[CR_CODED_BUFFER_SIZE] ALIGN_TO_WORD;
+        size_t      encoded_message_size;
+        // The prompt being handled.  A queue slot, a buffer loaned by the 
+        // transport or the encoded_message_buffer.  It is only read.
+        const uint8_t *prompt;
+        // Where the payload of the prompt is decoded.  Never the same as prompt.
+        uint8_t    *decoded_prompt;
+
+      #if CR_PROMPT_QUEUE_DEPTH > 0
+        // Single producer, single consumer ring filled by cr_store_coded_prompt().
+        // The head is written only by the producer and the tail only by 
+        // cr_process().  Both run freely and are masked to index the slots.
+        uint8_t     prompt_queue[CR_PROMPT_QUEUE_DEPTH][CR_CODED_BUFFER_SIZE] ALIGN_TO_WORD;
+        size_t      prompt_queue_len[CR_PROMPT_QUEUE_DEPTH];
+        // Non-NULL when the slot holds a buffer loaned by cr_loan_coded_prompt().
+        const uint8_t *prompt_queue_loan[CR_PROMPT_QUEUE_DEPTH];
+        uint32_t    prompt_queue_head;
+        uint32_t    prompt_queue_tail;
+      #endif
+
+        union
+        {
+            // A classic message is decoded into this structure containing an 
+            // encoded payload buffer.
+            cr_ReachMessage uncoded_message_structure;
+            // An Ahsoka payload is decoded straight from the prompt into here.
+            uint8_t     decoded_prompt_buffer[CR_CODED_BUFFER_SIZE];
+        };
+
+        // An uncoded response payload.
+        uint8_t     uncoded_response_buffer[UNCODED_RESPONSE_SIZE] ALIGN_TO_WORD;
+
+        // The size of the encoded response payload.
+        size_t      encoded_payload_size;
+
+        // The response, payload and header, is encoded into encoded_response_buffer[]  
+        uint8_t     encoded_response_buffer[CR_CODED_BUFFER_SIZE] ALIGN_TO_WORD;
+        size_t      encoded_response_size;
+        // The size of the Ahsoka header of the encoded response, recorded 
+        // when it is encoded so that the frame can be sent in segments.  
+        // Zero for a classic frame, which is sent whole.
+        uint16_t    response_header_size;
+
+        bool        classic_header_format;
+
+        uint8_t     raw_notification[CR_CODED_BUFFER_SIZE]    ALIGN_TO_WORD;
+        uint8_t     coded_notification[CR_CODED_BUFFER_SIZE]  ALIGN_TO_WORD;
+        size_t      encoded_notification_size;
+        uint16_t    notification_header_size;   ///< as response_header_size
+
+        // Buffers lent by crcb_get_tx_buffer() that the response and the 
+        // notification are encoded into.  NULL when the buffers above are used.
+        uint8_t    *response_frame;
+        size_t      response_frame_size;
+        uint8_t    *notification_frame;
+        size_t      notification_frame_size;
+
+      #if defined(ERROR_REPORT_FORMAT) && (ERROR_REPORT_FORMAT == ERROR_FORMAT_SHORT)
+        uint8_t     short_error_buffer[SHORT_ERROR_BUF_LEN] ALIGN_TO_WORD;
+      #elif defined(ERROR_REPORT_FORMAT) && (ERROR_REPORT_FORMAT != ERROR_FORMAT_LOG_ONLY)
+        // The asynchronous error report requires a buffer.
+        uint8_t     async_error_buffer[UNCODED_PAYLOAD_SIZE] ALIGN_TO_WORD;
+      #endif
+
+      #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+        // Set by cr_param_changed(), from an interrupt, and taken by 
+        // cr_process().  Only whole bytes are stored, never read-modify-write.
+        uint8_t     param_changed[CR_PARAM_CHANGE_FLAGS];
+        uint8_t     param_changed_any;
+        // The values that fall due in one check of notifications, sent 
+        // together as many to a frame as the notification holds, with the
+        // slot of each and the form to keep once it is sent.
+        cr_ParameterValue notify_batch[REACH_COUNT_PARAM_NOTIF_VALUES];
+        uint16_t    notify_batch_slot[REACH_COUNT_PARAM_NOTIF_VALUES];
+        cr_NotifyValue notify_batch_kept[REACH_COUNT_PARAM_NOTIF_VALUES];
+      #endif
+
+      #if CR_TX_QUEUE_DEPTH > 0
+        // Encoded frames waiting for the transport.  One at a time is in 
+        // flight.  The transport reports completion with cr_send_complete().
+        uint8_t     tx_frame[CR_TX_QUEUE_DEPTH][CR_CODED_BUFFER_SIZE] ALIGN_TO_WORD;
+        size_t      tx_len[CR_TX_QUEUE_DEPTH];
+        uint32_t    tx_seq[CR_TX_QUEUE_DEPTH];  ///< FIFO order within a class
+        uint8_t     tx_class[CR_TX_QUEUE_DEPTH];
+        uint8_t     tx_state[CR_TX_QUEUE_DEPTH];
+        uint16_t    tx_header_size[CR_TX_QUEUE_DEPTH];  ///< 0 for a classic frame
+        // The session and transaction of a queued response, so that it can
+        // be dropped when the client cancels.  tx_session is NULL for other
+        // frames.
+        const cr_session_t *tx_session[CR_TX_QUEUE_DEPTH];
+        uint32_t    tx_transaction_id[CR_TX_QUEUE_DEPTH];
+        uint32_t    tx_next_seq;
+        bool        tx_done;        ///< set by cr_send_complete()
+        uint32_t    tx_dropped;
+      #endif
+      #if CR_SPECULATIVE_PAGE
+        // The next page of a continued transaction, built while the 
+        // transmit queue was full.  spare_session is NULL when there is none.
+        uint8_t     spare_frame[CR_CODED_BUFFER_SIZE] ALIGN_TO_WORD;
+        size_t      spare_size;
+        uint16_t    spare_header_size;
+        int         spare_rval;     ///< as returned by the continuation
+        cr_ReachMessageTypes spare_type;
+        uint32_t    spare_transaction_id;
+        cr_session_t *spare_session;
+      #endif
+      #if CR_RESPONSE_CACHE_ENTRIES > 0
+        cr_ResponseCache response_cache;
+      #endif
+      #if CR_DISCOVERY_CACHE_SIZE > 0
+        cr_DiscoveryCache discovery_cache;
+      #endif
+        cr_ReachMessageTypes response_type; ///< of the last encoded response
+        uint32_t    response_transaction_id;    ///< of the last encoded response
+        int32_t     dispatch_response_type; ///< Handlers may change the type of their response
+
+        bool        error_reported;
+        int         call_count;
+        uint32_t    current_ticks;
+        uint32_t    next_process_ticks;     ///< See cr_get_next_process_ticks()
+        bool        comm_link_is_connected;
+
+        // The clients of this link.  session is the one being served.
+        cr_session_t  sessions[CR_NUM_SESSIONS];
+        cr_session_t *session;
+        uint8_t     next_continued_session; ///< round robin of continuations
+        cr_cursor_t *cursor;        ///< of the transaction being served
+        /// Given to the handler of a prompt when all the cursors of its 
+        /// session are open.
+        cr_cursor_t scratch_cursor;
+
+        // The scheduler of cr_process().  The credit of a class is the work
+        // it may still do in this round.  A class is waiting from when its
+        // work is first seen until it is done.
+        uint8_t     sched_credit[cr_WorkClass_COUNT];
+        uint8_t     sched_waiting;  ///< a bit per class
+        uint32_t    sched_ready_since[cr_WorkClass_COUNT];
+        cr_WorkClassStatistics sched_stats[cr_WorkClass_COUNT];
+
+        // The budget of this call to cr_process_budget().  Zero is no limit.
+        uint32_t    budget_work;
+        uint32_t    budget_time;
+        uint32_t    budget_start;   ///< crcb_get_budget_clock() when the call began
+        uint32_t    work_done;      ///< in this call
+        bool        budget_stopped; ///< a safe point stopped the work
+        cr_ProcessStatistics process_stats;
+    };
+
+    #ifndef CR_THREAD_LOCAL
+      /// Define CR_THREAD_LOCAL in reach-server.h (ie, as __thread) 
+      /// when the stack instances are driven from more than one thread.
+      #define CR_THREAD_LOCAL
+    #endif
+
+    /// The instance being served by the current call into the stack. 
+    /// Selected by cr_process_ctx() and friends.
+    extern CR_THREAD_LOCAL cr_stack_t *pvtCr_active_stack;
+
     /// <summary>
     /// Private variables controlling the sort of continuing 
     /// transactions used by file transfers, etc. 
     /// </summary>
 
+    /// The session being served by the active stack.
+    #define pvtCr_session                (pvtCr_active_stack->session)
+
+    /// The cursor of the continued transaction being served.  One of the 
+    /// cursors of the active session, chosen by the transaction_id of a 
+    /// prompt or by the turn of a continuation.
+    #define pvtCr_cursor                 (pvtCr_active_stack->cursor)
+
     /// The type of the current continued message
-    extern cr_ReachMessageTypes pvtCr_continued_message_type;
+    #define pvtCr_continued_message_type (pvtCr_cursor->message_type)
 
     /// The number of continued objects (remaining)
-    extern uint32_t             pvtCr_num_remaining_objects;
+    #define pvtCr_num_remaining_objects  (pvtCr_cursor->num_remaining_objects)
+
+    /**
+    * @brief   pvtCr_cursor_close
+    * @details Ends a continued transaction.  No more pages are sent.
+    * @param   cursor : The cursor to close.
+    */
+    void pvtCr_cursor_close(cr_cursor_t *cursor);
+
+    /**
+    * @brief   pvtCr_budget_spent
+    * @details Called at a safe point to ask if the budget of this call to 
+    *          cr_process_budget() is spent.  Never true before any work is 
+    *          done, so that each call makes progress.
+    * @return  true to stop here and resume in the next call.
+    */
+    bool pvtCr_budget_spent(void);
+
+    /**
+    * @brief   pvtCr_budget_charge
+    * @details Counts work done against the budget of this call.
+    * @param   units : The units of work done.
+    */
+    void pvtCr_budget_charge(uint32_t units);
+
+    /**
+    * @brief   pvtCr_session_select
+    * @details Makes the session of the given client the active one, claiming 
+    *          a free session or reusing the least recently used one if this
+    *          client is new.
+    * @param   client_id : From the message header.
+    * @param   endpoint_id : From the message header.
+    */
+    void pvtCr_session_select(uint32_t client_id, uint32_t endpoint_id);
+
+    /**
+    * @brief   pvtCr_challenge_key_is_valid
+    * @return  true if the active session has been granted access by the 
+    *          challenge key.
+    */
+    bool pvtCr_challenge_key_is_valid(void);
 
     /// <summary>
     /// Returns the state of the challenge key which may block 
@@ -94,6 +710,10 @@ extern "C" {
     /// Private function for file erase
     int pvtCrFile_erase_file(const cr_FileEraseRequest *request,
                              cr_FileEraseResponse *response);
+    /// Private function to abandon the file transfer of the active session
+    /// if transaction_id is zero or that of its latest prompt.
+    /// Returns true if a transfer was abandoned.
+    bool pvtCrFile_cancel(uint32_t transaction_id);
 
     /// <summary>
     /// The file service includes a timeout Watchdog. 
@@ -116,6 +736,15 @@ extern "C" {
     /// service. 
     ///  
 
+    /**
+    * @brief   pvtCrParam_registry_init
+    * @details Called in cr_init() to index the table of 
+    *          crcb_get_parameter_table() by parameter ID.
+    * @return  cr_ErrorCodes_NO_ERROR, or an error if the table cannot be 
+    *          indexed, in which case it is not used.
+    */
+    int pvtCrParam_registry_init(void);
+
     ///  Private helper function to discover parameters
     int pvtCrParam_discover_parameters(const cr_ParameterInfoRequest *,
                                        cr_ParameterInfoResponse *);
@@ -149,25 +778,20 @@ extern "C" {
                                        cr_ParameterNotifyConfigResponse *);
     int pvtCrParam_param_disable_notify(const cr_ParameterDisableNotifications *,
                                        cr_ParameterNotifyConfigResponse *);
-
-    /**
-    * @brief   pvtCr_notify_param
-    * @details parameter notifications are handled by the Reach stack. The stack 
-    * will use the read parameters to be notified on an appropriate timescale and 
-    *          send notifications if enough changes. Signals the
-    *          client that this parameter may have changed.
-    * @param   param (input) pointer to the parameter data that has 
-    *                changed.
-    * @return  cr_ErrorCodes_NO_ERROR on success or an error from the cr_ErrorCodes_
-    *          enumeration if the notification fails.
-    */
-    int pvtCr_notify_param(cr_ParameterValue *param);
   #endif // NUM_SUPPORTED_PARAM_NOTIFY != 0
 
     ///  Private helper function to check for parameter
     ///  notifications
     void pvtCrParam_check_for_notifications(void);
 
+    /**
+    * @brief   pvtCrParam_take_changes
+    * @details Takes the flags set by cr_param_changed() for the active stack
+    *          and schedules the notifications of the parameters they name.
+    * @return  true if any flag was set.
+    */
+    bool pvtCrParam_take_changes(void);
+
     /**
     * @brief   pvtCr_compare_proto_version 
     * @details Used to support backward compatibility.
@@ -219,6 +843,21 @@ extern "C" {
     */
     int pvtCr_notify_error(cr_ErrorReport *err);
 
+    /**
+    * @brief   pvtCr_send_frame
+    * @details All encoded frames leave through here.  The frame is copied 
+    *          into the transmit queue and sent by priority class as the
+    *          transport allows.  An accepted frame is never dropped for a
+    *          later one.  The last free slot is kept for a response.
+    * @param   tx_class : The priority of the frame.
+    * @param   frame : The encoded frame.
+    * @param   len : Size of the frame.
+    * @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_RESOURCE if the 
+    *          frame was not accepted because the queue is full.  The 
+    *          producer may try again later.
+    */
+    int pvtCr_send_frame(cr_TxClass tx_class, const uint8_t *frame, size_t len);
+
     /**
     * @brief   pvtCr_encode_message
     * @details Takes a raw reach message and encodes it to protobuf 
@@ -62,6 +62,50 @@
 // current transport means.  For example, BLE.
 #include "reach-server.h"
 
+/// One instance of the Reach stack serving one communication link.  The 
+/// contents are private.  See cr_stack_create().
+typedef struct cr_stack_s cr_stack_t;
+
+/// One contiguous piece of an outbound frame.  See crcb_send_coded_segments().
+typedef struct
+{
+    const uint8_t  *data;
+    size_t          len;
+} cr_TxSegment;
+
+/// One response payload that is already encoded.
+typedef struct
+{
+    const uint8_t  *payload;
+    uint16_t        size;
+    uint32_t        remaining_objects;  ///< for the message header
+} cr_EncodedPage;
+
+/// The complete response to a discovery, encoded when the application was 
+/// built.  See crcb_get_prebuilt_discovery() and tools/prebuild_discovery.c.
+typedef struct
+{
+    int32_t               message_type;     ///< a discover cr_ReachMessageTypes
+    uint32_t              parameter_hash;   ///< crcb_compute_parameter_hash() of the tables
+    const cr_EncodedPage *pages;
+    uint16_t              num_pages;
+    bool                  challenge_key_valid;  ///< the access of the client that asked
+} cr_PrebuiltDiscovery;
+
+/// The parameters of an application as a const table, which the stack 
+/// indexes by ID at cr_init().  See crcb_get_parameter_table().
+typedef struct
+{
+    const cr_ParameterInfo *params;     ///< the descriptions in the order of discovery
+    /// The storage of each value, or NULL for those read through 
+    /// crcb_parameter_read().  The type follows which_desc: uint32_t for 
+    /// uint32 and enum, int32_t, float, uint64_t for uint64 and bitfield, 
+    /// int64_t, double, bool, char[REACH_PVAL_STRING_LEN] or a 
+    /// cr_ParameterValue_bytes_value_t.  NULL if there is none.
+    void * const           *values;
+    uint16_t                num_params;
+} cr_ParameterTable;
+
 #include "crcb_weak.h"
 // reach.pb.h is generated by nanopb based on the protobuf file reach.proto.
 #include "reach.pb.h"
@@ -163,18 +207,128 @@ const char *cr_get_advertised_name();
 */
 int cr_process(uint32_t ticks);
 
+#ifndef CR_MAX_IDLE_TICKS
+    /// The furthest ahead cr_get_next_process_ticks() looks when nothing 
+    /// is pending.  Must be less than 2^31.
+  #define CR_MAX_IDLE_TICKS     10000
+#endif
+
+/**
+* @brief   cr_get_next_process_ticks
+* @details Supports an event driven application.  After cr_process() this 
+*          gives the tick count at which it next needs to be called, from
+*          pending continuations and transmissions, the file transfer
+*          watchdog and the periods of the parameter notifications.  A
+*          notification is checked for a change at its minimum period, or
+*          on every call if that is zero.  The application can sleep until
+*          then unless a prompt arrives, the link changes or a frame 
+*          completes.  Ticks compare with wrap around.
+* @return  The tick count at which to call cr_process().  Not later than 
+*          CR_MAX_IDLE_TICKS after the last call.
+*/
+uint32_t cr_get_next_process_ticks(void);
+
+/// The classes of work scheduled by cr_process().  Each call does one unit
+/// of work.  The classes with work take turns in proportion to their 
+/// weights, CR_SCHED_WEIGHT_PROMPT and friends, so that no class waits for
+/// another to finish.
+typedef enum {
+    cr_WorkClass_PROMPT = 0,        ///< a prompt from a client
+    cr_WorkClass_CONTINUATION,      ///< a page of a continued transaction
+    cr_WorkClass_NOTIFICATION,      ///< a check of due parameter notifications
+    cr_WorkClass_COUNT
+} cr_WorkClass;
+
+/// How one class of work is being served.  Waits are in ticks.
+typedef struct {
+    uint32_t    depth;      ///< units of work waiting now
+    uint32_t    served;     ///< units done since the last query
+    uint32_t    last_wait;  ///< how long the last unit waited to be done
+    uint32_t    max_wait;   ///< the longest wait since the last query
+} cr_WorkClassStatistics;
+
+/**
+* @brief   cr_get_scheduler_statistics
+* @details Shows how the work of cr_process() is shared between the classes.
+*          A prompt is counted in the depth once it is stored with 
+*          cr_store_coded_prompt(), a continuation per client with one open
+*          and a notification per client with one due.  served and max_wait
+*          are zeroed by each call.
+* @param   work_class : The class to report.
+* @param   stats : Filled in.
+* @return  cr_ErrorCodes_NO_ERROR or cr_ErrorCodes_INVALID_PARAMETER.
+*/
+int cr_get_scheduler_statistics(cr_WorkClass work_class, cr_WorkClassStatistics *stats);
+
+/**
+* @brief   cr_process_budget
+* @details As cr_process(), for a caller with a deadline.  The stack stops at
+*          a safe point once the budget is spent and carries on from there 
+*          in the next call.  The safe points are between prompts, between 
+*          pages and between the parameter reads of the notification check,
+*          so a call overruns by at most one of these.  Each call does at 
+*          least one.  cr_get_next_process_ticks() is the current tick count
+*          while work is left.
+* @param   ticks: As cr_process().
+* @param   max_work: The most units of work, counting prompts handled, pages
+*               sent and parameters read for notifications.  Zero for no limit.
+* @param   max_time: The most time, in the counts of crcb_get_budget_clock().
+*               Zero for no limit.
+* @return  As cr_process().
+*/
+int cr_process_budget(uint32_t ticks, uint32_t max_work, uint32_t max_time);
+
+/// The cost of the calls to cr_process().  Times are in the counts of 
+/// crcb_get_budget_clock().
+typedef struct {
+    uint32_t    last_time;      ///< of the last call
+    uint32_t    max_time;       ///< the worst case since the last query
+    uint32_t    last_work;      ///< units of work done by the last call
+    uint32_t    max_work;       ///< the most since the last query
+    uint32_t    num_deferred;   ///< calls that left work for later since the last query
+    uint32_t    num_prebuilt;   ///< pages built while the transmit queue was full, since the last query
+} cr_ProcessStatistics;
+
+/**
+* @brief   cr_get_process_statistics
+* @details Reports the execution time of cr_process(), to size a budget.
+*          The max values and the counts are zeroed by each call.
+* @param   stats : Filled in.
+*/
+void cr_get_process_statistics(cr_ProcessStatistics *stats);
+
 /**
 * @brief   cr_store_coded_prompt
 * @details Allows the application to store the prompt where the 
 *          Reach stack can see it.  The byte data and length are
-*          copied into private storage. This data is retrieved
-*          using crcb_get_coded_prompt().
+*          copied into the single prompt buffer or, when reach-server.h
+*          sets CR_PROMPT_QUEUE_DEPTH, into a queue of prompts which
+*          cr_process() drains, CR_PROMPT_BATCH_SIZE at a time, before
+*          it asks crcb_get_coded_prompt().  The queue is lock free
+*          with a single producer, so this can be called from an
+*          interrupt or a transport thread.
 * @param   data: The coded prompt to be stored. 
 * @param   len : number of bytes to be stored. 
-* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+* @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_RESOURCE if the 
+*          queue is full and the prompt was not stored.
 */
 int cr_store_coded_prompt(uint8_t *data, size_t len);
 
+/**
+* @brief   cr_loan_coded_prompt
+* @details A zero copy alternative to cr_store_coded_prompt().  The 
+*          transport lends the stack a pointer into its own receive buffer.
+*          The prompt is decoded directly from that buffer, which must not
+*          change until the stack hands it back through
+*          crcb_return_coded_prompt().  Loaned and stored prompts share the
+*          queue, so this requires CR_PROMPT_QUEUE_DEPTH > 0.
+* @param   data: The coded prompt. 
+* @param   len : number of bytes in the prompt. 
+* @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_RESOURCE if the 
+*          queue is full and the buffer remains with the caller.
+*/
+int cr_loan_coded_prompt(const uint8_t *data, size_t len);
+
 
 /**
 * @brief   cr_get_coded_response_buffer
@@ -185,9 +339,209 @@ int cr_store_coded_prompt(uint8_t *data, size_t len);
 * @param   ppResponse: Pointer to pointer to bytes.
 * @param   pLen : pointer to the number of bytes for transmission.
 * @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*          A response encoded into a buffer lent by crcb_get_tx_buffer() 
+*          is not available here.
 */
 int cr_get_coded_response_buffer(uint8_t **pResponse, size_t *len);
 
+#ifndef CR_NUM_STACK_INSTANCES
+    /// CR_NUM_STACK_INSTANCES can be set in reach-server.h when a device 
+    /// serves more than one link (ie, a gateway).  Each instance costs the
+    /// full set of buffers.
+  #define CR_NUM_STACK_INSTANCES    1
+#endif
+
+/**
+* @brief   cr_stack_create
+* @details Claims one of the CR_NUM_STACK_INSTANCES statically allocated stack 
+*          instances.  The first instance is the default instance and it is
+*          always available.  Each instance is independent: it has its own
+*          buffers, transactions, notifications and file transfers.  The
+*          functions that do not take a stack, like cr_process(), act on the
+*          active instance which is the default unless another is selected.
+* @param   app_context : Stored with the instance.  Callbacks can retrieve it 
+*                      with cr_stack_get_app_context().
+* @return  A pointer to the new instance, or NULL if all are in use.
+*/
+cr_stack_t *cr_stack_create(void *app_context);
+
+/**
+* @brief   cr_stack_release
+* @details Returns an instance claimed by cr_stack_create() to the pool.  The 
+*          default instance cannot be released.  Prompts loaned to it and
+*          transmit buffers lent to it are first handed back through
+*          crcb_return_coded_prompt() and crcb_send_tx_buffer().
+* @param   stack : The instance to release.
+* @return  cr_ErrorCodes_NO_ERROR or cr_ErrorCodes_INVALID_PARAMETER.
+*/
+int cr_stack_release(cr_stack_t *stack);
+
+/**
+* @brief   cr_get_default_stack
+* @return  The instance that exists without calling cr_stack_create().
+*/
+cr_stack_t *cr_get_default_stack(void);
+
+/**
+* @brief   cr_get_active_stack
+* @details The crcb_ callbacks do not take a stack argument.  A callback that 
+*          needs to know which link it is serving can call this.
+* @return  The instance currently being processed.  Outside of the stack this
+*          is the default instance unless changed by cr_set_active_stack().
+*/
+cr_stack_t *cr_get_active_stack(void);
+
+/**
+* @brief   cr_set_active_stack
+* @details Selects the instance used by the functions that do not take a 
+*          stack, such as cr_process(), cr_report_error() or cr_notify_stream().
+* @param   stack : The instance to select.  NULL selects the default.
+*/
+void cr_set_active_stack(cr_stack_t *stack);
+
+/**
+* @brief   cr_stack_get_app_context
+* @param   stack : The instance to query. 
+* @return  The app_context handed to cr_stack_create().
+*/
+void *cr_stack_get_app_context(const cr_stack_t *stack);
+
+/**
+* @brief   cr_send_complete
+* @details A transport that sends asynchronously returns 
+*          cr_ErrorCodes_INCOMPLETE from crcb_send_coded_response() and calls
+*          this when the frame is gone.  The frame buffer remains untouched
+*          until then.  This only marks the frame as done, so it is safe to
+*          call from an interrupt.  The next frame is sent by the following
+*          call to cr_process().
+* @param   result : cr_ErrorCodes_NO_ERROR or an error from the transport. 
+*/
+void cr_send_complete(int result);
+
+/**
+* @brief   cr_send_complete_ctx
+* @details As cr_send_complete(), for the given stack instance. 
+* @param   stack : The instance whose frame was sent.
+* @param   result : cr_ErrorCodes_NO_ERROR or an error from the transport. 
+*/
+void cr_send_complete_ctx(cr_stack_t *stack, int result);
+
+/**
+* @brief   cr_session_get_client
+* @details The crcb_ callbacks do not say which client they are serving. One 
+*          that needs to know, for example to grant access per client, can
+*          call this.  Sessions are enabled by defining CR_NUM_SESSIONS in
+*          reach-server.h.
+* @param   client_id : The client_id of the active session (output).
+* @param   endpoint_id : The endpoint_id of the active session (output).
+* @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_DATA if no client has 
+*          spoken yet.
+*/
+int cr_session_get_client(uint32_t *client_id, uint32_t *endpoint_id);
+
+/**
+* @brief   cr_session_challenge_key_is_valid
+* @details Access granted by the challenge key is remembered per session, 
+*          from the device info request of that client.  An implementation of
+*          crcb_access_granted() can use this to grant access per client.
+* @return  true if the client of the active session has presented a valid 
+*          challenge key.
+*/
+bool cr_session_challenge_key_is_valid(void);
+
+/**
+* @brief   cr_process_ctx
+* @details As cr_process(), for the given stack instance. 
+* @param   stack: The instance to run. 
+* @param   ticks: A measure of time passed, typically milliseconds. 
+* @return  As cr_process().
+*/
+int cr_process_ctx(cr_stack_t *stack, uint32_t ticks);
+
+/**
+* @brief   cr_store_coded_prompt_ctx
+* @details As cr_store_coded_prompt(), for the given stack instance. 
+* @param   stack: The instance to receive the prompt. 
+* @param   data: The coded prompt to be stored. 
+* @param   len : number of bytes to be stored. 
+* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*/
+int cr_store_coded_prompt_ctx(cr_stack_t *stack, uint8_t *data, size_t len);
+
+/**
+* @brief   cr_loan_coded_prompt_ctx
+* @details As cr_loan_coded_prompt(), for the given stack instance. 
+* @param   stack: The instance to receive the prompt. 
+* @param   data: The coded prompt, owned by the transport. 
+* @param   len : number of bytes in the prompt. 
+* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*/
+int cr_loan_coded_prompt_ctx(cr_stack_t *stack, const uint8_t *data, size_t len);
+
+/**
+* @brief   cr_get_coded_response_buffer_ctx
+* @details As cr_get_coded_response_buffer(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @param   ppResponse: Pointer to pointer to bytes.
+* @param   pLen : pointer to the number of bytes for transmission.
+* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*/
+int cr_get_coded_response_buffer_ctx(cr_stack_t *stack, uint8_t **ppResponse, size_t *pLen);
+
+/**
+* @brief   cr_set_comm_link_connected_ctx
+* @details As cr_set_comm_link_connected(), for the given stack instance. 
+* @param   stack: The instance whose link changed. 
+* @param   connected true if connected.
+*/
+void cr_set_comm_link_connected_ctx(cr_stack_t *stack, bool connected);
+
+/**
+* @brief   cr_get_comm_link_connected_ctx
+* @param   stack: The instance to query. 
+* @return  true if the communication link of this instance is connected.
+*/
+bool cr_get_comm_link_connected_ctx(const cr_stack_t *stack);
+
+/**
+* @brief   cr_get_next_process_ticks_ctx
+* @details As cr_get_next_process_ticks(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @return  The tick count at which to call cr_process_ctx().
+*/
+uint32_t cr_get_next_process_ticks_ctx(const cr_stack_t *stack);
+
+/**
+* @brief   cr_get_scheduler_statistics_ctx
+* @details As cr_get_scheduler_statistics(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @param   work_class : The class to report.
+* @param   stats : Filled in.
+* @return  cr_ErrorCodes_NO_ERROR or cr_ErrorCodes_INVALID_PARAMETER.
+*/
+int cr_get_scheduler_statistics_ctx(cr_stack_t *stack, cr_WorkClass work_class, 
+                                    cr_WorkClassStatistics *stats);
+
+/**
+* @brief   cr_process_budget_ctx
+* @details As cr_process_budget(), for the given stack instance. 
+* @param   stack: The instance to run. 
+* @param   ticks: As cr_process().
+* @param   max_work: The most units of work.  Zero for no limit.
+* @param   max_time: The most time by crcb_get_budget_clock().  Zero for no limit.
+* @return  As cr_process().
+*/
+int cr_process_budget_ctx(cr_stack_t *stack, uint32_t ticks, 
+                          uint32_t max_work, uint32_t max_time);
+
+/**
+* @brief   cr_get_process_statistics_ctx
+* @details As cr_get_process_statistics(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @param   stats : Filled in.
+*/
+void cr_get_process_statistics_ctx(cr_stack_t *stack, cr_ProcessStatistics *stats);
+
 /**
 * @brief   cr_report_error
 * @details Report an error condition to the client.  This can be called at any 
@@ -255,6 +609,20 @@ void  cr_init_param_notifications(void);
 */
 void cr_get_notification_statistics(uint32_t *numActive, uint32_t *numSent);
 
+/**
+* @brief   cr_param_changed
+* @details Tells the stack that the value of a parameter may have changed,
+*          so that its notification is checked by the next cr_process() 
+*          rather than when next polled.  It is still sent no sooner than 
+*          its minimum_notification_period allows.  Applies to every stack
+*          instance in use and is safe to call from an interrupt.  An event driven
+*          application should then wake cr_process(), as the ticks of 
+*          cr_get_next_process_ticks() do not know of it.  See 
+*          CR_PARAM_NOTIFY_POLL.
+* @param   pid The ID of the parameter.
+*/
+void cr_param_changed(uint32_t pid);
+
 /**
 * @brief   cr_get_current_ticks
 * @details The tick count is passed in to cr_process(). This function gives 
@@ -263,11 +631,102 @@ void cr_get_notification_statistics(uint32_t *numActive, uint32_t *numSent);
 */
 uint32_t cr_get_current_ticks();
 
+//----------------------------------------------------------------------------
+// Message dispatch
+//----------------------------------------------------------------------------
+
+/// Handles a decoded prompt and fills in the response.  Returns zero to 
+/// send the response, cr_ErrorCodes_NO_RESPONSE to send nothing, or an
+/// error to be reported.
+typedef int  (*cr_MessageHandler)(const void *request, void *response);
+/// Prints a decoded message.  Only used when logging is enabled.
+typedef void (*cr_MessageLogger)(const void *message);
+/// Encodes a message without the generic nanopb encoder.  Returns true on 
+/// success with the encoded size.
+typedef bool (*cr_PayloadEncoder)(const void *message, uint8_t *buffer, 
+                                  size_t buffer_size, size_t *encode_size);
+/// Decodes a message without the generic nanopb decoder.  Returns true on 
+/// success.
+typedef bool (*cr_PayloadDecoder)(void *message, const uint8_t *buffer, size_t size);
+
+/**
+* @brief   cr_MessageDescriptor
+* @details Everything the stack needs to know about one message type.  
+*          The built in types are described by a const table indexed by
+*          message type.  Vendor types are added with 
+*          cr_register_message_type().
+*/
+typedef struct
+{
+    int32_t             message_type;       ///< cr_ReachMessageTypes or a vendor type
+    const pb_msgdesc_t *request_fields;     ///< decodes a prompt of this type
+    const pb_msgdesc_t *response_fields;    ///< encodes a message of this type
+    cr_MessageHandler   handler;            ///< NULL if never received
+    cr_MessageLogger    log_request;        ///< may be NULL
+    cr_MessageLogger    log_response;       ///< may be NULL
+    int32_t             response_type;      ///< type of the response, 0 for the same
+    cr_PayloadDecoder   decode_request;     ///< NULL to decode with request_fields
+    cr_PayloadEncoder   encode_response;    ///< NULL to encode with response_fields
+    /// Fills in the next page of a continued transaction of this type, 
+    /// called with a NULL request.  NULL if the type is never continued.
+    cr_MessageHandler   next_page;
+} cr_MessageDescriptor;
+
+#ifndef CR_NUM_CUSTOM_MESSAGE_TYPES
+    /// The number of vendor message types that can be registered.
+  #define CR_NUM_CUSTOM_MESSAGE_TYPES   4
+#endif
+
+/**
+* @brief   cr_register_message_type
+* @details Adds a vendor specific message type so that an application can 
+*          offer its own services without changing the stack.  Prompts of
+*          this type are decoded with request_fields, passed to the handler
+*          and the response is encoded with the response_fields of the 
+*          response type.  The handler runs from cr_process() and can use 
+*          the same stack functions as the built in handlers.  The 
+*          descriptor is not copied and must remain valid.
+* @param   desc: Describes the new type.  
+* @return  cr_ErrorCodes_NO_ERROR, cr_ErrorCodes_INVALID_ID if the type 
+*          is already known, or cr_ErrorCodes_NO_RESOURCE if 
+*          CR_NUM_CUSTOM_MESSAGE_TYPES are already registered.
+*/
+int cr_register_message_type(const cr_MessageDescriptor *desc);
+
+/**
+* @brief   cr_get_message_descriptor
+* @param   message_type: A built in or registered type.  
+* @return  The descriptor of the type, or NULL if it is not supported.
+*/
+const cr_MessageDescriptor *cr_get_message_descriptor(int32_t message_type);
+
 /// <summary>
 /// Verify that buffer structures fit into limited size memory
 /// </summary>
 void cr_test_sizes();
 
+#ifdef CR_BUILD_CODEC_BENCHMARK
+/**
+* @brief   cr_benchmark_codecs
+* @details Times the specialized codecs of the busiest messages against the 
+*          generic nanopb path and checks that both give the same bytes.
+*          Only built when CR_BUILD_CODEC_BENCHMARK is defined, as it uses
+*          clock() and floating point.
+* @param   iterations: The number of times each message is coded.
+* @return  The number of messages for which the two paths differ.
+*/
+int cr_benchmark_codecs(uint32_t iterations);
+#endif  // def CR_BUILD_CODEC_BENCHMARK
+
+/**
+* @brief   cr_discovery_cache_invalidate
+* @details Empties the cache of discovery responses.  The cache is emptied 
+*          anyway when crcb_compute_parameter_hash() changes.  Call this if 
+*          the commands or the parameter descriptions change without 
+*          changing the hash.  Does nothing if CR_DISCOVERY_CACHE_SIZE is 0.
+*/
+void cr_discovery_cache_invalidate(void);
+
 
 /** The reach_sizes_t is used to communicate the sizes of device structures to
  *  clients.  These sizes can vary from one server to another and the client
@@ -80,13 +80,101 @@ int crcb_get_coded_prompt(uint8_t *prompt, size_t *len);
 /**
 * @brief   crcb_send_coded_response
 * @details The cr_process function calls this function to send responses to the client. 
-*          Must be overridden to send the data to the client.
+*          Must be overridden to send the data to the client.  When 
+*          CR_TX_QUEUE_DEPTH is set, frames come from the transmit queue,
+*          most urgent first.
+* @param   response    Pointer to coded data to be send (input)
+* @param   len    Number of bytes to be sent (input)
+* @return  cr_ErrorCodes_NO_ERROR when the frame has been sent.  
+*          cr_ErrorCodes_INCOMPLETE when the transport has taken the frame
+*          and will call cr_send_complete() when done.
+*          cr_ErrorCodes_NO_RESOURCE when the transport is busy and the frame
+*          should be offered again later.  Other errors drop the frame.
+*/
+int crcb_send_coded_response(const uint8_t *response, size_t len);
+
+/**
+* @brief   crcb_get_coded_prompt_ctx
+* @details The stack instance aware version of crcb_get_coded_prompt(), called 
+*          by cr_process_ctx().  The weak implementation calls
+*          crcb_get_coded_prompt() so that single link applications need not
+*          change.  A gateway overrides this to read from the link that belongs
+*          to the stack.
+* @param   stack  The instance asking for a prompt.  
+* @param   prompt    Pointer to raw data (output)
+* @param   len    Pointer to the number of bytes in the supplied prompt (output)
+* @return  cr_ErrorCodes_NO_ERROR on success.  cr_ErrorCodes_NO_DATA if no data is available.
+*/
+int crcb_get_coded_prompt_ctx(cr_stack_t *stack, uint8_t *prompt, size_t *len);
+
+/**
+* @brief   crcb_send_coded_response_ctx
+* @details The stack instance aware version of crcb_send_coded_response().  
+*          All responses and notifications go through here.  The weak
+*          implementation calls crcb_send_coded_response().
+* @param   stack  The instance sending.  
 * @param   response    Pointer to coded data to be send (input)
 * @param   len    Number of bytes to be sent (input)
 * @return  cr_ErrorCodes_NO_ERROR on success or a non-zero error preferably from the 
 *          cr_ErrorCodes_ enumeration
 */
-int crcb_send_coded_response(const uint8_t *response, size_t len);
+int crcb_send_coded_response_ctx(cr_stack_t *stack, const uint8_t *response, size_t len);
+
+/**
+* @brief   crcb_return_coded_prompt
+* @details Hands back a buffer lent by cr_loan_coded_prompt() once the 
+*          prompt in it has been handled.  The transport may then reuse the
+*          buffer.  Called from cr_process().  The weak implementation does
+*          nothing.
+* @param   stack  The instance that handled the prompt.  
+* @param   prompt The pointer that was lent.
+*/
+void crcb_return_coded_prompt(cr_stack_t *stack, const uint8_t *prompt);
+
+/**
+* @brief   crcb_get_tx_buffer
+* @details Lets the transport lend the stack the buffer that the next frame 
+*          will be sent from, such as a GATT notification buffer.  The frame
+*          is then encoded there directly and handed over with
+*          crcb_send_tx_buffer(), so it is never copied.  The stack asks only
+*          when no frames are waiting in its transmit queue.  The buffer
+*          need not be aligned.  The weak implementation returns NULL and
+*          frames are encoded into the stack's own buffers.
+* @param   stack  The instance that will encode the frame.  
+* @param   size   The size of the buffer (output).  At least 
+*                 CR_CODED_BUFFER_SIZE.
+* @return  The buffer, or NULL if none is available.
+*/
+uint8_t *crcb_get_tx_buffer(cr_stack_t *stack, size_t *size);
+
+/**
+* @brief   crcb_send_tx_buffer
+* @details Gives back a buffer lent by crcb_get_tx_buffer().  It now holds 
+*          a frame to be sent, or if len is zero the stack did not use it.
+*          Either way the buffer belongs to the transport again.
+* @param   stack  The instance that encoded the frame.  
+* @param   buffer The buffer that was lent.
+* @param   len    Number of bytes to be sent.  Zero to send nothing.
+* @return  cr_ErrorCodes_NO_ERROR or an error if the frame was dropped.
+*/
+int crcb_send_tx_buffer(cr_stack_t *stack, uint8_t *buffer, size_t len);
+
+/**
+* @brief   crcb_send_coded_segments
+* @details Sends one frame given as a list of segments.  An Ahsoka frame is 
+*          given as its two byte size prefix, its header and its payload so
+*          that a transport with chained buffers or DMA descriptors can
+*          gather them, or frame the header separately.  A classic frame is 
+*          one segment.  The return values are those of 
+*          crcb_send_coded_response().  The weak implementation passes 
+*          contiguous segments to crcb_send_coded_response_ctx() as one 
+*          span, without a copy.
+* @param   stack    The instance sending.  
+* @param   segments The pieces of the frame, in order.
+* @param   count    Number of segments.
+* @return  As crcb_send_coded_response().
+*/
+int crcb_send_coded_segments(cr_stack_t *stack, const cr_TxSegment *segments, int count);
 
 
 ///*************************************************************************
@@ -144,6 +232,34 @@ bool crcb_access_granted(const cr_ServiceIds service, const int32_t id);
 */
 void crcb_configure_access_control(const cr_DeviceInfoRequest *request, cr_DeviceInfoResponse *pDi);
 
+/**
+* @brief   crcb_get_prebuilt_discovery
+* @details Lets an application with fixed parameter and command tables 
+*          answer a discovery of everything with responses encoded when it
+*          was built, typically by tools/prebuild_discovery.c.  They are 
+*          only used if their parameter_hash matches 
+*          crcb_compute_parameter_hash() and their challenge_key_valid 
+*          matches the access of the client, as what a client may see 
+*          depends on its challenge key.  The weak implementation has none.
+* @param   message_type DISCOVER_PARAMETERS, DISCOVER_PARAM_EX or 
+*                       DISCOVER_COMMANDS.
+* @param   challenge_key_valid true for the responses seen by a client 
+*                              with a valid challenge key.
+* @return  The prebuilt responses or NULL to build them as usual.
+*/
+const cr_PrebuiltDiscovery *crcb_get_prebuilt_discovery(cr_ReachMessageTypes message_type,
+                                                        bool challenge_key_valid);
+
+/**
+* @brief   crcb_get_budget_clock
+* @details A free running count, such as a cycle counter or microseconds, 
+*          that measures the time spent in cr_process() and limits 
+*          cr_process_budget().  It wraps.  The weak implementation returns
+*          zero, so that no time is measured and time budgets are not used.
+* @return  The count now.
+*/
+uint32_t crcb_get_budget_clock(void);
+
 ///*************************************************************************
 ///  Link (ping) Service 
 ///*************************************************************************
@@ -168,7 +284,7 @@ int crcb_ping_get_signal_strength(int8_t *rssi);
   /// repository service.
   #define INCLUDE_PARAMETER_SERVICE
   /// #define in reach-server.h to specify the number of parameter
-  /// notifications supported.
+  /// notifications supported.  Each takes 38 bytes of every session.
   #define NUM_SUPPORTED_PARAM_NOTIFY 8
   /// #define in reach-server.h to include the command service.
   #define INCLUDE_COMMAND_SERVICE
@@ -333,6 +449,21 @@ int crcb_ping_get_signal_strength(int8_t *rssi);
     */
     uint32_t crcb_compute_parameter_hash(void);
 
+    /**
+    * @brief   crcb_get_parameter_table
+    * @details Lets an application whose parameters are described by a const 
+    *          table give it to the stack.  When CR_PARAM_REGISTRY_SIZE is not
+    *          zero, cr_init() indexes it by parameter ID, so that discovery, 
+    *          reads and notifications find a parameter directly instead of 
+    *          through crcb_parameter_discover_reset() and 
+    *          crcb_parameter_discover_next().  Values with storage in the 
+    *          table are read from it without crcb_parameter_read().  Writes 
+    *          still go to crcb_parameter_write().  The weak implementation 
+    *          has no table.
+    * @return  The table, which must not change after cr_init(), or NULL.
+    */
+    const cr_ParameterTable *crcb_get_parameter_table(void);
+
   #if NUM_SUPPORTED_PARAM_NOTIFY != 0
 
     /**
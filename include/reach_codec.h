@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2023-2024 i3 Product Development
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file      reach_codec.h
+ * @brief     Type specialized protobuf codecs for the messages that carry
+ *            most of the traffic.  They produce the same bytes as nanopb.
+ *
+ * @copyright (c) Copyright 2023 i3 Product Development. All Rights Reserved.
+ */
+
+#ifndef __REACH_CODEC_H__
+#define __REACH_CODEC_H__
+
+#include "reach.pb.h"
+#include <stdint.h>
+
+/**
+* @brief   encode_file_transfer_data
+* @details Encodes a cr_FileTransferData.
+* @param   message :  in:  a cr_FileTransferData
+* @param   buffer :  out:  encode to here
+* @param   buffer_size :  in:  size of buffer
+* @param   encode_size :  out:  encoded size
+* @return  true if no error.
+*/
+bool encode_file_transfer_data(const void *message, uint8_t *buffer,
+                               size_t buffer_size, size_t *encode_size);
+
+/**
+* @brief   decode_file_transfer_data
+* @details Decodes a cr_FileTransferData without clearing the data array.
+* @param   message :  out:  a cr_FileTransferData
+* @param   buffer :  in:  encoded
+* @param   size :  in:  size of encoded buffer
+* @return  true if no error.
+*/
+bool decode_file_transfer_data(void *message, const uint8_t *buffer, size_t size);
+
+/**
+* @brief   encode_stream_data
+* @details Encodes a cr_StreamData.
+* @param   message :  in:  a cr_StreamData
+* @param   buffer :  out:  encode to here
+* @param   buffer_size :  in:  size of buffer
+* @param   encode_size :  out:  encoded size
+* @return  true if no error.
+*/
+bool encode_stream_data(const void *message, uint8_t *buffer,
+                        size_t buffer_size, size_t *encode_size);
+
+/**
+* @brief   decode_stream_data
+* @details Decodes a cr_StreamData without clearing the data array.
+* @param   message :  out:  a cr_StreamData
+* @param   buffer :  in:  encoded
+* @param   size :  in:  size of encoded buffer
+* @return  true if no error.
+*/
+bool decode_stream_data(void *message, const uint8_t *buffer, size_t size);
+
+/**
+* @brief   encode_parameter_notification
+* @details Encodes a cr_ParameterNotification.  Only the values_count
+*          values in use are visited.
+* @param   message :  in:  a cr_ParameterNotification
+* @param   buffer :  out:  encode to here
+* @param   buffer_size :  in:  size of buffer
+* @param   encode_size :  out:  encoded size
+* @return  true if no error.
+*/
+bool encode_parameter_notification(const void *message, uint8_t *buffer,
+                                   size_t buffer_size, size_t *encode_size);
+
+#endif /* __REACH_CODEC_H__ */
@@ -34,8 +34,8 @@
 /**
 * @brief   decode_reach_payload
 * @details Apply the protobuf decode function to the buffer. 
-*          Feeds pb_decode() the necessary structure based on
-*          the message type.
+*          The request fields of the message type are found with 
+*          cr_get_message_descriptor().
 * @param   message_type :  in:  from the header
 * @param   data :  out:  decode to here
 * @param   buffer :  in:  encoded, from the header
@@ -61,6 +61,19 @@ bool decode_reach_message(cr_ReachMessage *message,           // out: decoded
                           const uint8_t *in_buffer,           // in:  encoded
                           size_t in_size);                    // in:  encoded size
 
+/**
+* @brief   decode_ahsoka_header
+* @details Decodes the Ahsoka header without the generic nanopb field
+*          iterator, falling back to pb_decode() for unusual encodings.
+* @param   header :  out:  decode to here
+* @param   buffer :  in:  encoded, after the two byte size prefix
+* @param   size :  in:  size of the encoded header
+* @return  true if no error.
+*/
+bool decode_ahsoka_header(cr_AhsokaMessageHeader *header,     // out: decoded
+                          const uint8_t *in_buffer,           // in:  encoded
+                          size_t in_size);                    // in:  encoded size
+
 /**
 * @brief   cr_get_transaction_id
 * @return  Return the current transaction ID.
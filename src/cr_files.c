@@ -145,27 +145,15 @@ int pvtCrFile_discover(const cr_DiscoverFiles *request,
         I3_LOG(LOG_MASK_PARAMS, "Added file %d.", response->file_infos_count);
         response->file_infos_count++;
     }
+    // A full page.  The rest follow as a continued transaction.
+    pvtCr_num_remaining_objects = 
+        (pvtCr_num_remaining_objects > REACH_DISCOVER_FILES_COUNT) ?
+            pvtCr_num_remaining_objects - REACH_DISCOVER_FILES_COUNT : 0;
     return 0;
 }
 
-typedef PB_BYTES_ARRAY_T(REACH_BYTES_IN_A_FILE_PACKET) cr_FileTransferStateMachine_message_data_t;
-typedef struct _cr_FileTransferStateMachine {
-    cr_FileTransferState    state;
-    uint32_t                transfer_id;    // determined on init
-    int32_t                 file_id;        // requested at init
-    int32_t                 timeout_in_ms;  // requested at init
-    uint32_t                request_offset; // requested at init
-    uint32_t                transfer_length;    // requested at init
-    uint8_t                 read_write;         // 0: read, 1: write.
-    uint32_t                message_number;     // rolling counter
-    int32_t                 checksum;
-    uint32_t                messages_per_ack;   // target, fixed
-    uint32_t                messages_until_ack; // current, counts down
-    uint32_t                bytes_transfered;   // to date
-    bool                    use_checksum;
-} cr_FileTransferStateMachine;
-
-cr_FileTransferStateMachine sCr_file_xfer_state;
+// The transfer state is held in the active session.
+#define sCr_file_xfer_state     (pvtCr_session->file_xfer_state)
 
 int pvtCrFile_transfer_init(const cr_FileTransferRequest *request,
                             cr_FileTransferResponse *response)
@@ -182,6 +170,7 @@ int pvtCrFile_transfer_init(const cr_FileTransferRequest *request,
     response->transfer_id = request->transfer_id;
     memset(&sCr_file_xfer_state, 0, sizeof(cr_FileTransferStateMachine));
     sCr_file_xfer_state.state = cr_FileTransferState_IDLE;
+    sCr_file_xfer_state.transaction_id = pvtCr_session->transaction_id;
     int rval = crcb_file_get_description(request->file_id, &file_desc);
     if (rval != 0)
     {
@@ -346,6 +335,7 @@ int pvtCrFile_transfer_data(const cr_FileTransferData *dataTransfer,
 
     // we receive this on write.
     memset(response, 0, sizeof(cr_FileTransferDataNotification));
+    sCr_file_xfer_state.transaction_id = pvtCr_session->transaction_id;
     switch (sCr_file_xfer_state.state)
     {
     default:
@@ -539,6 +529,7 @@ int pvtCrFile_transfer_data_notification(const cr_FileTransferDataNotification *
     // And it can generate repeated responses.
     if (request)
     {   // responding to a prompt.
+        sCr_file_xfer_state.transaction_id = pvtCr_session->transaction_id;
         switch (sCr_file_xfer_state.state)
         {
         default:
@@ -711,13 +702,37 @@ int pvtCrFile_erase_file(const cr_FileEraseRequest *request,
 }
 
 
+// Abandons the transfer in progress, as asked by the client.
+bool pvtCrFile_cancel(uint32_t transaction_id)
+{
+    switch (sCr_file_xfer_state.state)
+    {
+    case cr_FileTransferState_INIT:
+    case cr_FileTransferState_DATA:
+    case cr_FileTransferState_COMPLETE:
+        break;
+    default:
+        return false;   // nothing in progress
+    }
+    if ((transaction_id != 0) && (transaction_id != sCr_file_xfer_state.transaction_id))
+        return false;
+
+    I3_LOG(LOG_MASK_FILES, "File transfer %d of fid %d cancelled after %d bytes.", 
+           sCr_file_xfer_state.transfer_id, sCr_file_xfer_state.file_id,
+           sCr_file_xfer_state.bytes_transfered);
+    sCr_file_xfer_state.state = cr_FileTransferState_IDLE;
+    sCr_file_xfer_state.messages_until_ack = 0;
+    pvtCr_watchdog_end_timeout();
+    return true;
+}
+
 // 
 // Timeout Watchdog interface
 // This is used in the file write sequences.
 // 
-static bool  sTimeoutWatchdog_is_active = false;
-static uint32_t sTimeoutWatchdog_period = 0;
-static uint32_t sTimeoutWatchdog_target = 0;
+#define sTimeoutWatchdog_is_active  (pvtCr_session->watchdog_is_active)
+#define sTimeoutWatchdog_period     (pvtCr_session->watchdog_period)
+#define sTimeoutWatchdog_target     (pvtCr_session->watchdog_target)
 
 // 0 ms disables watchdog.
 void pvtCr_watchdog_start_timeout(uint32_t msec, uint32_t ticks)
@@ -58,7 +58,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include <math.h>
 
 // H file provided by the app to configure the stack.
 #include "reach-server.h"
@@ -77,21 +76,258 @@
     #include "reach_decode.h"
     #include "reach_version.h"
 
-    static uint32_t sCr_num_ex_this_pid = 0;
-    static int16_t sCr_requested_param_array[REACH_COUNT_PARAMS_IN_REQUEST];
-    static uint8_t sCr_requested_param_info_count = 0;
-    static uint8_t sCr_requested_param_index = 0;
-    static uint8_t sCr_requested_notify_count = 0;
-    static uint8_t sCr_requested_param_read_count = 0;
+    // The parameter service state is held in the active session.
+    #define sCr_num_ex_this_pid             (pvtCr_cursor->num_ex_this_pid)
+    #define sCr_requested_param_array       (pvtCr_cursor->requested_param_array)
+    #define sCr_requested_param_info_count  (pvtCr_cursor->requested_param_info_count)
+    #define sCr_requested_param_index       (pvtCr_cursor->requested_param_index)
+    #define sCr_requested_notify_count      (pvtCr_cursor->requested_notify_count)
+    #define sCr_requested_param_read_count  (pvtCr_cursor->requested_param_read_count)
   #if NUM_SUPPORTED_PARAM_NOTIFY != 0
     /// check these params for notification
-    static uint32_t sCr_numNotificationsSent = 0;
-    static cr_ParameterNotifyConfig sCr_param_notify_list[NUM_SUPPORTED_PARAM_NOTIFY];
+    #define sCr_numNotificationsSent        (pvtCr_session->num_notifications_sent)
+    #define sCr_notify_count                (pvtCr_session->notify_count)
+    #define sCr_notify_pid                  (pvtCr_session->notify_pid)
+    #define sCr_notify_min_period           (pvtCr_session->notify_min_period)
+    #define sCr_notify_max_period           (pvtCr_session->notify_max_period)
+    #define sCr_notify_min_delta            (pvtCr_session->notify_min_delta)
     /// storage of the previous value
-    static cr_ParameterValue sCr_last_param_values[NUM_SUPPORTED_PARAM_NOTIFY];
-    static uint8_t sCr_requested_notify_index = 0;
+    #define sCr_notify_last_ticks           (pvtCr_session->notify_last_ticks)
+    #define sCr_notify_last                 (pvtCr_session->notify_last)
+    #define sCr_notify_by_pid               (pvtCr_session->notify_by_pid)
+    #define sCr_requested_notify_index      (pvtCr_cursor->requested_notify_index)
+    /// The list of the session changed, so its heap is rebuilt.
+    #define sCr_notify_list_changed()                       \
+        do {                                                \
+            pvtCr_session->notify_heap_valid = false;       \
+            pvtCr_session->notify_due_valid  = false;       \
+        } while (0)
   #endif
 
+    /// The cr_ParameterValue which_value of a cr_ParameterInfo which_desc.  
+    /// The two oneofs list the types in the same order.
+    #define sCr_value_tag(which_desc)   \
+        ((which_desc) - cr_ParameterInfo_uint32_desc_tag + cr_ParameterValue_uint32_value_tag)
+
+  #if CR_PARAM_REGISTRY_SIZE > 0
+    /// The number of hash slots of the registry.  At least half are empty,
+    /// so that probes are short and always end.
+    #define CR_PARAM_REGISTRY_SLOTS     (2 * CR_PARAM_REGISTRY_SIZE)
+
+    /// @private The table of crcb_get_parameter_table(), once indexed.
+    static const cr_ParameterTable *sCr_registry = NULL;
+    /// @private The index of the table hashed by parameter ID.  Holds 1 + the
+    /// position in the table, or 0 if empty.
+    static uint16_t sCr_registry_slots[CR_PARAM_REGISTRY_SLOTS];
+    /// @private The cr_ParameterValue which_value of each parameter.
+    static uint8_t  sCr_registry_type[CR_PARAM_REGISTRY_SIZE];
+    /// @private The size of the storage of each value.
+    static uint8_t  sCr_registry_size[CR_PARAM_REGISTRY_SIZE];
+
+    /// @private
+    static uint32_t sCr_registry_hash(uint32_t pid)
+    {
+        return (uint32_t)(pid * 2654435761u) % CR_PARAM_REGISTRY_SLOTS;
+    }
+
+    /// @private Returns the position of pid in the table, or -1.
+    static int sCr_registry_find(uint32_t pid)
+    {
+        if (sCr_registry == NULL)
+            return -1;
+        uint32_t slot = sCr_registry_hash(pid);
+        while (sCr_registry_slots[slot] != 0)
+        {
+            int idx = sCr_registry_slots[slot] - 1;
+            if (sCr_registry->params[idx].id == pid)
+                return idx;
+            if (++slot == CR_PARAM_REGISTRY_SLOTS)
+                slot = 0;
+        }
+        return -1;
+    }
+
+    /// @private The size of the storage of a value of type which_value.
+    static uint8_t sCr_value_size(pb_size_t which_value)
+    {
+        #define sCr_member_size(m)  sizeof(((cr_ParameterValue *)0)->value.m)
+        switch (which_value)
+        {
+        case cr_ParameterValue_uint32_value_tag:
+        case cr_ParameterValue_enum_value_tag:
+            return sCr_member_size(uint32_value);
+        case cr_ParameterValue_int32_value_tag:
+            return sCr_member_size(int32_value);
+        case cr_ParameterValue_float32_value_tag:
+            return sCr_member_size(float32_value);
+        case cr_ParameterValue_uint64_value_tag:
+        case cr_ParameterValue_bitfield_value_tag:
+            return sCr_member_size(uint64_value);
+        case cr_ParameterValue_int64_value_tag:
+            return sCr_member_size(int64_value);
+        case cr_ParameterValue_float64_value_tag:
+            return sCr_member_size(float64_value);
+        case cr_ParameterValue_bool_value_tag:
+            return sCr_member_size(bool_value);
+        case cr_ParameterValue_string_value_tag:
+            return sCr_member_size(string_value);
+        case cr_ParameterValue_bytes_value_tag:
+            return sCr_member_size(bytes_value);
+        default:
+            return 0;
+        }
+        #undef sCr_member_size
+    }
+  #endif // CR_PARAM_REGISTRY_SIZE > 0
+
+    int pvtCrParam_registry_init(void)
+    {
+      #if CR_PARAM_REGISTRY_SIZE > 0
+        const cr_ParameterTable *table = crcb_get_parameter_table();
+        sCr_registry = NULL;
+        memset(sCr_registry_slots, 0, sizeof(sCr_registry_slots));
+        if (table == NULL)
+            return cr_ErrorCodes_NO_ERROR;
+        if (table->num_params > CR_PARAM_REGISTRY_SIZE)
+        {
+            I3_LOG(LOG_MASK_ERROR, "%d parameters exceed CR_PARAM_REGISTRY_SIZE (%d).",
+                   table->num_params, CR_PARAM_REGISTRY_SIZE);
+            return cr_ErrorCodes_NO_RESOURCE;
+        }
+
+        for (uint16_t i=0; i<table->num_params; i++)
+        {
+            const cr_ParameterInfo *pInfo = &table->params[i];
+            if ((pInfo->which_desc < cr_ParameterInfo_uint32_desc_tag) ||
+                (pInfo->which_desc > cr_ParameterInfo_bytearray_desc_tag))
+            {
+                I3_LOG(LOG_MASK_ERROR, "PID %d has no type.", pInfo->id);
+                memset(sCr_registry_slots, 0, sizeof(sCr_registry_slots));
+                return cr_ErrorCodes_INVALID_PARAMETER;
+            }
+            uint32_t slot = sCr_registry_hash(pInfo->id);
+            while (sCr_registry_slots[slot] != 0)
+            {
+                if (table->params[sCr_registry_slots[slot] - 1].id == pInfo->id)
+                {
+                    I3_LOG(LOG_MASK_ERROR, "PID %d is in the table twice.", pInfo->id);
+                    memset(sCr_registry_slots, 0, sizeof(sCr_registry_slots));
+                    return cr_ErrorCodes_INVALID_PARAMETER;
+                }
+                if (++slot == CR_PARAM_REGISTRY_SLOTS)
+                    slot = 0;
+            }
+            sCr_registry_slots[slot] = i + 1;
+            sCr_registry_type[i] = sCr_value_tag(pInfo->which_desc);
+            sCr_registry_size[i] = sCr_value_size(sCr_registry_type[i]);
+        }
+        sCr_registry = table;
+        I3_LOG(LOG_MASK_PARAMS, "Indexed %d parameters.", table->num_params);
+      #endif // CR_PARAM_REGISTRY_SIZE > 0
+        return cr_ErrorCodes_NO_ERROR;
+    }
+
+    /// @private The number of parameters.
+    static int sCrParam_count(void)
+    {
+      #if CR_PARAM_REGISTRY_SIZE > 0
+        if (sCr_registry != NULL)
+            return sCr_registry->num_params;
+      #endif
+        return crcb_parameter_get_count();
+    }
+
+    /// @private Starts a walk of all parameters with sCrParam_next().
+    static void sCrParam_first(void)
+    {
+      #if CR_PARAM_REGISTRY_SIZE > 0
+        // The registry finds its place from pvtCr_num_remaining_objects.
+        if (sCr_registry != NULL)
+            return;
+      #endif
+        crcb_parameter_discover_reset(0);
+    }
+
+    /// @private Gets the description of the next parameter of a walk of all
+    /// of them, while pvtCr_num_remaining_objects counts down from 
+    /// sCrParam_count().  With the registry only the id is filled when 
+    /// pDesc is NULL.
+    static int sCrParam_next(cr_ParameterInfo *pDesc, uint32_t *pid)
+    {
+      #if CR_PARAM_REGISTRY_SIZE > 0
+        if (sCr_registry != NULL)
+        {
+            if ((pvtCr_num_remaining_objects == 0) ||
+                (pvtCr_num_remaining_objects > sCr_registry->num_params))
+                return cr_ErrorCodes_INVALID_ID;
+            const cr_ParameterInfo *pInfo = 
+                &sCr_registry->params[sCr_registry->num_params - pvtCr_num_remaining_objects];
+            if (pDesc != NULL)
+                memcpy(pDesc, pInfo, sizeof(cr_ParameterInfo));
+            *pid = pInfo->id;
+            return cr_ErrorCodes_NO_ERROR;
+        }
+      #endif
+        cr_ParameterInfo paramInfo;
+        if (pDesc == NULL)
+            pDesc = &paramInfo;
+        int rval = crcb_parameter_discover_next(pDesc);
+        *pid = pDesc->id;
+        return rval;
+    }
+
+    /// @private Gets the description of parameter pid.
+    static int sCrParam_describe(uint32_t pid, cr_ParameterInfo *pDesc)
+    {
+      #if CR_PARAM_REGISTRY_SIZE > 0
+        if (sCr_registry != NULL)
+        {
+            int idx = sCr_registry_find(pid);
+            if (idx < 0)
+                return cr_ErrorCodes_INVALID_ID;
+            memcpy(pDesc, &sCr_registry->params[idx], sizeof(cr_ParameterInfo));
+            return cr_ErrorCodes_NO_ERROR;
+        }
+      #endif
+        int rval = crcb_parameter_discover_reset(pid);
+        if (rval != cr_ErrorCodes_NO_ERROR)
+            return rval;
+        return crcb_parameter_discover_next(pDesc);
+    }
+
+  #if NUM_SUPPORTED_PARAM_NOTIFY != 0
+    /// @private Returns cr_ErrorCodes_NO_ERROR if parameter pid exists.
+    static int sCrParam_exists(uint32_t pid)
+    {
+      #if CR_PARAM_REGISTRY_SIZE > 0
+        if (sCr_registry != NULL)
+            return (sCr_registry_find(pid) < 0) ? cr_ErrorCodes_INVALID_ID : cr_ErrorCodes_NO_ERROR;
+      #endif
+        return crcb_parameter_discover_reset(pid);
+    }
+  #endif // NUM_SUPPORTED_PARAM_NOTIFY != 0
+
+    /// @private Reads parameter pid, from its storage in the registry if it 
+    /// has one, else with crcb_parameter_read().
+    static int sCrParam_read(uint32_t pid, cr_ParameterValue *pVal)
+    {
+      #if CR_PARAM_REGISTRY_SIZE > 0
+        int idx = sCr_registry_find(pid);
+        if ((idx >= 0) && (sCr_registry->values != NULL) && 
+            (sCr_registry->values[idx] != NULL))
+        {
+            memset(pVal, 0, sizeof(cr_ParameterValue));
+            pVal->parameter_id = pid;
+            pVal->which_value  = sCr_registry_type[idx];
+            memcpy(&pVal->value, sCr_registry->values[idx], sCr_registry_size[idx]);
+            if (pVal->which_value == cr_ParameterValue_string_value_tag)
+                pVal->value.string_value[sizeof(pVal->value.string_value) - 1] = 0;
+            return cr_ErrorCodes_NO_ERROR;
+        }
+      #endif
+        return crcb_parameter_read(pid, pVal);
+    }
+
     /**
     * @brief   pvtCrParam_discover_parameters
     * @details Private function responsible to respond to a discover 
@@ -139,7 +375,7 @@
             }
             else
             {
-                pvtCr_num_remaining_objects = crcb_parameter_get_count();
+                pvtCr_num_remaining_objects = sCrParam_count();
             }
             if (pvtCr_num_remaining_objects > REACH_COUNT_PARAM_DESC_IN_RESPONSE)
             {
@@ -153,9 +389,9 @@
         {
             if (request != NULL)
             {   // first time
-                crcb_parameter_discover_reset(0);
+                sCrParam_first();
                 sCr_requested_param_info_count = 0;
-                pvtCr_num_remaining_objects = crcb_parameter_get_count();
+                pvtCr_num_remaining_objects = sCrParam_count();
                 // default on first.
                 pvtCr_continued_message_type = cr_ReachMessageTypes_DISCOVER_PARAMETERS;
             }
@@ -164,7 +400,8 @@
             response->parameter_infos_count = 0;
             for (int i=0; i<REACH_COUNT_PARAM_DESC_IN_RESPONSE; i++) 
             {
-                rval = crcb_parameter_discover_next(&response->parameter_infos[i]);
+                uint32_t pid;
+                rval = sCrParam_next(&response->parameter_infos[i], &pid);
                 if (rval != cr_ErrorCodes_NO_ERROR) 
                 {   // there are no more params.  clear on last.
                     pvtCr_num_remaining_objects = 0;
@@ -210,8 +447,8 @@
             }
             I3_LOG(LOG_MASK_PARAMS, "Add param %d from list of %d", 
                    sCr_requested_param_index, sCr_requested_param_info_count);
-            crcb_parameter_discover_reset(sCr_requested_param_array[sCr_requested_param_index]);
-            rval = crcb_parameter_discover_next(&response->parameter_infos[i]);
+            rval = sCrParam_describe(sCr_requested_param_array[sCr_requested_param_index],
+                                     &response->parameter_infos[i]);
             sCr_requested_param_array[sCr_requested_param_index] = -1;
             if (rval != cr_ErrorCodes_NO_ERROR) {
                 // we've done them all.
@@ -397,7 +634,7 @@
             {
                 sCr_requested_param_index = 0;
                 I3_LOG(LOG_MASK_PARAMS, "READ all PARAMETERS.");
-                pvtCr_num_remaining_objects = crcb_parameter_get_count();
+                pvtCr_num_remaining_objects = sCrParam_count();
             }
             if (pvtCr_num_remaining_objects > REACH_COUNT_PARAM_READ_VALUES)
             {
@@ -411,18 +648,16 @@
         {
             if (request != NULL)
             {   // first time
-                crcb_parameter_discover_reset(0);
-                pvtCr_num_remaining_objects = crcb_parameter_get_count();
+                sCrParam_first();
+                pvtCr_num_remaining_objects = sCrParam_count();
                 // default on first.
                 pvtCr_continued_message_type = cr_ReachMessageTypes_READ_PARAMETERS;
             }
             response->values_count = 0;
             for (int i=0; i<REACH_COUNT_PARAM_READ_VALUES; i++) 
             {
-                // Would use less stack if we got a pointer into flash instead of the actual data.
-                // But that makes other calls more complicated. 
-                cr_ParameterInfo paramInfo;
-                rval = crcb_parameter_discover_next(&paramInfo);
+                uint32_t pid;
+                rval = sCrParam_next(NULL, &pid);
                 if (rval != cr_ErrorCodes_NO_ERROR) 
                 {   // there are no more params.  clear on last.
                     pvtCr_num_remaining_objects = 0;
@@ -436,10 +671,9 @@
                     return 0;
                 }
                 // I3_LOG(LOG_MASK_PARAMS, "line %d, call crcb_parameter_read(%d).", 
-                //        __LINE__, paramInfo.id);
-                rval = crcb_parameter_read(paramInfo.id, &response->values[i]);
+                //        __LINE__, pid);
+                rval = sCrParam_read(pid, &response->values[i]);
                 if (rval == cr_ErrorCodes_INVALID_PARAMETER) {
-                    int pid = paramInfo.id;
                     I3_LOG(LOG_MASK_ERROR, "crcb_parameter_read(pid %d) returned %d, INVALID_PARAMETER.", 
                               pid, rval);
                     cr_report_error(rval, "pid %d is not valid.", pid);
@@ -447,7 +681,6 @@
                     response->values[i].parameter_id = pid;
                 }
                 else if (rval != cr_ErrorCodes_NO_ERROR) {
-                    int pid = paramInfo.id;
                     cr_report_error(rval, "pid %d is not valid, ret %d.", pid, rval);
                     I3_LOG(LOG_MASK_ERROR, "crcb_parameter_read(pid %d) returned %d.",
                               pid, rval);
@@ -493,8 +726,8 @@
                    sCr_requested_param_read_count);
 
             cr_ParameterValue paramVal;
-            rval = crcb_parameter_read(sCr_requested_param_array[sCr_requested_param_index], 
-                                       &paramVal);
+            rval = sCrParam_read(sCr_requested_param_array[sCr_requested_param_index], 
+                                 &paramVal);
 
             if (rval == cr_ErrorCodes_INVALID_PARAMETER) {
                 I3_LOG(LOG_MASK_ERROR, "crcb_parameter_read(pid %d) returned %d, INVALID_PARAMETER.", 
@@ -579,23 +812,85 @@
 
   #if NUM_SUPPORTED_PARAM_NOTIFY != 0
 
-    static int sParameter_notification_get_by_pid(uint32_t pid, cr_ParameterNotifyConfig **ppConfig)
+    /// @private Finds the position of pid in notify_by_pid, or the position
+    /// at which it belongs.  Returns true if it is there.
+    static bool sCr_notify_search(uint32_t pid, uint16_t *pPos)
     {
-        if (pid == 0)
-        {
-            *ppConfig = NULL;
-            return cr_ErrorCodes_INVALID_PARAMETER;
-        }
-        for (int i=0; i<NUM_SUPPORTED_PARAM_NOTIFY; i++)
+        uint16_t lo = 0, hi = sCr_notify_count;
+        while (lo < hi)
         {
-            if (sCr_param_notify_list[i].parameter_id == pid)
-            {
-                *ppConfig = &sCr_param_notify_list[i];
-                return cr_ErrorCodes_NO_ERROR;
-            }
+            uint16_t mid = lo + (hi - lo) / 2;
+            if (sCr_notify_pid[sCr_notify_by_pid[mid]] < pid)
+                lo = mid + 1;
+            else
+                hi = mid;
         }
-        *ppConfig = NULL;
-        return cr_ErrorCodes_INVALID_PARAMETER;
+        *pPos = lo;
+        return (lo < sCr_notify_count) && (sCr_notify_pid[sCr_notify_by_pid[lo]] == pid);
+    }
+
+    /// @private The slot notifying on pid, or -1.
+    static int sCr_notify_find(uint32_t pid)
+    {
+        uint16_t pos;
+        return sCr_notify_search(pid, &pos) ? sCr_notify_by_pid[pos] : -1;
+    }
+
+    /// @private Copies the configuration of a slot.
+    static void sCr_notify_get_config(uint16_t slot, cr_ParameterNotifyConfig *pConfig)
+    {
+        pConfig->parameter_id                = sCr_notify_pid[slot];
+        pConfig->minimum_notification_period = sCr_notify_min_period[slot];
+        pConfig->maximum_notification_period = sCr_notify_max_period[slot];
+        pConfig->minimum_delta               = sCr_notify_min_delta[slot];
+    }
+
+    /// @private Sets the periods and delta of a slot.
+    static void sCr_notify_set_config(uint16_t slot, const cr_ParameterNotifyConfig *pConfig)
+    {
+        sCr_notify_min_period[slot] = pConfig->minimum_notification_period;
+        sCr_notify_max_period[slot] = pConfig->maximum_notification_period;
+        sCr_notify_min_delta[slot]  = pConfig->minimum_delta;
+    }
+
+    /// @private Takes a free slot for a parameter that has none.  Its last 
+    /// value is zero.  Returns the slot, or -1 if all are in use.
+    static int sCr_notify_add(const cr_ParameterNotifyConfig *pConfig)
+    {
+        uint16_t pos;
+        if (sCr_notify_count >= NUM_SUPPORTED_PARAM_NOTIFY)
+            return -1;
+        sCr_notify_search(pConfig->parameter_id, &pos);
+        uint16_t slot = sCr_notify_count++;
+        memmove(&sCr_notify_by_pid[pos + 1], &sCr_notify_by_pid[pos],
+                (slot - pos) * sizeof(sCr_notify_by_pid[0]));
+        sCr_notify_by_pid[pos] = slot;
+        sCr_notify_pid[slot] = pConfig->parameter_id;
+        sCr_notify_set_config(slot, pConfig);
+        sCr_notify_last_ticks[slot] = 0;
+        memset(&sCr_notify_last[slot], 0, sizeof(cr_NotifyValue));
+        return slot;
+    }
+
+    /// @private Frees the slot at position pos of notify_by_pid.  The last 
+    /// slot moves into it, so the heap must be rebuilt.
+    static void sCr_notify_remove(uint16_t pos)
+    {
+        uint16_t slot = sCr_notify_by_pid[pos];
+        uint16_t last = --sCr_notify_count;
+        memmove(&sCr_notify_by_pid[pos], &sCr_notify_by_pid[pos + 1],
+                (last - pos) * sizeof(sCr_notify_by_pid[0]));
+        if (slot == last)
+            return;
+        uint16_t lastPos;
+        sCr_notify_search(sCr_notify_pid[last], &lastPos);
+        sCr_notify_by_pid[lastPos]  = slot;
+        sCr_notify_pid[slot]        = sCr_notify_pid[last];
+        sCr_notify_min_period[slot] = sCr_notify_min_period[last];
+        sCr_notify_max_period[slot] = sCr_notify_max_period[last];
+        sCr_notify_min_delta[slot]  = sCr_notify_min_delta[last];
+        sCr_notify_last_ticks[slot] = sCr_notify_last_ticks[last];
+        sCr_notify_last[slot]       = sCr_notify_last[last];
     }
 
     static bool sParamNotifyEnabled(const cr_ParameterNotifyConfig *pCfg)
@@ -614,13 +909,7 @@
         *numSent   = 0;
         return;
       #else
-        uint32_t active = 0;
-        for (int i=0; i<NUM_SUPPORTED_PARAM_NOTIFY; i++)
-        {
-            if (sParamNotifyEnabled(&sCr_param_notify_list[i]))
-                active++;
-        }
-        *numActive = active; 
+        *numActive = sCr_notify_count; 
         *numSent = sCr_numNotificationsSent;
         sCr_numNotificationsSent = 0;
       #endif  // NUM_SUPPORTED_PARAM_NOTIFY == 0
@@ -637,10 +926,6 @@
             return cr_ErrorCodes_NO_DATA;
         }
 
-        int rval;
-        static bool checkAll;
-        cr_ParameterNotifyConfig *pConfig;
-        cr_ParameterInfo paramInfo;
         size_t numActive = cr_get_active_notify_count();
 
         // init them all to 0 meaning invalid.
@@ -662,16 +947,15 @@
             sCr_requested_notify_index = 0;
             if (request->parameter_ids_count != 0) 
             {
-                // some specific numbers are requested.  Remember them.
-                checkAll = false;
+                // some specific numbers are requested.  Remember those 
+                // that are notifying.
+                pvtCr_cursor->discover_all_notifications = false;
                 affirm(request->parameter_ids_count<= REACH_COUNT_PARAM_IDS);
                 sCr_requested_notify_count = 0;
                 for (int i=0; i<request->parameter_ids_count; i++)
                 {
-                    sCr_requested_param_array[i] = request->parameter_ids[i];
-                    sParameter_notification_get_by_pid(sCr_requested_param_array[i], &pConfig);
-                    if (pConfig && sParamNotifyEnabled(pConfig))
-                        sCr_requested_notify_count++;
+                    if (sCr_notify_find(request->parameter_ids[i]) >= 0)
+                        sCr_requested_param_array[sCr_requested_notify_count++] = request->parameter_ids[i];
                 }
                 sCr_requested_notify_index = 0;
                 I3_LOG(LOG_MASK_PARAMS, "%s, partial notification count %d.", 
@@ -680,70 +964,40 @@
             else
             {
                 // count is zero, so setup for all
-                checkAll = true;
+                pvtCr_cursor->discover_all_notifications = true;
                 sCr_requested_notify_count = numActive;
                 sCr_requested_notify_index = 0;
                 I3_LOG(LOG_MASK_PARAMS, "%s, full notification count %d.", 
                        __FUNCTION__, sCr_requested_notify_count);
-                crcb_parameter_discover_reset(-1);
             }
             pvtCr_num_remaining_objects = sCr_requested_notify_count;
         }
 
         int numChecked = 0;
         int numFound = 0;
-        if (checkAll)
-        {
-            // checking all params.
-            while ((numFound < REACH_PARAM_NOTE_SETUP_COUNT) &&
-                   (sCr_requested_notify_index < sCr_requested_notify_count) )
-            {
-                // Get the PID of the next param
-                rval = crcb_parameter_discover_next(&paramInfo);
-                if (rval != 0)
-                {
-                    // Normal end of the parameter list.
-                    break;
-                }
-                sParameter_notification_get_by_pid(paramInfo.id, &pConfig);
-                if (pConfig && sParamNotifyEnabled(pConfig))
-                {
-                    memcpy(&response->configs[numFound], pConfig, sizeof(cr_ParameterNotifyConfig));
-                    I3_LOG(LOG_MASK_PARAMS, "%s: Param ID %d IS notifying.", 
-                           __FUNCTION__, pConfig->parameter_id);
-                    numFound++;
-                    sCr_requested_notify_index++;
-                    response->configs_count++;
-                }
-                numChecked++;
-            }
-            
-            I3_LOG(LOG_MASK_PARAMS, "Checked %d, Filled %d to %d of %d all notifications.", 
-                   numChecked, numFound, sCr_requested_notify_index, sCr_requested_notify_count);
-        }
-        else 
+        // In order of parameter ID.  Those disabled since the request are
+        // passed over.
+        while ((numFound < REACH_PARAM_NOTE_SETUP_COUNT) &&
+               (sCr_requested_notify_index < sCr_requested_notify_count) )
         {
-            // checking the requested numbers
-            while ((numFound < REACH_PARAM_NOTE_SETUP_COUNT) &&
-                   (sCr_requested_notify_index < sCr_requested_notify_count) )
-            {
-                sParameter_notification_get_by_pid(
-                    sCr_requested_param_array[sCr_requested_notify_index],
-                    &pConfig);
-                if (pConfig && sParamNotifyEnabled(pConfig))
-                {
-                    memcpy(&response->configs[numFound], pConfig, sizeof(cr_ParameterNotifyConfig));
-                    I3_LOG(LOG_MASK_PARAMS, "%s: Param ID %d IS notifying.", 
-                           __FUNCTION__, pConfig->parameter_id);
-                    numFound++;
-                    sCr_requested_notify_index++;
-                    response->configs_count++;
-                }
-                numChecked++;
-            }
-            I3_LOG(LOG_MASK_PARAMS, "Checked %d, Filled %d to %d of %d requested notifications.", 
-                   numChecked, numFound, sCr_requested_notify_index, sCr_requested_notify_count);
+            int slot;
+            if (pvtCr_cursor->discover_all_notifications)
+                slot = (sCr_requested_notify_index < sCr_notify_count) ?
+                    sCr_notify_by_pid[sCr_requested_notify_index] : -1;
+            else
+                slot = sCr_notify_find(sCr_requested_param_array[sCr_requested_notify_index]);
+            sCr_requested_notify_index++;
+            numChecked++;
+            if (slot < 0)
+                continue;
+            sCr_notify_get_config(slot, &response->configs[numFound]);
+            I3_LOG(LOG_MASK_PARAMS, "%s: Param ID %d IS notifying.", 
+                   __FUNCTION__, response->configs[numFound].parameter_id);
+            numFound++;
+            response->configs_count++;
         }
+        I3_LOG(LOG_MASK_PARAMS, "Checked %d, Filled %d to %d of %d notifications.", 
+               numChecked, numFound, sCr_requested_notify_index, sCr_requested_notify_count);
         if (pvtCr_num_remaining_objects == 0)
         {
             pvtCr_continued_message_type = cr_ReachMessageTypes_INVALID;
@@ -760,19 +1014,16 @@
     int pvtCrParam_param_disable_notify(const cr_ParameterDisableNotifications *pnd,
                                        cr_ParameterNotifyConfigResponse *pncr)
     {
-        int notify_idx, disable_idx;
-
-        for (disable_idx=0; disable_idx<pnd->parameter_ids_count; disable_idx++)
+        for (int disable_idx=0; disable_idx<pnd->parameter_ids_count; disable_idx++)
         {
-            for (notify_idx=0; notify_idx<NUM_SUPPORTED_PARAM_NOTIFY; notify_idx++ ) {
-                if (sCr_param_notify_list[notify_idx].parameter_id == pnd->parameter_ids[disable_idx])
-                {
-                    memset(&sCr_param_notify_list[notify_idx], 0, sizeof(cr_ParameterNotifyConfig));
-                    i3_log(LOG_MASK_PARAMS, "%s: Disabled notification on pid %u.", __FUNCTION__, pnd->parameter_ids[disable_idx]);
-                    break;
-                }
+            uint16_t pos;
+            if (sCr_notify_search(pnd->parameter_ids[disable_idx], &pos))
+            {
+                sCr_notify_remove(pos);
+                i3_log(LOG_MASK_PARAMS, "%s: Disabled notification on pid %u.", __FUNCTION__, pnd->parameter_ids[disable_idx]);
             }
         }
+        sCr_notify_list_changed();
         // no error report on a bad pid.
         pncr->has_result_message = false;
         memset(pncr->result_message, 0, REACH_ERROR_BUFFER_LEN);
@@ -783,21 +1034,19 @@
                                        cr_ParameterNotifyConfigResponse *pncr)
     {
         int idx;
-        bool canContinue = false;
         int rval = cr_ErrorCodes_NO_ERROR;
 
         if (pnc->disable_all_first)
         {
             // all zero means not in use.
             i3_log(LOG_MASK_PARAMS, "%s: Disabled all notifications first.", __FUNCTION__);
-            memset(sCr_param_notify_list, 0, sizeof(sCr_param_notify_list));
+            sCr_notify_count = 0;
         }
 
         for (int i=0; i<pnc->configs_count; i++ )
         {
             // reject enable on non-existing PID's.
-            int rval = crcb_parameter_discover_reset(pnc->configs[i].parameter_id);
-            if (rval != cr_ErrorCodes_NO_ERROR) {
+            if (sCrParam_exists(pnc->configs[i].parameter_id) != cr_ErrorCodes_NO_ERROR) {
                 cr_report_error(cr_ErrorCodes_INVALID_PARAMETER, "Notificaiton: PID %d not found.", 
                                 pnc->configs[i].parameter_id);
                 pncr->has_result_message = true;
@@ -811,30 +1060,18 @@
                 break;
 
 
-            canContinue = false;
             // see if an active notification already exists
-            for (idx=0; idx<NUM_SUPPORTED_PARAM_NOTIFY; idx++ ) {
-                if (!sParamNotifyEnabled(&sCr_param_notify_list[idx]))
-                    continue;
-                if (pnc->configs[i].parameter_id == sCr_param_notify_list[idx].parameter_id) {
-                    sCr_param_notify_list[idx] = pnc->configs[i];
-                    // store the index of the param with this PID.
-                    i3_log(LOG_MASK_PARAMS, "Updated notification %d on PID %d",
-                           idx, pnc->configs[i].parameter_id);
-                    pncr->result = cr_ErrorCodes_NO_ERROR;
-                    canContinue = true;
-                    break;
-                }
-            }
-            if (canContinue)
+            idx = sCr_notify_find(pnc->configs[i].parameter_id);
+            if (idx >= 0) {
+                sCr_notify_set_config(idx, &pnc->configs[i]);
+                i3_log(LOG_MASK_PARAMS, "Updated notification %d on PID %d",
+                       idx, pnc->configs[i].parameter_id);
+                pncr->result = cr_ErrorCodes_NO_ERROR;
                 continue;
-
-            // Find an open entry
-            for (idx=0; idx<NUM_SUPPORTED_PARAM_NOTIFY; idx++ ) {
-                if (!sParamNotifyEnabled(&sCr_param_notify_list[idx]))
-                    break;
             }
-            if (idx >= NUM_SUPPORTED_PARAM_NOTIFY) {
+
+            idx = sCr_notify_add(&pnc->configs[i]);
+            if (idx < 0) {
                 // All notifications are in use.  
                 pncr->result = cr_ErrorCodes_NO_RESOURCE;
                 cr_report_error(cr_ErrorCodes_NO_RESOURCE,
@@ -846,11 +1083,10 @@
                         (int)pnc->configs[i].parameter_id);
                 continue;
             }
-            sCr_param_notify_list[idx] = pnc->configs[i];
-            // store the index of the param with this PID.
             i3_log(LOG_MASK_PARAMS, "Enabled notification %d on PID %d",
                    idx, pnc->configs[i].parameter_id);
         }
+        sCr_notify_list_changed();
         pncr->result = rval;
         return cr_ErrorCodes_NO_ERROR;
     }
@@ -890,40 +1126,34 @@
             return;
         }
 
+        sCr_notify_count = 0;
         for (size_t i=0; i<num; i++)
         {
-            cr_ParameterInfo paramInfo;
-            sCr_param_notify_list[i].parameter_id = pNoteArray[i].parameter_id;
-            sCr_param_notify_list[i].minimum_notification_period = pNoteArray[i].minimum_notification_period;
-            sCr_param_notify_list[i].maximum_notification_period = pNoteArray[i].maximum_notification_period;
-            sCr_param_notify_list[i].minimum_delta = pNoteArray[i].minimum_delta;
-            sCr_last_param_values[i].parameter_id = pNoteArray[i].parameter_id;
-            sCr_last_param_values[i].timestamp = 0;
-            rval = crcb_parameter_discover_reset(pNoteArray[i].parameter_id);
+            rval = sCrParam_exists(pNoteArray[i].parameter_id);
             if (rval != 0)
             {
                 cr_report_error(cr_ErrorCodes_INVALID_PARAMETER, "PID %d doesn't exist for notify[%d].\n",
                                 pNoteArray[i].parameter_id, i);
                 continue;  // try to do the other ones.
             }
-            // I don't see how this can fail right after discover.
-            crcb_parameter_discover_next(&paramInfo);
-            sCr_last_param_values[i].which_value = paramInfo.which_desc - cr_ParameterInfo_uint32_desc_tag;
-            sCr_last_param_values[i].value.int32_value = 0;
+            int slot = sCr_notify_find(pNoteArray[i].parameter_id);
+            if (slot >= 0)
+                sCr_notify_set_config(slot, &pNoteArray[i]);
+            else
+                sCr_notify_add(&pNoteArray[i]);
         }
+        sCr_notify_list_changed();
         return;
       #endif
     }
 
     size_t cr_get_active_notify_count(void)
     {
-        size_t numNotifying = 0;
-        for (int i=0; i<NUM_SUPPORTED_PARAM_NOTIFY; i++)
-        {
-            if (sParamNotifyEnabled(&sCr_param_notify_list[i]))
-                numNotifying++;
-        }
-        return numNotifying;
+      #if NUM_SUPPORTED_PARAM_NOTIFY == 0
+        return 0;
+      #else
+        return sCr_notify_count;
+      #endif
     }
 #endif // def INCLUDE_PARAMETER_SERVICE
 
@@ -936,159 +1166,464 @@
 void cr_clear_param_notifications(void)
 {
 #if (defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0) )
-    memset(sCr_param_notify_list, 0, sizeof(sCr_param_notify_list));
-    memset(sCr_last_param_values, 0, sizeof(sCr_last_param_values));
+    sCr_notify_count = 0;
+    sCr_notify_list_changed();
   #endif
 }
 
-int pvtCr_notify_param(cr_ParameterValue *param)
+#if (defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0) )
+/// @private
+/// FNV-1a of the bytes, continued from hash.
+static uint32_t sCr_notify_hash(uint32_t hash, const uint8_t *data, size_t size)
+{
+    for (size_t i=0; i<size; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+/// @private
+/// The form of a value kept as the last notified.  Strings are hashed to
+/// their terminator, and byte arrays with their size.
+static void sCr_notify_value(const cr_ParameterValue *pVal, cr_NotifyValue *pOut)
+{
+    memset(pOut, 0, sizeof(cr_NotifyValue));
+    switch (pVal->which_value) {
+    case cr_ParameterValue_uint32_value_tag:
+    case cr_ParameterValue_enum_value_tag:
+        pOut->uint32_value = pVal->value.uint32_value;
+        break;
+    case cr_ParameterValue_int32_value_tag:
+        pOut->int32_value = pVal->value.int32_value;
+        break;
+    case cr_ParameterValue_float32_value_tag:
+        pOut->float32_value = pVal->value.float32_value;
+        break;
+    case cr_ParameterValue_uint64_value_tag:
+        pOut->uint64_value = pVal->value.uint64_value;
+        break;
+    case cr_ParameterValue_bitfield_value_tag:
+        pOut->uint64_value = pVal->value.bitfield_value;
+        break;
+    case cr_ParameterValue_int64_value_tag:
+        pOut->int64_value = pVal->value.int64_value;
+        break;
+    case cr_ParameterValue_float64_value_tag:
+        pOut->float64_value = pVal->value.float64_value;
+        break;
+    case cr_ParameterValue_bool_value_tag:
+        pOut->bool_value = pVal->value.bool_value;
+        break;
+    case cr_ParameterValue_string_value_tag:
+    {
+        const char *end = memchr(pVal->value.string_value, 0, REACH_PVAL_STRING_LEN);
+        size_t len = end ? (size_t)(end - pVal->value.string_value) : REACH_PVAL_STRING_LEN;
+        pOut->hash = sCr_notify_hash(2166136261u, (const uint8_t *)pVal->value.string_value, len);
+        break;
+    }
+    case cr_ParameterValue_bytes_value_tag:
+    {
+        pb_size_t size = pVal->value.bytes_value.size;
+        if (size > sizeof(pVal->value.bytes_value.bytes))
+            size = sizeof(pVal->value.bytes_value.bytes);
+        pOut->hash = sCr_notify_hash(2166136261u, (const uint8_t *)&size, sizeof(size));
+        pOut->hash = sCr_notify_hash(pOut->hash, pVal->value.bytes_value.bytes, size);
+        break;
+    }
+    default:
+        break;
+    }
+}
+#endif  // NUM_SUPPORTED_PARAM_NOTIFY != 0
+
+#if (defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0) )
+
+/// @private True if ticks a come before ticks b, allowing for the wrap.
+#define sCr_before(a, b)    ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+/// @private
+/// Puts slot at position pos of the heap of the session and moves it up 
+/// or down to where its due ticks belong.
+static void sCr_heap_place(uint32_t pos, uint16_t slot)
+{
+    cr_session_t *session = pvtCr_session;
+    uint16_t *heap = session->notify_heap;
+    uint32_t due = session->notify_slot_due[slot];
+
+    while (pos > 0)
+    {
+        uint32_t parent = (pos - 1) / 2;
+        if (!sCr_before(due, session->notify_slot_due[heap[parent]]))
+            break;
+        heap[pos] = heap[parent];
+        session->notify_heap_pos[heap[pos]] = pos;
+        pos = parent;
+    }
+    for (;;)
+    {
+        uint32_t child = 2 * pos + 1;
+        if (child >= session->notify_heap_count)
+            break;
+        if ((child + 1 < session->notify_heap_count) &&
+            sCr_before(session->notify_slot_due[heap[child + 1]], 
+                       session->notify_slot_due[heap[child]]))
+            child++;
+        if (!sCr_before(session->notify_slot_due[heap[child]], due))
+            break;
+        heap[pos] = heap[child];
+        session->notify_heap_pos[heap[pos]] = pos;
+        pos = child;
+    }
+    heap[pos] = slot;
+    session->notify_heap_pos[slot] = pos;
+}
+
+/// @private
+/// Checks the slot at the ticks due, adding it to the heap if not there.
+static void sCr_notify_schedule(uint16_t slot, uint32_t due)
+{
+    uint32_t pos = pvtCr_session->notify_heap_pos[slot];
+    if (pos == CR_NOTIFY_NOT_SCHEDULED)
+        pos = pvtCr_session->notify_heap_count++;
+    pvtCr_session->notify_slot_due[slot] = due;
+    sCr_heap_place(pos, slot);
+}
+
+/// @private
+/// Takes the slot out of the heap, if there.
+static void sCr_notify_unschedule(uint16_t slot)
+{
+    uint32_t pos = pvtCr_session->notify_heap_pos[slot];
+    if (pos == CR_NOTIFY_NOT_SCHEDULED)
+        return;
+    pvtCr_session->notify_heap_pos[slot] = CR_NOTIFY_NOT_SCHEDULED;
+    uint16_t last = pvtCr_session->notify_heap[--pvtCr_session->notify_heap_count];
+    if (pos != pvtCr_session->notify_heap_count)
+        sCr_heap_place(pos, last);
+}
+
+/// @private
+/// The smallest whole number not less than a minimum_delta, found from 
+/// its IEEE 754 bits so that integer values are compared without floating
+/// point.  Zero or less gives 0, so that any value counts as moved, and 
+/// NaN gives UINT64_MAX, which none reaches, as with a float compare.
+static uint64_t sCr_delta_ceiling(float delta)
+{
+    uint32_t bits;
+    memcpy(&bits, &delta, sizeof(bits));
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint64_t mantissa = (bits & 0x7FFFFF) | 0x800000;
+
+    if ((exponent == 0xFF) && ((bits & 0x7FFFFF) != 0))
+        return UINT64_MAX;                  // NaN
+    if ((bits & 0x80000000) || ((bits & 0x7FFFFFFF) == 0))
+        return 0;                           // negative or zero
+    if (exponent == 0xFF)
+        return UINT64_MAX;                  // infinity
+    if (exponent == 0)
+        return 1;                           // subnormal
+    // The value is mantissa * 2^(exponent - 150).
+    if (exponent >= 150)
+        return (exponent - 150 > 40) ? UINT64_MAX : (mantissa << (exponent - 150));
+    uint32_t shift = 150 - exponent;
+    if (shift >= 24)
+        return 1;
+    return (mantissa >> shift) + ((mantissa & ((1u << shift) - 1)) != 0);
+}
+
+/// @private
+/// True if a numeric value has moved by at least the minimum_delta of the
+/// slot since it was last notified.  Integer types are compared exactly, 
+/// in integer arithmetic at their full width.  Only float values use 
+/// floating point.
+static bool sCr_notify_moved(uint16_t idx, pb_size_t which_value, const cr_NotifyValue *pCur)
+{
+    const cr_NotifyValue *pLast = &sCr_notify_last[idx];
+    uint64_t diff;
+
+    switch (which_value) {
+    // To match the apps and protobufs, must use _value_tags!
+    case cr_ParameterValue_uint32_value_tag:
+    case cr_ParameterValue_enum_value_tag:
+        diff = (pCur->uint32_value > pLast->uint32_value) ?
+            pCur->uint32_value - pLast->uint32_value :
+            pLast->uint32_value - pCur->uint32_value;
+        break;
+    case cr_ParameterValue_int32_value_tag:
+        // The difference of two int32 always fits a uint32.
+        diff = (pCur->int32_value > pLast->int32_value) ?
+            (uint32_t)pCur->int32_value - (uint32_t)pLast->int32_value :
+            (uint32_t)pLast->int32_value - (uint32_t)pCur->int32_value;
+        break;
+    case cr_ParameterValue_uint64_value_tag:
+    case cr_ParameterValue_bitfield_value_tag:
+        diff = (pCur->uint64_value > pLast->uint64_value) ?
+            pCur->uint64_value - pLast->uint64_value :
+            pLast->uint64_value - pCur->uint64_value;
+        break;
+    case cr_ParameterValue_int64_value_tag:
+        diff = (pCur->int64_value > pLast->int64_value) ?
+            (uint64_t)pCur->int64_value - (uint64_t)pLast->int64_value :
+            (uint64_t)pLast->int64_value - (uint64_t)pCur->int64_value;
+        break;
+    case cr_ParameterValue_bool_value_tag:
+        diff = (pCur->bool_value != pLast->bool_value);
+        break;
+    case cr_ParameterValue_float32_value_tag:
+    {
+        float d = (pCur->float32_value > pLast->float32_value) ?
+            pCur->float32_value - pLast->float32_value :
+            pLast->float32_value - pCur->float32_value;
+        return d >= sCr_notify_min_delta[idx];
+    }
+    case cr_ParameterValue_float64_value_tag:
+    {
+        double d = (pCur->float64_value > pLast->float64_value) ?
+            pCur->float64_value - pLast->float64_value :
+            pLast->float64_value - pCur->float64_value;
+        return d >= (double)sCr_notify_min_delta[idx];
+    }
+    default:
+        return false;
+    }
+    return diff >= sCr_delta_ceiling(sCr_notify_min_delta[idx]);
+}
+
+/// @private
+/// The first ticks from now at which the minimum period of the slot has 
+/// passed since it was last notified.
+static uint32_t sCr_notify_allowed(uint16_t idx, uint32_t now)
+{
+    uint32_t since = now - sCr_notify_last_ticks[idx];
+    if (since >= sCr_notify_min_period[idx])
+        return now;
+    return now + sCr_notify_min_period[idx] - since;
+}
+
+/// @private
+/// Rebuilds the heap from the list of the session.  Each slot is checked
+/// once its minimum period has passed since it was last notified.
+static void sCr_notify_rebuild(uint32_t now)
+{
+    pvtCr_session->notify_heap_count = 0;
+    memset(pvtCr_session->notify_heap_pos, 0xFF, sizeof(pvtCr_session->notify_heap_pos));
+    for (uint16_t idx=0; idx<sCr_notify_count; idx++)
+        sCr_notify_schedule(idx, sCr_notify_allowed(idx, now));
+    pvtCr_session->notify_heap_valid = true;
+}
+
+bool pvtCrParam_take_changes(void)
+{
+    cr_stack_t *stack = pvtCr_active_stack;
+    if (!__atomic_load_n(&stack->param_changed_any, __ATOMIC_ACQUIRE))
+        return false;
+    // Cleared before the flags, so that a flag set meanwhile is taken next time.
+    __atomic_store_n(&stack->param_changed_any, 0, __ATOMIC_SEQ_CST);
+
+    // A flag is only cleared when seen set.  If cr_param_changed() sets it 
+    // again in between, the value it signals is read by this check.
+    uint8_t changed[CR_PARAM_CHANGE_FLAGS];
+    for (int i=0; i<CR_PARAM_CHANGE_FLAGS; i++)
+    {
+        changed[i] = __atomic_load_n(&stack->param_changed[i], __ATOMIC_ACQUIRE);
+        if (changed[i])
+            __atomic_store_n(&stack->param_changed[i], 0, __ATOMIC_RELAXED);
+    }
+
+    uint32_t now = cr_get_current_ticks();
+    cr_session_t *served = pvtCr_session;
+    for (int i=0; i<CR_NUM_SESSIONS; i++)
+    {
+        pvtCr_session = &stack->sessions[i];
+        if (!pvtCr_session->notify_heap_valid)
+            continue;   // all are checked when it is rebuilt
+        for (uint16_t idx=0; idx<sCr_notify_count; idx++)
+        {
+            if (!changed[sCr_notify_pid[idx] % CR_PARAM_CHANGE_FLAGS])
+                continue;
+            // As soon as the minimum period allows, unless already sooner.
+            uint32_t due = sCr_notify_allowed(idx, now);
+            if ((pvtCr_session->notify_heap_pos[idx] == CR_NOTIFY_NOT_SCHEDULED) ||
+                sCr_before(due, pvtCr_session->notify_slot_due[idx]))
+                sCr_notify_schedule(idx, due);
+            pvtCr_session->notify_due_valid = false;
+        }
+    }
+    pvtCr_session = served;
+    return true;
+}
+
+/// The values that fall due in one check are batched by the active stack.
+/// They are copied into the raw notification buffer only when sent, so that 
+/// it is free for log and error reports until then.
+#define sCr_notify_batch        (pvtCr_active_stack->notify_batch)
+#define sCr_notify_batch_slot   (pvtCr_active_stack->notify_batch_slot)
+#define sCr_notify_batch_kept   (pvtCr_active_stack->notify_batch_kept)
+
+/// @private
+/// Sends the first count values of the batch in one parameter notification.
+/// The values are kept as the last notified only if the frame is queued.
+/// Returns false if it could not be encoded or there was no room for it.
+static bool sCr_notify_send(pb_size_t count, uint32_t now)
 {
     if (!cr_get_comm_link_connected())
-        return 0;
+        return true;
 
     uint8_t *pRaw, *pCoded;
     size_t size;
     pvtCr_get_raw_notification_buffer(&pRaw, &size);
 
     cr_ParameterNotification *note = (cr_ParameterNotification*)pRaw;
-    note->values_count = 1;
-    memcpy(&note->values[0], param, sizeof(cr_ParameterValue));
-
-    pvtCr_encode_message(cr_ReachMessageTypes_PARAMETER_NOTIFICATION, pRaw, NULL);
-    pvtCr_get_coded_notification_buffers(&pCoded, &size);
+    note->values_count = count;
+    memcpy(note->values, sCr_notify_batch, count * sizeof(cr_ParameterValue));
 
-    LOG_DUMP_MASK(LOG_MASK_AHSOKA, "notification", pCoded, size);
-    // i3_log(LOG_MASK_PARAMS, TEXT_MAGENTA "Notify PID %d" TEXT_RESET, param->parameter_id);
-    crcb_send_coded_response(pCoded, size);
-    return 0;
+    int rval = pvtCr_encode_message(cr_ReachMessageTypes_PARAMETER_NOTIFICATION, pRaw, NULL);
+    if (rval == cr_ErrorCodes_NO_ERROR)
+    {
+        pvtCr_get_coded_notification_buffers(&pCoded, &size);
+        LOG_DUMP_MASK(LOG_MASK_AHSOKA, "notification", pCoded, size);
+        rval = pvtCr_send_frame(cr_TxClass_NOTIFICATION, pCoded, size);
+    }
+    if (rval != cr_ErrorCodes_NO_ERROR)
+    {
+        // Not notified.  Look again when the queue may have room.
+        for (pb_size_t i=0; i<count; i++)
+            sCr_notify_schedule(sCr_notify_batch_slot[i], now + 1);
+        return false;
+    }
+    for (pb_size_t i=0; i<count; i++)
+    {
+        uint16_t idx = sCr_notify_batch_slot[i];
+        sCr_notify_last[idx] = sCr_notify_batch_kept[i];
+        sCr_notify_last_ticks[idx] = now;
+    }
+    sCr_numNotificationsSent += count;
+    return true;
 }
+#endif  // NUM_SUPPORTED_PARAM_NOTIFY != 0
 
 /// <summary>
-/// A local function called in cr_process() to determine whether
-/// any parameter notifications need to be generated. 
+/// A local function called in cr_process() to send the parameter 
+/// notifications of the session that are due.  Only the slots at the 
+/// top of the heap are visited.
 /// Must be available (empty) in all no-param case. 
 /// </summary>
 void pvtCrParam_check_for_notifications()
 {
   #if (defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0) )
 
-    for (int idx=0; idx<NUM_SUPPORTED_PARAM_NOTIFY; idx++ )
-    {
-        if (!sParamNotifyEnabled(&sCr_param_notify_list[idx]))
-            continue;
+    uint32_t now = cr_get_current_ticks();
+    if (!pvtCr_session->notify_heap_valid)
+        sCr_notify_rebuild(now);
 
-        cr_ParameterValue curVal;
-        float delta;
+    pb_size_t batch_count = 0;
+
+    while ((pvtCr_session->notify_heap_count != 0) &&
+           !sCr_before(now, pvtCr_session->notify_slot_due[pvtCr_session->notify_heap[0]]))
+    {
+        uint16_t idx = pvtCr_session->notify_heap[0];
+        cr_ParameterValue *pCurVal = &sCr_notify_batch[batch_count];
+        cr_NotifyValue curVal;
+        const cr_NotifyValue *pLast = &sCr_notify_last[idx];
         bool needToNotify = false;
-        bool checkedDelta = false;
-        uint32_t  timeSinceLastNotify = cr_get_current_ticks() - sCr_last_param_values[idx].timestamp;
+        uint32_t  timeSinceLastNotify = now - sCr_notify_last_ticks[idx];
 
         // 0 will cause this to be ignored.
-        if (timeSinceLastNotify < sCr_param_notify_list[idx].minimum_notification_period)
+        if (timeSinceLastNotify < sCr_notify_min_period[idx])
+        {
+            // Signalled too soon.  Look again when the period has passed.
+            sCr_notify_schedule(idx, sCr_notify_allowed(idx, now));
             continue;
+        }
 
         // 0 will cause this to be ignored.
-        if ((sCr_param_notify_list[idx].maximum_notification_period != 0) &&
-            (timeSinceLastNotify > sCr_param_notify_list[idx].maximum_notification_period))
+        if ((sCr_notify_max_period[idx] != 0) &&
+            (timeSinceLastNotify > sCr_notify_max_period[idx]))
             needToNotify = true;
 
-        crcb_parameter_read(sCr_param_notify_list[idx].parameter_id, &curVal);
-        switch (curVal.which_value) {
-        // To match the apps and protobufs, must use _value_tags!
-        case cr_ParameterValue_uint32_value_tag:
-        case cr_ParameterValue_enum_value_tag:
-        case cr_ParameterValue_bitfield_value_tag:
-        {
-            int64_t cur  = curVal.value.uint32_value;
-            int64_t last = sCr_last_param_values[idx].value.uint32_value;
-            if (cur>last)
-              delta = cur-last;
-            else
-              delta = last-cur;
-            checkedDelta = true;
-            break;
-        }
-        case cr_ParameterValue_int32_value_tag:
-            delta = abs(curVal.value.int32_value - sCr_last_param_values[idx].value.int32_value);
-            checkedDelta = true;
+        // A safe point.  The slot stays at the top of the heap.
+        if (pvtCr_budget_spent())
             break;
-        case cr_ParameterValue_float32_value_tag:
-            delta = fabs(curVal.value.float32_value - sCr_last_param_values[idx].value.float32_value);
-            checkedDelta = true;
-            break;
-        case cr_ParameterValue_uint64_value_tag:
-          {
-          int64_t cur  = curVal.value.uint64_value;
-          int64_t last = sCr_last_param_values[idx].value.uint64_value;
-          if (cur>last)
-            delta = (float)(cur-last);
-          else
-            delta = (float)(last-cur);
-          checkedDelta = true;
-          break;
-          }
-        case cr_ParameterValue_int64_value_tag:
-          {
-            int64_t cur  = curVal.value.int64_value;
-            int64_t last = sCr_last_param_values[idx].value.int64_value;
-            if (cur>last)
-              delta = (float)(cur-last);
-            else
-              delta = (float)(last-cur);
-            checkedDelta = true;
-            break;
-          }
-        case cr_ParameterValue_float64_value_tag:
-            delta = fabs(curVal.value.float64_value - sCr_last_param_values[idx].value.float64_value);
-            checkedDelta = true;
-            break;
-        case cr_ParameterValue_bool_value_tag:
-            delta = abs(curVal.value.bool_value - sCr_last_param_values[idx].value.bool_value);
-            checkedDelta = true;
-            break;
-        case cr_ParameterValue_string_value_tag:
-        case cr_ParameterValue_bytes_value_tag:
-        default:
-            checkedDelta = false;
-            break;
-        }
-        if (checkedDelta && (delta >= sCr_param_notify_list[idx].minimum_delta))
+        sCrParam_read(sCr_notify_pid[idx], pCurVal);
+        pvtCr_budget_charge(1);
+        sCr_notify_value(pCurVal, &curVal);
+        // The kept forms are compared as one word first.  Only a value 
+        // that changed, or any value when the delta is zero, goes on to the
+        // comparator of its type.  Strings and bytes are equal by hash.
+        bool changed = (curVal.bits != pLast->bits);
+        if (changed || (sCr_delta_ceiling(sCr_notify_min_delta[idx]) == 0))
         {
-            i3_log(LOG_MASK_PARAMS, TEXT_MAGENTA "Notify PID %d on delta %.1f" TEXT_RESET,
-                   sCr_param_notify_list[idx].parameter_id, delta);
-            needToNotify = true;
-        }
-
-        if (curVal.which_value == cr_ParameterValue_string_value_tag) {
-            if (strncmp(curVal.value.string_value, sCr_last_param_values[idx].value.string_value, REACH_PVAL_STRING_LEN))
-                needToNotify = true;
-        }
-        if (curVal.which_value == cr_ParameterValue_bytes_value_tag) {
-            if (memcmp(curVal.value.bytes_value.bytes, 
-                       sCr_last_param_values[idx].value.bytes_value.bytes, 
-                       curVal.value.bytes_value.size))
+            if ((pCurVal->which_value == cr_ParameterValue_string_value_tag) ||
+                (pCurVal->which_value == cr_ParameterValue_bytes_value_tag))
+            {
+                if (changed)
+                    needToNotify = true;
+            }
+            else if (sCr_notify_moved(idx, pCurVal->which_value, &curVal))
+            {
+                i3_log(LOG_MASK_PARAMS, TEXT_MAGENTA "Notify PID %d on delta" TEXT_RESET,
+                       sCr_notify_pid[idx]);
                 needToNotify = true;
+            }
         }
 
-        if ((sCr_param_notify_list[idx].maximum_notification_period !=0) &&
-            (timeSinceLastNotify > sCr_param_notify_list[idx].maximum_notification_period) )
+        if ((sCr_notify_max_period[idx] !=0) &&
+            (timeSinceLastNotify > sCr_notify_max_period[idx]) )
         {
             i3_log(LOG_MASK_PARAMS, TEXT_MAGENTA "Notify PID %d on max period" TEXT_RESET,
-                   sCr_param_notify_list[idx].parameter_id);
+                   sCr_notify_pid[idx]);
             needToNotify = true;
         }
 
+        // Kept for next time once the notification is queued.
+        uint32_t last_ticks = sCr_notify_last_ticks[idx];
         if (needToNotify)
         {
-            sCr_numNotificationsSent++;
-            pvtCr_notify_param(&curVal);
+            sCr_notify_batch_slot[batch_count] = idx;
+            sCr_notify_batch_kept[batch_count] = curVal;
+            batch_count++;
+            last_ticks = now;
+        }
 
-            // save it for next time
-            sCr_last_param_values[idx] = curVal;
-            sCr_last_param_values[idx].timestamp = cr_get_current_ticks();
+        // Polled once per minimum period, and notified when the maximum 
+        // period has passed.  Never again within this check.
+      #if CR_PARAM_NOTIFY_POLL
+        bool scheduled = true;
+        uint32_t due = now + sCr_notify_min_period[idx];
+      #else
+        bool scheduled = false;
+        uint32_t due = now + 1;
+      #endif
+        if (sCr_notify_max_period[idx] != 0)
+        {
+            uint32_t max_due = last_ticks + sCr_notify_max_period[idx] + 1;
+            if (!scheduled || sCr_before(max_due, due))
+                due = max_due;
+            scheduled = true;
+        }
+        if (!sCr_before(now, due))
+            due = now + 1;
+        if (scheduled)
+            sCr_notify_schedule(idx, due);
+        else
+            sCr_notify_unschedule(idx);     // until cr_param_changed()
+
+        if (batch_count == REACH_COUNT_PARAM_NOTIF_VALUES)
+        {
+            // With no room in the transmit queue, the rest can wait.
+            bool sent = sCr_notify_send(batch_count, now);
+            batch_count = 0;
+            if (!sent)
+                break;
         }
     }
+    if (batch_count != 0)
+        sCr_notify_send(batch_count, now);
+
+    // Find when the heap next needs checking.  See cr_get_next_process_ticks().
+    if (pvtCr_session->notify_heap_count != 0)
+        pvtCr_session->notify_due = pvtCr_session->notify_slot_due[pvtCr_session->notify_heap[0]];
+    else
+        pvtCr_session->notify_due = now + CR_MAX_IDLE_TICKS;
+    pvtCr_session->notify_due_valid = true;
   #endif  // NUM_SUPPORTED_PARAM_NOTIFY != 0
 }
-
-
@@ -80,71 +80,63 @@
 
 #include "message_util.h"
 #include "reach_decode.h"
+#include "reach_codec.h"
 #include "reach_version.h"
 
 //----------------------------------------------------------------------------
-// static buffers used and reused by the reach stack.
-// This is private data.
+// Buffers used and reused by the reach stack.
+// This is private data, held per instance in the cr_stack_t.
 //----------------------------------------------------------------------------
 
-// the fully encoded message is received in the sCr_encoded_message_buffer. 
-/// @private
-static uint8_t sCr_encoded_message_buffer[CR_CODED_BUFFER_SIZE] ALIGN_TO_WORD;
-
 /// @private
-static size_t  sCr_encoded_message_size = 0;
+static cr_stack_t sCr_stack_pool[CR_NUM_STACK_INSTANCES] = 
+    { { .in_use = true, .session = &sCr_stack_pool[0].sessions[0] } };
 
-// The message header is decoded into this buffer containing an encoded payload buffer: 
 /// @private
-static cr_ReachMessage sCr_uncoded_message_structure;
+CR_THREAD_LOCAL cr_stack_t *pvtCr_active_stack = &sCr_stack_pool[0];
 
-/// The payload buffers are slightly smaller than the CR_CODED_BUFFER_SIZE
-/// so that the header can be added.
-#define UNCODED_PAYLOAD_SIZE  (CR_CODED_BUFFER_SIZE-4)
+// The names below refer to the instance being processed.
 
-// A decoded prompt payload. This can be reused from the encoded message buffer. 
-// static uint8_t sCr_decoded_prompt_buffer[UNCODED_PAYLOAD_SIZE] ALIGN_TO_WORD;
-/// @private
-static uint8_t *sCr_decoded_prompt_buffer = sCr_encoded_message_buffer;
+// the fully encoded message is received in the sCr_encoded_message_buffer. 
+#define sCr_encoded_message_buffer      (pvtCr_active_stack->prompt)
+#define sCr_encoded_message_size        (pvtCr_active_stack->encoded_message_size)
 
-// An uncoded response payload.
-/// @private
-static uint8_t sCr_uncoded_response_buffer[UNCODED_PAYLOAD_SIZE] ALIGN_TO_WORD;
+// The message header is decoded into this buffer containing an encoded payload buffer: 
+#define sCr_uncoded_message_structure   (pvtCr_active_stack->uncoded_message_structure)
 
-// The response payload is encoded into sCr_encoded_payload_buffer[]. 
-/// @private
-static uint8_t sCr_encoded_payload_buffer[UNCODED_PAYLOAD_SIZE] ALIGN_TO_WORD; 
-/// @private
-static size_t sCr_encoded_payload_size; 
- 
-// The response payload is copied into the sCr_uncoded_message_structure
+// A decoded prompt payload.  Never the buffer the prompt is read from, as 
+// that may be loaned by the transport. 
+#define sCr_decoded_prompt_buffer       (pvtCr_active_stack->decoded_prompt)
 
-// The sCr_uncoded_message_structure is encoded into sCr_encoded_response_buffer[]  
-/// @private
-static uint8_t sCr_encoded_response_buffer[CR_CODED_BUFFER_SIZE] ALIGN_TO_WORD;
-/// @private
-static size_t  sCr_encoded_response_size = 0;
+// An uncoded response payload.
+#define sCr_uncoded_response_buffer     (pvtCr_active_stack->uncoded_response_buffer)
 
-static bool sClassic_header_format = false;
+// The size of the encoded response payload.
+#define sCr_encoded_payload_size        (pvtCr_active_stack->encoded_payload_size)
 
-static uint8_t sCr_raw_notification[CR_CODED_BUFFER_SIZE]    ALIGN_TO_WORD;
-static uint8_t sCr_coded_notification[CR_CODED_BUFFER_SIZE]  ALIGN_TO_WORD;
-static size_t sCr_encoded_notification_size = 0;
+// The response is encoded into sCr_encoded_response_buffer[]  
+#define sCr_encoded_response_buffer     (pvtCr_active_stack->encoded_response_buffer)
+#define sCr_encoded_response_size       (pvtCr_active_stack->encoded_response_size)
 
+#define sClassic_header_format          (pvtCr_active_stack->classic_header_format)
 
-///----------------------------------------------------------------------------
-/// private but global variables shared with the Reach stack
-///----------------------------------------------------------------------------
-cr_ReachMessageTypes pvtCr_continued_message_type;
-uint32_t pvtCr_num_remaining_objects = 0;
+#define sCr_raw_notification            (pvtCr_active_stack->raw_notification)
+#define sCr_coded_notification          (pvtCr_active_stack->coded_notification)
+#define sCr_encoded_notification_size   (pvtCr_active_stack->encoded_notification_size)
 
 ///----------------------------------------------------------------------------
 /// static (private) "member" variables
 ///----------------------------------------------------------------------------
-static uint32_t sCr_transaction_id = 0;
-static uint32_t sCr_client_id = 0;
-static uint32_t sCr_endpoint_id = 0;
-static bool sCr_error_reported = false;
+#define sCr_transaction_id              (pvtCr_session->transaction_id)
+#define sCr_client_id                   (pvtCr_session->client_id)
+#define sCr_endpoint_id                 (pvtCr_session->endpoint_id)
+#define sCr_error_reported              (pvtCr_active_stack->error_reported)
+#define sClientProtocolVersion          (pvtCr_session->client_protocol_version)
+#define sCr_CallCount                   (pvtCr_active_stack->call_count)
+#define sCr_currentTicks                (pvtCr_active_stack->current_ticks)
+#define sCr_comm_link_is_connected      (pvtCr_active_stack->comm_link_is_connected)
+#define sCr_requested_command_index     (pvtCr_cursor->requested_command_index)
+#define sCr_requested_WiFI_index        (pvtCr_cursor->requested_wifi_index)
 
 ///----------------------------------------------------------------------------
 /// Forward declarations of static (private) "member" functions
@@ -165,6 +157,13 @@ handle_message(const cr_ReachMessageHeader *hdr, const uint8_t *data, size_t siz
 /// <returns></returns>
 static int handle_ping(const cr_PingRequest *request, cr_PingResponse *response);
 
+/// <summary>
+/// Act on an error report from the client, which can cancel a transaction
+/// </summary>
+/// <param name="request"> The triggering message</param>
+/// <param name="response">Not used</param>
+/// <returns>cr_ErrorCodes_NO_RESPONSE</returns>
+static int handle_error_report(const cr_ErrorReport *request, cr_ErrorReport *response);
 
 /// <summary>
 /// Respond to a request for device info
@@ -180,8 +179,6 @@ static int handle_get_device_info(const cr_DeviceInfoRequest *request,
     static int handle_discover_commands(const cr_DiscoverCommands *,
                                         cr_DiscoverCommandsResponse *);
     static int handle_send_command(const cr_SendCommand *, cr_SendCommandResponse *);
-
-    static unsigned int sCr_requested_command_index = 0;
 #endif // def INCLUDE_COMMAND_SERVICE
 
 #ifdef INCLUDE_CLI_SERVICE
@@ -211,94 +208,117 @@ bool encode_reach_payload(cr_ReachMessageTypes message_type,    // in
                           pb_size_t buffer_size,                // in:  max size of encoded data
                           size_t *encode_size);                 // out: encoded data size
 
-static
-bool encode_reach_message(const cr_ReachMessage *message,       // in:  message to be encoded
-                          uint8_t *buffer,                      // out: Buffer to encode into
-                          size_t buffer_size,                   // in:  max size of encoded message
-                          size_t *encode_size);                 // out: actual size of encoded message.
+// Discovery responses sent from pages already encoded
+static bool sCr_replay_begin(cr_ReachMessageTypes message_type, const void *request);
+static bool sCr_replaying(void);
+static int  sCr_replay_send_page(cr_ReachMessageTypes message_type);
+#if CR_DISCOVERY_CACHE_SIZE > 0
+    static void sCr_cache_store_page(cr_ReachMessageTypes message_type, 
+                                     const uint8_t *payload, size_t size,
+                                     uint32_t remaining_objects);
+    static void sCr_cache_abandon(void);
+#endif  // CR_DISCOVERY_CACHE_SIZE > 0
+
+// What is left over from a link that went up or down
+static void sCr_tx_reset(cr_stack_t *stack);
+static void sCr_prompt_queue_drain(cr_stack_t *stack);
+static int  sCr_tx_return_buffer(uint8_t **held, size_t len);
+
+// Responses kept for prompts that are sent again
+#if CR_RESPONSE_CACHE_ENTRIES > 0
+    static bool sCr_response_cacheable(const cr_MessageDescriptor *desc);
+    static bool sCr_response_cache_send(int32_t message_type, uint32_t prompt_hash, 
+                                        size_t prompt_size, int *rval);
+    static void sCr_response_cache_store(int32_t message_type, uint32_t prompt_hash, 
+                                         size_t prompt_size, const uint8_t *response, 
+                                         size_t response_size);
+    static void sCr_response_cache_forget(const cr_session_t *session);
+    static uint32_t sCr_hash_bytes(const uint8_t *data, size_t size);
+#endif  // CR_RESPONSE_CACHE_ENTRIES > 0
+
+/**
+* @brief   pvtCr_cursor_close
+* @details Ends a continued transaction.  No more pages are sent.
+* @param   cursor : The cursor to close.
+*/
+void pvtCr_cursor_close(cr_cursor_t *cursor)
+{
+    cursor->message_type          = cr_ReachMessageTypes_INVALID;
+    cursor->num_remaining_objects = 0;
+    cursor->replay_pages          = NULL;
+}
 
+/// @private
+/// Sends the next page of the continued transaction of the active session.
+/// The page is produced by the next_page function of the descriptor of the
+/// cursor's type and carries the transaction ID of the prompt that opened 
+/// the cursor.
+/// @return zero if a page was encoded, cr_ErrorCodes_NO_DATA if there is
+///         nothing to send, otherwise an error.
 static int handle_continued_transactions()
 {
+    cr_cursor_t *cursor = pvtCr_cursor;
     int rval = 0;
 
-    if (pvtCr_continued_message_type == cr_ReachMessageTypes_INVALID)
+    if (cursor->message_type == cr_ReachMessageTypes_INVALID)
     {
         // I3_LOG(LOG_MASK_REACH, "%s(): No continued transactions.", __FUNCTION__);
         return cr_ErrorCodes_NO_DATA;  // no continued transaction.
     }
 
-    cr_ReachMessageTypes encode_message_type = pvtCr_continued_message_type;
-    switch (pvtCr_continued_message_type)
+  #if CR_CURSOR_TIMEOUT_TICKS > 0
+    if ((uint32_t)(sCr_currentTicks - cursor->last_active) > CR_CURSOR_TIMEOUT_TICKS)
     {
-    #ifdef INCLUDE_PARAMETER_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_PARAMETERS:
-        I3_LOG(LOG_MASK_REACH, "%s(): Continued dp.", __FUNCTION__);
-        rval = 
-            pvtCrParam_discover_parameters(NULL, 
-                                       (cr_ParameterInfoResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_DISCOVER_PARAM_EX:
-        I3_LOG(LOG_MASK_REACH, "%s(): Continued dpx.", __FUNCTION__);
-        rval = 
-            pvtCrParam_discover_parameters_ex(NULL, 
-                                       (cr_ParamExInfoResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_READ_PARAMETERS:
-        I3_LOG(LOG_MASK_REACH, "%s(): Continued rp.", __FUNCTION__);
-        rval = pvtCrParam_read_param(NULL, (cr_ParameterReadResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_DISCOVER_NOTIFICATIONS:
-        rval = pvtCrParam_discover_notifications(NULL, (cr_DiscoverParameterNotificationsResponse *)sCr_uncoded_response_buffer);
-        break;
-    #endif  // def INCLUDE_PARAMETER_SERVICE
-
-    #ifdef INCLUDE_COMMAND_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_COMMANDS:
-        I3_LOG(LOG_MASK_REACH, "%s(): Continued disc cmds.", __FUNCTION__);
-        rval = 
-            handle_discover_commands(NULL,
-                                     (cr_DiscoverCommandsResponse *)sCr_uncoded_response_buffer);
-        break;
-    #endif  // def INCLUDE_COMMAND_SERVICE
-
-    #ifdef INCLUDE_WIFI_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_WIFI:
-        I3_LOG(LOG_MASK_REACH, "%s(): Continued discover WiFi.", __FUNCTION__);
-        rval = handle_discover_wifi(NULL, (cr_DiscoverWiFiResponse *)sCr_uncoded_response_buffer);
-        break;
-    #endif  // def INCLUDE_WIFI_SERVICE
-
-    #ifdef INCLUDE_FILE_SERVICE
-    case cr_ReachMessageTypes_TRANSFER_DATA:
-        I3_LOG(LOG_MASK_REACH, "%s(): Continued rf.", __FUNCTION__);
-        rval = pvtCrFile_transfer_data_notification(NULL, (cr_FileTransferData *)sCr_uncoded_response_buffer);
-        encode_message_type = cr_ReachMessageTypes_TRANSFER_DATA;
-        break;
-    #endif // def INCLUDE_FILE_SERVICE
-
-    default:
-        LOG_ERROR("Continued type %d not written.", pvtCr_continued_message_type);
-        pvtCr_continued_message_type = cr_ReachMessageTypes_INVALID;
+        LOG_ERROR("Continued %d of client 0x%x expired.", 
+                  cursor->message_type, pvtCr_session->client_id);
+      #if CR_DISCOVERY_CACHE_SIZE > 0
+        sCr_cache_abandon();
+      #endif
+        pvtCr_cursor_close(cursor);
         return cr_ErrorCodes_NO_DATA;
     }
+  #endif  // CR_CURSOR_TIMEOUT_TICKS > 0
 
-    if (rval != 0)
-        return rval;
-
-    cr_ReachMessageHeader msg_header;
-    memset(&msg_header, 0, sizeof(msg_header));
-    msg_header.message_type      = encode_message_type;
-    msg_header.endpoint_id       = sCr_endpoint_id;
-    msg_header.client_id         = sCr_client_id;
-    msg_header.transaction_id    = sCr_transaction_id;
-    msg_header.remaining_objects = pvtCr_num_remaining_objects;
+    if (sCr_replaying())
+        rval = sCr_replay_send_page(cursor->message_type);
+    else
+    {
+        cr_ReachMessageTypes message_type = cursor->message_type;
+        const cr_MessageDescriptor *desc = cr_get_message_descriptor(message_type);
+        if ((desc == NULL) || (desc->next_page == NULL))
+        {
+            LOG_ERROR("Continued type %d not written.", message_type);
+            pvtCr_cursor_close(cursor);
+            return cr_ErrorCodes_NO_DATA;
+        }
 
-    rval = pvtCr_encode_message(encode_message_type,         // in
-                             sCr_uncoded_response_buffer,  // in:  to be encoded
-                             &msg_header);
+        I3_LOG(LOG_MASK_REACH, "%s(): Continued %d.", __FUNCTION__, message_type);
+        rval = desc->next_page(NULL, sCr_uncoded_response_buffer);
+        if (rval != 0)
+        {
+          #if CR_DISCOVERY_CACHE_SIZE > 0
+            sCr_cache_abandon();
+          #endif
+            // A transaction that cannot go on is ended, not tried again.
+            pvtCr_cursor_close(cursor);
+            return rval;
+        }
 
-    if (pvtCr_num_remaining_objects == 0)
-        pvtCr_continued_message_type = cr_ReachMessageTypes_INVALID;
+        cr_ReachMessageHeader msg_header;
+        memset(&msg_header, 0, sizeof(msg_header));
+        msg_header.message_type      = message_type;
+        msg_header.endpoint_id       = sCr_endpoint_id;
+        msg_header.client_id         = sCr_client_id;
+        msg_header.transaction_id    = cursor->transaction_id;
+        msg_header.remaining_objects = cursor->num_remaining_objects;
+
+        rval = pvtCr_encode_message(message_type,                // in
+                                 sCr_uncoded_response_buffer,  // in:  to be encoded
+                                 &msg_header);
+        if ((rval != 0) || (cursor->num_remaining_objects == 0))
+            pvtCr_cursor_close(cursor);
+    }
+    cursor->last_active = sCr_currentTicks;
     return rval;
 }
 
@@ -309,7 +329,11 @@ static int handle_continued_transactions()
 */
 int cr_init() 
 {
+  #ifdef INCLUDE_PARAMETER_SERVICE
+    return pvtCrParam_registry_init();
+  #else
     return cr_ErrorCodes_NO_ERROR;
+  #endif
 }
 
 #ifndef APP_ADVERTISED_NAME_LENGTH
@@ -361,19 +385,29 @@ const char *cr_get_advertised_name()
 /**
 * @brief   cr_store_coded_prompt
 * @details allows the application to store the prompt where the Reach stack can 
-*          see it.  The byte data and length are copied into private storage.
-*          This data is retrieved using crcb_get_coded_prompt().
+*          see it.  The byte data and length are copied into the prompt
+*          queue of the active stack instance.
 * @param   data: The coded prompt to be stored. 
 * @param   len : number of bytes to be stored. 
-* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+* @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_RESOURCE if full.
 */
 int cr_store_coded_prompt(uint8_t *data, size_t len)
 {
-    affirm(len <= sizeof(sCr_encoded_message_buffer));
+    return cr_store_coded_prompt_ctx(pvtCr_active_stack, data, len);
+}
 
-    memcpy(sCr_encoded_message_buffer, data, len);
-    sCr_encoded_message_size = len;
-    return cr_ErrorCodes_NO_ERROR;
+/**
+* @brief   cr_loan_coded_prompt
+* @details Lends a prompt in a buffer owned by the transport to the active 
+*          stack instance.  No copy is made.  The prompt is decoded where it 
+*          lies and the buffer is handed back by crcb_return_coded_prompt().
+* @param   data: The coded prompt.  Must be unchanged until returned. 
+* @param   len : number of bytes in the prompt. 
+* @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_RESOURCE if full.
+*/
+int cr_loan_coded_prompt(const uint8_t *data, size_t len)
+{
+    return cr_loan_coded_prompt_ctx(pvtCr_active_stack, data, len);
 }
 
 /**
@@ -388,17 +422,193 @@ int cr_store_coded_prompt(uint8_t *data, size_t len)
 */
 int cr_get_coded_response_buffer(uint8_t **ppResponse, size_t *pLen)
 {
-    *ppResponse = sCr_encoded_response_buffer;
-    *pLen = sCr_encoded_response_size;
-    if (sCr_encoded_response_size == 0)
+    return cr_get_coded_response_buffer_ctx(pvtCr_active_stack, ppResponse, pLen);
+}
+
+//----------------------------------------------------------------------------
+// Stack instances
+//----------------------------------------------------------------------------
+
+/**
+* @brief   cr_stack_create
+* @details Claims one of the CR_NUM_STACK_INSTANCES statically allocated stack 
+*          instances.
+* @param   app_context : Stored with the instance. 
+* @return  A pointer to the new instance, or NULL if all are in use.
+*/
+cr_stack_t *cr_stack_create(void *app_context)
+{
+    for (int i=1; i<CR_NUM_STACK_INSTANCES; i++)
+    {
+        if (sCr_stack_pool[i].in_use)
+            continue;
+        memset(&sCr_stack_pool[i], 0, sizeof(cr_stack_t));
+        sCr_stack_pool[i].app_context = app_context;
+        sCr_stack_pool[i].session = &sCr_stack_pool[i].sessions[0];
+        // Last, as cr_param_changed() only looks at instances in use.
+        __atomic_store_n(&sCr_stack_pool[i].in_use, true, __ATOMIC_RELEASE);
+        return &sCr_stack_pool[i];
+    }
+    LOG_ERROR("%s: All %d stack instances are in use.", __FUNCTION__, CR_NUM_STACK_INSTANCES);
+    return NULL;
+}
+
+/**
+* @brief   cr_stack_release
+* @details Returns an instance claimed by cr_stack_create() to the pool. 
+*          Prompts loaned to it and transmit buffers lent to it are handed
+*          back to the transport, and frames not yet sent are dropped.
+* @param   stack : The instance to release.
+* @return  cr_ErrorCodes_NO_ERROR or cr_ErrorCodes_INVALID_PARAMETER.
+*/
+int cr_stack_release(cr_stack_t *stack)
+{
+    if ((stack == NULL) || (stack == &sCr_stack_pool[0]) || !stack->in_use)
+        return cr_ErrorCodes_INVALID_PARAMETER;
+
+    // Whatever the transport loaned or lent to this instance goes back.
+    cr_stack_t *prev = pvtCr_active_stack;
+    pvtCr_active_stack = stack;
+    sCr_tx_reset(stack);
+    sCr_prompt_queue_drain(stack);
+    if (stack->response_frame)
+        sCr_tx_return_buffer(&stack->response_frame, 0);
+    if (stack->notification_frame)
+        sCr_tx_return_buffer(&stack->notification_frame, 0);
+    pvtCr_active_stack = (prev == stack) ? &sCr_stack_pool[0] : prev;
+
+    __atomic_store_n(&stack->in_use, false, __ATOMIC_RELEASE);
+    return cr_ErrorCodes_NO_ERROR;
+}
+
+cr_stack_t *cr_get_default_stack(void)
+{
+    return &sCr_stack_pool[0];
+}
+
+cr_stack_t *cr_get_active_stack(void)
+{
+    return pvtCr_active_stack;
+}
+
+void cr_set_active_stack(cr_stack_t *stack)
+{
+    pvtCr_active_stack = (stack == NULL) ? &sCr_stack_pool[0] : stack;
+}
+
+void cr_param_changed(uint32_t pid)
+{
+  #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+    // Whole byte stores are atomic on any core, so no lock is needed.  The 
+    // flag is set before the summary, which cr_process() clears first.  
+    // A free instance may be being cleared by cr_stack_create().
+    for (int i=0; i<CR_NUM_STACK_INSTANCES; i++)
+    {
+        if (!__atomic_load_n(&sCr_stack_pool[i].in_use, __ATOMIC_ACQUIRE))
+            continue;
+        __atomic_store_n(&sCr_stack_pool[i].param_changed[pid % CR_PARAM_CHANGE_FLAGS], 
+                         1, __ATOMIC_RELAXED);
+        __atomic_store_n(&sCr_stack_pool[i].param_changed_any, 1, __ATOMIC_RELEASE);
+    }
+  #else
+    (void)pid;
+  #endif
+}
+
+void *cr_stack_get_app_context(const cr_stack_t *stack)
+{
+    return stack->app_context;
+}
+
+/**
+* @brief   cr_store_coded_prompt_ctx
+* @details As cr_store_coded_prompt(), for the given stack instance.  The 
+*          prompt is added to a lock free queue of CR_PROMPT_QUEUE_DEPTH
+*          prompts so this can be called from an interrupt or from a
+*          transport thread while cr_process() runs elsewhere.  There must
+*          be only one such caller per stack instance.
+* @param   stack: The instance to receive the prompt. 
+* @param   data: The coded prompt to be stored. 
+* @param   len : number of bytes to be stored. 
+* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*/
+int cr_store_coded_prompt_ctx(cr_stack_t *stack, uint8_t *data, size_t len)
+{
+    affirm(len <= sizeof(stack->encoded_message_buffer));
+
+  #if CR_PROMPT_QUEUE_DEPTH > 0
+    // Only the producer writes the head.  The acquire pairs with the release 
+    // of the tail by cr_process() so that the slot is not reused early.
+    uint32_t head = stack->prompt_queue_head;
+    uint32_t tail = __atomic_load_n(&stack->prompt_queue_tail, __ATOMIC_ACQUIRE);
+    if ((head - tail) >= CR_PROMPT_QUEUE_DEPTH)
+        return cr_ErrorCodes_NO_RESOURCE;   // full.  The caller may retry.
+
+    uint32_t slot = head & (CR_PROMPT_QUEUE_DEPTH - 1);
+    memcpy(stack->prompt_queue[slot], data, len);
+    stack->prompt_queue_len[slot] = len;
+    stack->prompt_queue_loan[slot] = NULL;
+    __atomic_store_n(&stack->prompt_queue_head, head + 1, __ATOMIC_RELEASE);
+  #else
+    memcpy(stack->encoded_message_buffer, data, len);
+    stack->encoded_message_size = len;
+  #endif
+    return cr_ErrorCodes_NO_ERROR;
+}
+
+/**
+* @brief   cr_loan_coded_prompt_ctx
+* @details As cr_loan_coded_prompt(), for the given stack instance.  The 
+*          pointer takes a place in the same queue as cr_store_coded_prompt()
+*          so that prompts are handled in the order they arrive.
+* @param   stack: The instance to receive the prompt. 
+* @param   data: The coded prompt, in a buffer owned by the transport. 
+* @param   len : number of bytes in the prompt. 
+* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*/
+int cr_loan_coded_prompt_ctx(cr_stack_t *stack, const uint8_t *data, size_t len)
+{
+    affirm(data);
+    affirm(len <= CR_CODED_BUFFER_SIZE);
+
+  #if CR_PROMPT_QUEUE_DEPTH > 0
+    uint32_t head = stack->prompt_queue_head;
+    uint32_t tail = __atomic_load_n(&stack->prompt_queue_tail, __ATOMIC_ACQUIRE);
+    if ((head - tail) >= CR_PROMPT_QUEUE_DEPTH)
+        return cr_ErrorCodes_NO_RESOURCE;   // full.  The buffer remains with the caller.
+
+    uint32_t slot = head & (CR_PROMPT_QUEUE_DEPTH - 1);
+    stack->prompt_queue_loan[slot] = data;
+    stack->prompt_queue_len[slot] = len;
+    __atomic_store_n(&stack->prompt_queue_head, head + 1, __ATOMIC_RELEASE);
+    return cr_ErrorCodes_NO_ERROR;
+  #else
+    // Without a queue there is nowhere to hold the loan.
+    (void)stack;
+    (void)len;
+    return cr_ErrorCodes_NOT_IMPLEMENTED;
+  #endif
+}
+
+/**
+* @brief   cr_get_coded_response_buffer_ctx
+* @details As cr_get_coded_response_buffer(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @param   ppResponse: Pointer to pointer to bytes.
+* @param   pLen : pointer to the number of bytes for transmission.
+* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*/
+int cr_get_coded_response_buffer_ctx(cr_stack_t *stack, uint8_t **ppResponse, size_t *pLen)
+{
+    *ppResponse = stack->encoded_response_buffer;
+    *pLen = stack->encoded_response_size;
+    if (stack->encoded_response_size == 0)
         return cr_ErrorCodes_NO_DATA;
-    sCr_encoded_response_size = 0;
+    stack->encoded_response_size = 0;
     return cr_ErrorCodes_NO_ERROR;
 }
 
 // static uint32_t lastTick = 0;
-static int sCr_CallCount = 0;
-static uint32_t sCr_currentTicks = 0;
 
 /**
 * @brief   cr_process
@@ -415,158 +625,1248 @@ static uint32_t sCr_currentTicks = 0;
 */
 int cr_process(uint32_t ticks) 
 {
-    sCr_currentTicks = ticks;   // store it so others can use it.
-    sCr_CallCount++;
+    return cr_process_ctx(pvtCr_active_stack, ticks);
+}
 
-    if (!cr_get_comm_link_connected())
-        return cr_ErrorCodes_NO_ERROR;
+/// @private
+static int sCr_process(uint32_t ticks);
+/// @private
+static uint32_t sCr_next_process_ticks(uint32_t ticks);
 
-  #ifdef INCLUDE_FILE_SERVICE
-    int timeout = pvtCr_watchdog_check_timeout(ticks);
-    if (timeout) {
-        i3_log(LOG_MASK_ERROR, "Timeout watchdog expired.");
-        pvtCr_watchdog_end_timeout();
-    }
-  #endif // def INCLUDE_FILE_SERVICE
+/**
+* @brief   cr_process_ctx
+* @details As cr_process(), for the given stack instance.  The instance is 
+*          active for the duration of the call so that anything called from
+*          here, including the crcb_ callbacks, works on it.
+* @param   stack: The instance to run. 
+* @param   ticks: A measure of time passed, typically milliseconds. 
+* @return  As cr_process().
+*/
+int cr_process_ctx(cr_stack_t *stack, uint32_t ticks)
+{
+    return cr_process_budget_ctx(stack, ticks, 0, 0);
+}
 
-    /*if (ticks - lastTick > 10001)
-    {
-        i3_log(LOG_MASK_ALWAYS, "\r\n--------%s: tick %d", __FUNCTION__, ticks);
-        lastTick = ticks;
-    }*/
+/**
+* @brief   cr_process_budget
+* @details As cr_process(), stopping at a safe point once the budget is spent.
+* @param   ticks: A measure of time passed, typically milliseconds. 
+* @param   max_work: The most units of work.  Zero for no limit.
+* @param   max_time: The most time by crcb_get_budget_clock().  Zero for no limit.
+* @return  As cr_process().
+*/
+int cr_process_budget(uint32_t ticks, uint32_t max_work, uint32_t max_time)
+{
+    return cr_process_budget_ctx(pvtCr_active_stack, ticks, max_work, max_time);
+}
 
-    // clear buffers of previous data
-    memset(&sCr_uncoded_message_structure,  0, sizeof(cr_ReachMessage));
-    memset(sCr_uncoded_response_buffer,     0, sizeof(sCr_uncoded_response_buffer));
-    memset(sCr_encoded_payload_buffer,      0, sizeof(sCr_encoded_payload_buffer));
-    // memset(sCr_encoded_response_buffer,     0, sizeof(sCr_encoded_response_buffer));
+/**
+* @brief   cr_process_budget_ctx
+* @details As cr_process_budget(), for the given stack instance.  The time 
+*          and work of every call are recorded for 
+*          cr_get_process_statistics().
+* @param   stack: The instance to run. 
+* @param   ticks: A measure of time passed, typically milliseconds. 
+* @param   max_work: The most units of work.  Zero for no limit.
+* @param   max_time: The most time by crcb_get_budget_clock().  Zero for no limit.
+* @return  As cr_process().
+*/
+int cr_process_budget_ctx(cr_stack_t *stack, uint32_t ticks, 
+                          uint32_t max_work, uint32_t max_time)
+{
+    affirm(stack != NULL);
+    cr_stack_t *prev = pvtCr_active_stack;
+    pvtCr_active_stack = stack;
+
+    stack->budget_work    = max_work;
+    stack->budget_time    = max_time;
+    stack->budget_start   = crcb_get_budget_clock();
+    stack->work_done      = 0;
+    stack->budget_stopped = false;
+
+    int rval = sCr_process(ticks);
+    stack->next_process_ticks = sCr_next_process_ticks(ticks);
+
+    cr_ProcessStatistics *stats = &stack->process_stats;
+    stats->last_time = crcb_get_budget_clock() - stack->budget_start;
+    stats->last_work = stack->work_done;
+    if (stats->last_time > stats->max_time)
+        stats->max_time = stats->last_time;
+    if (stats->last_work > stats->max_work)
+        stats->max_work = stats->last_work;
+    if (stack->budget_stopped)
+        stats->num_deferred++;
+    // No limit for work done outside of cr_process().
+    stack->budget_work = stack->budget_time = 0;
+
+    pvtCr_active_stack = prev;
+    return rval;
+}
 
-    // Support for continued transactions:
-    //   zero indicates valid data was produced.
-    //   cr_ErrorCodes_NO_DATA indicates no data was produced.
-    //   Other non-zero values indicate an error report was produced.
-    int rval = handle_continued_transactions();
-    if (rval == cr_ErrorCodes_NO_DATA)
+/**
+* @brief   pvtCr_budget_spent
+* @details Asked at the safe points of cr_process_budget().
+* @return  true to stop here and resume in the next call.
+*/
+bool pvtCr_budget_spent(void)
+{
+    cr_stack_t *stack = pvtCr_active_stack;
+    if (stack->work_done == 0)
+        return false;
+    if (((stack->budget_work != 0) && (stack->work_done >= stack->budget_work)) ||
+        ((stack->budget_time != 0) && 
+         ((crcb_get_budget_clock() - stack->budget_start) >= stack->budget_time)))
     {
-        // Gets the encoded buffer from the app.
-        rval = crcb_get_coded_prompt(sCr_encoded_message_buffer, &sCr_encoded_message_size);
-        if (rval == cr_ErrorCodes_NO_DATA)
-        {
-            sCr_encoded_message_size = 0;
-
-            // check notifications when nothing else is happening.
-            pvtCrParam_check_for_notifications();
-
-            return cr_ErrorCodes_NO_DATA;
-        }
-
-
-        I3_LOG(LOG_MASK_REACH, TEXT_MAGENTA "Got a new prompt" TEXT_RESET);
-        LOG_DUMP_WIRE("Rcvd prompt", sCr_encoded_message_buffer, sCr_encoded_message_size);
-        rval = handle_coded_prompt(); // in case of error the reply is the error report
-        sCr_encoded_message_size = 0;
-
-        // these two cases require no response/reply
-        if ((rval == cr_ErrorCodes_NO_DATA) || (rval == cr_ErrorCodes_NO_RESPONSE))
-            return rval;
-
-        if (rval && !sCr_error_reported)
-        {
-            // The functions called here must report their errors
-            // and return the error code.  This is a backup.
-            cr_report_error(rval, "Otherwise unreported error");
-        }
-        sCr_error_reported = false;
+        stack->budget_stopped = true;
+        return true;
     }
-    crcb_send_coded_response(sCr_encoded_response_buffer, sCr_encoded_response_size);
-
-    return cr_ErrorCodes_NO_ERROR;
+    return false;
 }
 
+/**
+* @brief   pvtCr_budget_charge
+* @param   units : The units of work done.
+*/
+void pvtCr_budget_charge(uint32_t units)
+{
+    pvtCr_active_stack->work_done += units;
+}
 
 /**
-* @brief   cr_get_current_ticks
-* @details The tick count is passed in to cr_process(). This function gives 
-*          other Reach functions access to that value. 
-* @return  The same tick count passed into cr_process().
+* @brief   cr_get_process_statistics
+* @details The execution time of cr_process().  
+* @param   stats : Filled in.  The max values and the counts are zeroed.
 */
-uint32_t cr_get_current_ticks()
+void cr_get_process_statistics(cr_ProcessStatistics *stats)
 {
-    // a 32 bit number will roll over in 49 days at 1kHz.
-    return sCr_currentTicks;
+    cr_get_process_statistics_ctx(pvtCr_active_stack, stats);
 }
 
-static bool sCr_comm_link_is_connected = false;
 /**
-* @brief   cr_set_comm_link_connected
-* @details The communication stack must inform the Reach stack of the status of 
-*          the communication link. The integration must inform Reach when
-*          the connection status changes. The Reach loop only runs when the
-*          connection is valid. All parameter notifications are cleared when a
-*          connection is established. The client must reenable notifications on
-*          each connection.
-* @param   connected true if connected.
+* @brief   cr_get_process_statistics_ctx
+* @details As cr_get_process_statistics(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @param   stats : Filled in.  The max values and the counts are zeroed.
 */
-void cr_set_comm_link_connected(bool connected)
-{ 
-   if (!sCr_comm_link_is_connected && connected)
-   {
-       // we are newly connected, so clear any stale data.
-       pvtCr_continued_message_type = cr_ReachMessageTypes_INVALID;
-       pvtCr_num_remaining_objects = 0;
-       cr_clear_param_notifications();
-       crcb_invalidate_challenge_key();
-   }
-   sCr_comm_link_is_connected = connected;
-} 
+void cr_get_process_statistics_ctx(cr_stack_t *stack, cr_ProcessStatistics *stats)
+{
+    *stats = stack->process_stats;
+    stack->process_stats.max_time     = 0;
+    stack->process_stats.max_work     = 0;
+    stack->process_stats.num_deferred = 0;
+    stack->process_stats.num_prebuilt = 0;
+}
 
 /**
-* @brief   cr_get_comm_link_connected
-* @details Returns what was set using cr_set_comm_link_connected().
-* @return  true if the communication link is connected.
+* @brief   cr_get_next_process_ticks
+* @details The tick count at which cr_process() next needs to be called. 
+* @return  A tick count computed by the last cr_process().
 */
-bool cr_get_comm_link_connected(void)
-{ 
-   return sCr_comm_link_is_connected;
-} 
+uint32_t cr_get_next_process_ticks(void)
+{
+    return pvtCr_active_stack->next_process_ticks;
+}
 
 /**
-* @brief   cr_report_error
-* @details The system can report errors to the client.  This 
-*          takes some memory and so users are given the option
-*          to configure this with ERROR_REPORT_FORMAT defined in
-*          reach-server.h.  ERROR_FORMAT_FULL causes another 240
-*          byte buffer to be allocated so that the error string
-*          can be forwarded to the client at any time without
-*          sharing buffers.  ERROR_FORMAT_SHORT causes only the
-*          error code to be passed to the client.
-*          ERROR_FORMAT_LOG_ONLY disables the remote
-*          notification and only prints the error code in the
-*          local log.
-* @param error_code : Use of the cr_ErrorCodes_ enum is encouraged but not 
-*                   required.
-* @param fmt : A printf-like string with variables. 
+* @brief   cr_get_next_process_ticks_ctx
+* @details As cr_get_next_process_ticks(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @return  A tick count computed by the last cr_process_ctx().
 */
+uint32_t cr_get_next_process_ticks_ctx(const cr_stack_t *stack)
+{
+    return stack->next_process_ticks;
+}
 
-#ifndef ERROR_REPORT_FORMAT
-    #warning  ERROR_REPORT_FORMAT should be defined in reach-server.h
-    void cr_report_error(int error_code, const char *fmt, ...)
+//----------------------------------------------------------------------------
+// Sessions
+//----------------------------------------------------------------------------
+
+/// @private
+/// Forget everything about a session so that it can serve a new client.
+static void sCr_session_reset(cr_session_t *session)
+{
+  #if CR_SPECULATIVE_PAGE
+    if (pvtCr_active_stack->spare_session == session)
+        pvtCr_active_stack->spare_session = NULL;
+  #endif
+  #if CR_RESPONSE_CACHE_ENTRIES > 0
+    sCr_response_cache_forget(session);
+  #endif
+  #if CR_TX_QUEUE_DEPTH > 0
+    // Its queued responses are still sent, but cannot be cancelled by the
+    // next client of the session.
+    for (int i=0; i<CR_TX_QUEUE_DEPTH; i++)
     {
-        (void)fmt;
-        i3_log(LOG_MASK_ERROR, "cr_report_error(%d) is disabled", error_code);
+        if (pvtCr_active_stack->tx_session[i] == session)
+            pvtCr_active_stack->tx_session[i] = NULL;
     }
-#else
-  #if (ERROR_REPORT_FORMAT == ERROR_FORMAT_LOG_ONLY)
-    void cr_report_error(int error_code, const char *fmt, ...)
-    {
+  #endif
+    memset(session, 0, sizeof(cr_session_t));
+    for (int i=0; i<CR_CURSORS_PER_SESSION; i++)
+        session->cursors[i].message_type = cr_ReachMessageTypes_INVALID;
+}
+
+/// @private
+/// The number of open continued transactions of a session.
+static int sCr_open_cursor_count(const cr_session_t *session)
+{
+    int count = 0;
+    for (int i=0; i<CR_CURSORS_PER_SESSION; i++)
+    {
+        if (session->cursors[i].message_type != cr_ReachMessageTypes_INVALID)
+            count++;
+    }
+    return count;
+}
+
+/// @private
+/// The open cursor of a session with pages of the type, or NULL.
+static cr_cursor_t *sCr_find_open_cursor(cr_session_t *session, cr_ReachMessageTypes message_type)
+{
+    for (int i=0; i<CR_CURSORS_PER_SESSION; i++)
+    {
+        if (session->cursors[i].message_type == message_type)
+            return &session->cursors[i];
+    }
+    return NULL;
+}
+
+/// @private
+/// True if tick count a comes before b, allowing for wrap around.
+#define sCr_ticks_before(a, b)  ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+/**
+* @brief   pvtCr_session_select
+* @details Makes the session of the given client the active one, claiming 
+*          a free session or reusing the least recently used one if this
+*          client is new.  A free session is claimed as is so that
+*          notifications set up by cr_init_param_notifications() survive.
+* @param   client_id : From the message header.
+* @param   endpoint_id : From the message header.
+*/
+void pvtCr_session_select(uint32_t client_id, uint32_t endpoint_id)
+{
+    cr_session_t *sessions = pvtCr_active_stack->sessions;
+    cr_session_t *reuse = NULL;
+    uint32_t ticks = sCr_currentTicks;
+
+    for (int i=0; i<CR_NUM_SESSIONS; i++)
+    {
+        if (sessions[i].in_use && 
+            (sessions[i].client_id == client_id) && 
+            (sessions[i].endpoint_id == endpoint_id))
+        {
+            sessions[i].last_used = ticks;
+            pvtCr_session = &sessions[i];
+            return;
+        }
+        // prefer a free session, otherwise the least recently used.
+        if (reuse == NULL)
+            reuse = &sessions[i];
+        else if (!sessions[i].in_use)
+        {
+            if (reuse->in_use)
+                reuse = &sessions[i];
+        }
+        else if (reuse->in_use && 
+                 ((ticks - sessions[i].last_used) > (ticks - reuse->last_used)))
+            reuse = &sessions[i];
+    }
+
+    if (reuse->in_use)
+    {
+        I3_LOG(LOG_MASK_REACH, "Session of client 0x%x given to client 0x%x.",
+               reuse->client_id, client_id);
+        sCr_session_reset(reuse);
+    }
+    reuse->in_use      = true;
+    reuse->client_id   = client_id;
+    reuse->endpoint_id = endpoint_id;
+    reuse->header_template_size = 0;
+    reuse->last_used   = ticks;
+    pvtCr_session = reuse;
+}
+
+/**
+* @brief   pvtCr_challenge_key_is_valid
+* @return  true if the active session has been granted access by the 
+*          challenge key.
+*/
+bool pvtCr_challenge_key_is_valid(void)
+{
+  #if CR_NUM_SESSIONS > 1
+    return pvtCr_session->challenge_key_valid;
+  #else
+    return crcb_challenge_key_is_valid();
+  #endif
+}
+
+/**
+* @brief   cr_session_get_client
+* @details The crcb_ callbacks do not say which client they are serving. One 
+*          that needs to know, for example to grant access per client, can
+*          call this.
+* @param   client_id : The client_id of the active session (output).
+* @param   endpoint_id : The endpoint_id of the active session (output).
+* @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_DATA if no client has 
+*          spoken yet.
+*/
+int cr_session_get_client(uint32_t *client_id, uint32_t *endpoint_id)
+{
+    *client_id   = pvtCr_session->client_id;
+    *endpoint_id = pvtCr_session->endpoint_id;
+    return pvtCr_session->in_use ? cr_ErrorCodes_NO_ERROR : cr_ErrorCodes_NO_DATA;
+}
+
+/**
+* @brief   cr_session_challenge_key_is_valid
+* @details Access granted by the challenge key is remembered per session, 
+*          from the device info request of that client.
+* @return  true if the client of the active session has presented a valid 
+*          challenge key.
+*/
+bool cr_session_challenge_key_is_valid(void)
+{
+    return pvtCr_session->challenge_key_valid;
+}
+
+//----------------------------------------------------------------------------
+// Transmit queue
+//----------------------------------------------------------------------------
+
+/// @private
+/// Offers one contiguous frame to the transport.  An Ahsoka frame is split 
+/// into its size prefix, header and payload, using the header size recorded
+/// when it was encoded.  A classic frame, with a header_size of zero, is one
+/// segment.
+static int sCr_transmit(const uint8_t *frame, size_t len, uint16_t header_size)
+{
+    cr_TxSegment seg[3];
+
+    if ((header_size == 0) || ((size_t)header_size + 2 > len))
+    {
+        seg[0].data = frame;
+        seg[0].len  = len;
+        return crcb_send_coded_segments(pvtCr_active_stack, seg, 1);
+    }
+    seg[0].data = frame;
+    seg[0].len  = 2;
+    seg[1].data = frame + 2;
+    seg[1].len  = header_size;
+    seg[2].data = frame + 2 + header_size;
+    seg[2].len  = len - 2 - header_size;
+    return crcb_send_coded_segments(pvtCr_active_stack, seg, 3);
+}
+
+#if CR_TX_QUEUE_DEPTH > 0
+/// @private
+/// Find a slot in the given state, or -1.  For queued slots, the most urgent.
+static int sCr_tx_find(cr_TxSlotState state)
+{
+    cr_stack_t *st = pvtCr_active_stack;
+    int found = -1;
+    for (int i=0; i<CR_TX_QUEUE_DEPTH; i++)
+    {
+        if (st->tx_state[i] != state)
+            continue;
+        if (state != cr_TxSlot_QUEUED)
+            return i;
+        if ((found < 0) ||
+            (st->tx_class[i] < st->tx_class[found]) ||
+            ((st->tx_class[i] == st->tx_class[found]) && 
+             ((int32_t)(st->tx_seq[i] - st->tx_seq[found]) < 0)))
+            found = i;
+    }
+    return found;
+}
+
+/// @private
+/// Offer queued frames to the transport until it is busy or the queue is empty.
+static void sCr_tx_pump(void)
+{
+    cr_stack_t *st = pvtCr_active_stack;
+    for (;;)
+    {
+        int slot = sCr_tx_find(cr_TxSlot_IN_FLIGHT);
+        if (slot >= 0)
+        {
+            if (!__atomic_load_n(&st->tx_done, __ATOMIC_ACQUIRE))
+                return;   // still sending
+            __atomic_store_n(&st->tx_done, false, __ATOMIC_RELAXED);
+            st->tx_state[slot] = cr_TxSlot_FREE;
+        }
+
+        slot = sCr_tx_find(cr_TxSlot_QUEUED);
+        if (slot < 0)
+            return;
+
+        // Nothing is in flight, so a completion seen now is stale.
+        __atomic_store_n(&st->tx_done, false, __ATOMIC_RELAXED);
+        int rval = sCr_transmit(st->tx_frame[slot], st->tx_len[slot], 
+                                st->tx_header_size[slot]);
+        switch (rval)
+        {
+        case cr_ErrorCodes_INCOMPLETE:
+            st->tx_state[slot] = cr_TxSlot_IN_FLIGHT;
+            return;
+        case cr_ErrorCodes_NO_RESOURCE:
+            return;   // busy.  Try again on the next cr_process().
+        case cr_ErrorCodes_NO_ERROR:
+            break;
+        default:
+            I3_LOG(LOG_MASK_WARN, "%s: transport error %d, frame dropped.", __FUNCTION__, rval);
+            break;
+        }
+        st->tx_state[slot] = cr_TxSlot_FREE;
+    }
+}
+
+/// @private
+/// The number of free transmit slots.
+static int sCr_tx_free_count(void)
+{
+    int count = 0;
+    for (int i=0; i<CR_TX_QUEUE_DEPTH; i++)
+        if (pvtCr_active_stack->tx_state[i] == cr_TxSlot_FREE)
+            count++;
+    return count;
+}
+
+/// @private
+/// Drops the queued responses of the session that belong to the 
+/// transaction, or to any transaction when transaction_id is zero.  A frame
+/// in flight is left to the transport.
+/// @return true if a frame was dropped.
+static bool sCr_tx_cancel(const cr_session_t *session, uint32_t transaction_id)
+{
+    cr_stack_t *st = pvtCr_active_stack;
+    bool dropped = false;
+    for (int i=0; i<CR_TX_QUEUE_DEPTH; i++)
+    {
+        if ((st->tx_state[i] != cr_TxSlot_QUEUED) || (st->tx_session[i] != session) ||
+            ((transaction_id != 0) && (transaction_id != st->tx_transaction_id[i])))
+            continue;
+        st->tx_state[i] = cr_TxSlot_FREE;
+        dropped = true;
+    }
+    return dropped;
+}
+#endif  // CR_TX_QUEUE_DEPTH > 0
+
+/// @private
+/// Chooses where a frame is encoded.  A buffer lent by the transport is 
+/// used when one is offered and no frames are waiting to be sent, so that 
+/// the frame cannot overtake them.  Otherwise the stack's own buffer.
+static uint8_t *sCr_tx_target(uint8_t **held, size_t *held_size, 
+                              uint8_t *own, size_t *size)
+{
+    if (*held == NULL)
+    {
+      #if CR_TX_QUEUE_DEPTH > 0
+        if (sCr_tx_find(cr_TxSlot_QUEUED) < 0)
+      #endif
+        {
+            *held = crcb_get_tx_buffer(pvtCr_active_stack, held_size);
+            affirm((*held == NULL) || (*held_size >= CR_CODED_BUFFER_SIZE));
+        }
+    }
+    if (*held != NULL)
+    {
+        *size = *held_size;
+        return *held;
+    }
+    *size = CR_CODED_BUFFER_SIZE;
+    return own;
+}
+
+/// @private
+/// Hands a lent buffer back to the transport, with a frame or empty.
+static int sCr_tx_return_buffer(uint8_t **held, size_t len)
+{
+    uint8_t *buffer = *held;
+    *held = NULL;
+    int rval = crcb_send_tx_buffer(pvtCr_active_stack, buffer, len);
+    if (rval != cr_ErrorCodes_NO_ERROR)
+        I3_LOG(LOG_MASK_WARN, "%s: transport error %d, frame dropped.", __FUNCTION__, rval);
+    return rval;
+}
+
+/**
+* @brief   pvtCr_send_frame
+* @details All encoded frames leave through here.  The frame is copied 
+*          into the transmit queue and sent by priority class as the
+*          transport allows.  A frame that is accepted is sent.  When the
+*          queue is full the new frame is refused, so that its producer
+*          can try again, and the last free slot is kept for a response.
+*          A frame that was encoded into a buffer lent by the transport
+*          goes straight back to it with crcb_send_tx_buffer().
+* @param   tx_class : The priority of the frame.
+* @param   frame : The encoded frame.
+* @param   len : Size of the frame.
+* @return  cr_ErrorCodes_NO_ERROR, or cr_ErrorCodes_NO_RESOURCE if the 
+*          frame was not accepted because the queue is full.
+*/
+int pvtCr_send_frame(cr_TxClass tx_class, const uint8_t *frame, size_t len)
+{
+    cr_stack_t *st = pvtCr_active_stack;
+
+    // A frame encoded into a transport buffer is already in place.
+    if ((frame != NULL) && (frame == st->response_frame))
+        return sCr_tx_return_buffer(&st->response_frame, len);
+    if ((frame != NULL) && (frame == st->notification_frame))
+        return sCr_tx_return_buffer(&st->notification_frame, len);
+
+    // Otherwise the frame is in the response or the notification buffer.
+    bool response = (frame == sCr_encoded_response_buffer);
+    uint16_t header_size = response ? st->response_header_size : 
+                                      st->notification_header_size;
+
+  #if CR_TX_QUEUE_DEPTH > 0
+    affirm(len <= CR_CODED_BUFFER_SIZE);
+
+    // A frame already accepted is never given up, as its producer has 
+    // moved on.  cr_process() only makes a response when a slot is free,
+    // so other frames leave it the last one.
+    int reserved = (response || (CR_TX_QUEUE_DEPTH == 1)) ? 0 : 1;
+    if (sCr_tx_free_count() <= reserved)
+        sCr_tx_pump();
+    if (sCr_tx_free_count() <= reserved)
+    {
+        st->tx_dropped++;
+        I3_LOG(LOG_MASK_WARN, "%s: Transmit queue full, class %d frame refused.", 
+               __FUNCTION__, tx_class);
+        return cr_ErrorCodes_NO_RESOURCE;
+    }
+    int slot = sCr_tx_find(cr_TxSlot_FREE);
+
+    memcpy(st->tx_frame[slot], frame, len);
+    st->tx_len[slot]   = len;
+    st->tx_header_size[slot] = header_size;
+    st->tx_class[slot] = tx_class;
+    st->tx_seq[slot]   = st->tx_next_seq++;
+    st->tx_session[slot] = response ? pvtCr_session : NULL;
+    st->tx_transaction_id[slot] = st->response_transaction_id;
+    st->tx_state[slot] = cr_TxSlot_QUEUED;
+    sCr_tx_pump();
+    return cr_ErrorCodes_NO_ERROR;
+  #else
+    (void)tx_class;
+    sCr_transmit(frame, len, header_size);
+    return cr_ErrorCodes_NO_ERROR;
+  #endif
+}
+
+/**
+* @brief   cr_send_complete
+* @details Called by an asynchronous transport when the frame that it took 
+*          with cr_ErrorCodes_INCOMPLETE is gone.
+* @param   result : cr_ErrorCodes_NO_ERROR or an error from the transport. 
+*/
+void cr_send_complete(int result)
+{
+    cr_send_complete_ctx(pvtCr_active_stack, result);
+}
+
+/**
+* @brief   cr_send_complete_ctx
+* @details As cr_send_complete(), for the given stack instance. 
+* @param   stack : The instance whose frame was sent.
+* @param   result : cr_ErrorCodes_NO_ERROR or an error from the transport. 
+*/
+void cr_send_complete_ctx(cr_stack_t *stack, int result)
+{
+    (void)result;   // The frame is not sent again either way.
+  #if CR_TX_QUEUE_DEPTH > 0
+    __atomic_store_n(&stack->tx_done, true, __ATOMIC_RELEASE);
+  #else
+    (void)stack;
+  #endif
+}
+
+#if CR_SPECULATIVE_PAGE
+/// @private
+/// Drops the page built ahead for the session if it belongs to the 
+/// transaction, or to any transaction when transaction_id is zero.
+/// @return true if a page was dropped.
+static bool sCr_spare_discard(cr_session_t *session, uint32_t transaction_id)
+{
+    cr_stack_t *st = pvtCr_active_stack;
+    if ((st->spare_session != session) ||
+        ((transaction_id != 0) && (transaction_id != st->spare_transaction_id)))
+        return false;
+    st->spare_session = NULL;
+    return true;
+}
+#endif  // CR_SPECULATIVE_PAGE
+
+/// @private
+/// Gives each open cursor a turn, round robin over the sessions and then
+/// over the cursors of a session.  A page that was built ahead is sent first.
+static int sCr_handle_session_continuations(void)
+{
+  #if CR_SPECULATIVE_PAGE
+    cr_stack_t *st = pvtCr_active_stack;
+    if (st->spare_session != NULL)
+    {
+        pvtCr_session = st->spare_session;
+        st->spare_session = NULL;
+        memcpy(sCr_encoded_response_buffer, st->spare_frame, st->spare_size);
+        sCr_encoded_response_size = st->spare_size;
+        st->response_header_size = st->spare_header_size;
+        st->response_type = st->spare_type;
+        st->response_transaction_id = st->spare_transaction_id;
+        return st->spare_rval;
+    }
+  #endif
+
+    for (int i=0; i<CR_NUM_SESSIONS; i++)
+    {
+        int idx = (pvtCr_active_stack->next_continued_session + i) % CR_NUM_SESSIONS;
+        cr_session_t *session = &pvtCr_active_stack->sessions[idx];
+        for (int j=0; j<CR_CURSORS_PER_SESSION; j++)
+        {
+            int c = (session->next_cursor + j) % CR_CURSORS_PER_SESSION;
+            if (session->cursors[c].message_type == cr_ReachMessageTypes_INVALID)
+                continue;
+
+            pvtCr_session = session;
+            pvtCr_cursor  = &session->cursors[c];
+            memset(sCr_uncoded_response_buffer, 0, sizeof(sCr_uncoded_response_buffer));
+            int rval = handle_continued_transactions();
+            if (rval != cr_ErrorCodes_NO_DATA)
+            {
+                pvtCr_active_stack->next_continued_session = (idx + 1) % CR_NUM_SESSIONS;
+                session->next_cursor = (c + 1) % CR_CURSORS_PER_SESSION;
+                return rval;
+            }
+        }
+    }
+    return cr_ErrorCodes_NO_DATA;
+}
+
+/// @private
+/// Checks the parameter notifications of every session.
+static void sCr_check_session_notifications(void)
+{
+    cr_session_t *served = pvtCr_session;
+  #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+    pvtCrParam_take_changes();
+  #endif
+    for (int i=0; i<CR_NUM_SESSIONS; i++)
+    {
+        pvtCr_session = &pvtCr_active_stack->sessions[i];
+      #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+        // Nothing can be due before the first entry of the heap.
+        if (pvtCr_session->notify_due_valid && 
+            sCr_ticks_before(sCr_currentTicks, pvtCr_session->notify_due))
+            continue;
+      #endif
+        pvtCrParam_check_for_notifications();
+    }
+    pvtCr_session = served;
+}
+
+/// @private
+/// The number of prompts waiting in the queue.
+static uint32_t sCr_prompt_queue_count(void)
+{
+  #if CR_PROMPT_QUEUE_DEPTH > 0
+    return __atomic_load_n(&pvtCr_active_stack->prompt_queue_head, __ATOMIC_ACQUIRE) 
+            - pvtCr_active_stack->prompt_queue_tail;
+  #else
+    return 0;
+  #endif
+}
+
+/// @private
+/// When cr_process() next has work to do, if no prompt arrives first.
+static uint32_t sCr_next_process_ticks(uint32_t ticks)
+{
+    uint32_t next = ticks + CR_MAX_IDLE_TICKS;
+
+    if (!sCr_comm_link_is_connected)
+        return next;
+    if (sCr_prompt_queue_count() != 0)
+        return ticks;
+  #if CR_TX_QUEUE_DEPTH > 0
+    if (sCr_tx_find(cr_TxSlot_QUEUED) >= 0)
+        return ticks;   // waiting for the transport to take a frame
+  #endif
+  #if CR_SPECULATIVE_PAGE
+    if (pvtCr_active_stack->spare_session != NULL)
+        return ticks;   // a page is ready to queue
+  #endif
+  #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+    if (__atomic_load_n(&pvtCr_active_stack->param_changed_any, __ATOMIC_ACQUIRE))
+        return ticks;   // see cr_param_changed()
+  #endif
+
+    for (int i=0; i<CR_NUM_SESSIONS; i++)
+    {
+        const cr_session_t *session = &pvtCr_active_stack->sessions[i];
+        if (sCr_open_cursor_count(session) != 0)
+            return ticks;
+      #ifdef INCLUDE_FILE_SERVICE
+        // The watchdog expires once the ticks pass the target.
+        if (session->watchdog_is_active && 
+            sCr_ticks_before(session->watchdog_target + 1, next))
+            next = session->watchdog_target + 1;
+      #endif
+      #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+        if (!session->notify_due_valid)
+            return ticks;
+        if (sCr_ticks_before(session->notify_due, next))
+            next = session->notify_due;
+      #endif
+    }
+    if (sCr_ticks_before(next, ticks))
+        next = ticks;
+    return next;
+}
+
+/// @private
+/// Gets a prompt, first from the queue, then from the app, and handles it.  
+/// *got_prompt is false if there was none.
+static int sCr_handle_prompt(bool *got_prompt)
+{
+    int rval;
+    bool from_queue = false;
+    const uint8_t *loan = NULL;
+
+  #if CR_PROMPT_QUEUE_DEPTH > 0
+    if (sCr_prompt_queue_count() != 0)
+    {
+        // The prompt is handled in place, either in the slot or in the 
+        // buffer loaned by the transport.  The slot is released when done.
+        uint32_t slot = pvtCr_active_stack->prompt_queue_tail & (CR_PROMPT_QUEUE_DEPTH - 1);
+        loan = pvtCr_active_stack->prompt_queue_loan[slot];
+        sCr_encoded_message_buffer = loan ? loan : pvtCr_active_stack->prompt_queue[slot];
+        sCr_encoded_message_size   = pvtCr_active_stack->prompt_queue_len[slot];
+        from_queue = true;
+    }
+    else
+  #endif
+    {
+        // Gets the encoded buffer from the app.
+        sCr_encoded_message_buffer = pvtCr_active_stack->encoded_message_buffer;
+        rval = crcb_get_coded_prompt_ctx(pvtCr_active_stack, 
+                                         pvtCr_active_stack->encoded_message_buffer, 
+                                         &sCr_encoded_message_size);
+        if (rval == cr_ErrorCodes_NO_DATA)
+        {
+            sCr_encoded_message_size = 0;
+            *got_prompt = false;
+            return cr_ErrorCodes_NO_DATA;
+        }
+    }
+    *got_prompt = true;
+
+    // clear buffers of previous data.  Only when there is work so that an 
+    // idle call is cheap.
+    memset(&sCr_uncoded_message_structure,  0, sizeof(cr_ReachMessage));
+    memset(sCr_uncoded_response_buffer,     0, sizeof(sCr_uncoded_response_buffer));
+
+    I3_LOG(LOG_MASK_REACH, TEXT_MAGENTA "Got a new prompt" TEXT_RESET);
+    LOG_DUMP_WIRE("Rcvd prompt", sCr_encoded_message_buffer, sCr_encoded_message_size);
+    rval = handle_coded_prompt(); // in case of error the reply is the error report
+    sCr_encoded_message_size = 0;
+
+    if (loan)
+    {
+        // Nothing refers to the loaned buffer once the prompt is handled.
+        sCr_encoded_message_buffer = NULL;
+        crcb_return_coded_prompt(pvtCr_active_stack, loan);
+    }
+
+  #if CR_PROMPT_QUEUE_DEPTH > 0
+    if (from_queue)
+        __atomic_store_n(&pvtCr_active_stack->prompt_queue_tail, 
+                         pvtCr_active_stack->prompt_queue_tail + 1, __ATOMIC_RELEASE);
+  #else
+    (void)from_queue;
+  #endif
+
+    // these two cases require no response/reply
+    if ((rval == cr_ErrorCodes_NO_DATA) || (rval == cr_ErrorCodes_NO_RESPONSE))
+        return rval;
+
+    if (rval && !sCr_error_reported)
+    {
+        // The functions called here must report their errors
+        // and return the error code.  This is a backup.
+        cr_report_error(rval, "Otherwise unreported error");
+    }
+    sCr_error_reported = false;
+    return rval;
+}
+
+/// @private
+static int sCr_process_one(bool *got_prompt);
+#if CR_SPECULATIVE_PAGE
+/// @private
+static void sCr_speculate(void);
+#endif
+
+static int sCr_process(uint32_t ticks)
+{
+    sCr_currentTicks = ticks;   // store it so others can use it.
+    sCr_CallCount++;
+
+    if (!cr_get_comm_link_connected())
+        return cr_ErrorCodes_NO_ERROR;
+
+  #ifdef INCLUDE_FILE_SERVICE
+    cr_session_t *served = pvtCr_session;
+    for (int i=0; i<CR_NUM_SESSIONS; i++)
+    {
+        pvtCr_session = &pvtCr_active_stack->sessions[i];
+        int timeout = pvtCr_watchdog_check_timeout(ticks);
+        if (timeout) {
+            i3_log(LOG_MASK_ERROR, "Timeout watchdog expired.");
+            pvtCr_watchdog_end_timeout();
+        }
+    }
+    pvtCr_session = served;
+  #endif // def INCLUDE_FILE_SERVICE
+
+    /*if (ticks - lastTick > 10001)
+    {
+        i3_log(LOG_MASK_ALWAYS, "\r\n--------%s: tick %d", __FUNCTION__, ticks);
+        lastTick = ticks;
+    }*/
+
+  #if CR_TX_QUEUE_DEPTH > 0
+    // Send what is waiting.  If the transport can't keep up, hold off on 
+    // producing more until it does.
+    sCr_tx_pump();
+    if (sCr_tx_free_count() == 0)
+    {
+      #if CR_SPECULATIVE_PAGE
+        sCr_speculate();
+      #endif
+        return cr_ErrorCodes_NO_RESOURCE;
+    }
+  #endif
+
+    // Handle a prompt or continuation, then any more queued prompts up to 
+    // the batch size.
+    bool got_prompt;
+    int rval = sCr_process_one(&got_prompt);
+    for (int n=1; got_prompt && (n < CR_PROMPT_BATCH_SIZE) && (sCr_prompt_queue_count() != 0) &&
+                  !pvtCr_budget_spent(); n++)
+        rval = sCr_process_one(&got_prompt);
+    return rval;
+}
+
+//----------------------------------------------------------------------------
+// Scheduler
+//----------------------------------------------------------------------------
+
+/// @private
+/// The weight of each class of work.
+static const uint8_t sCr_sched_weights[cr_WorkClass_COUNT] =
+{
+    [cr_WorkClass_PROMPT]       = CR_SCHED_WEIGHT_PROMPT,
+    [cr_WorkClass_CONTINUATION] = CR_SCHED_WEIGHT_CONTINUATION,
+    [cr_WorkClass_NOTIFICATION] = CR_SCHED_WEIGHT_NOTIFICATION,
+};
+
+/// @private
+/// The units of work of a class waiting in a stack.  A prompt that the 
+/// transport will give to crcb_get_coded_prompt() is not counted.
+static uint32_t sCr_work_depth(const cr_stack_t *stack, cr_WorkClass work_class)
+{
+    uint32_t depth = 0;
+    switch (work_class)
+    {
+    case cr_WorkClass_PROMPT:
+      #if CR_PROMPT_QUEUE_DEPTH > 0
+        depth = __atomic_load_n(&stack->prompt_queue_head, __ATOMIC_ACQUIRE) 
+                - stack->prompt_queue_tail;
+      #endif
+        break;
+    case cr_WorkClass_CONTINUATION:
+        for (int i=0; i<CR_NUM_SESSIONS; i++)
+            depth += sCr_open_cursor_count(&stack->sessions[i]);
+      #if CR_SPECULATIVE_PAGE
+        if (stack->spare_session != NULL)
+            depth++;
+      #endif
+        break;
+    case cr_WorkClass_NOTIFICATION:
+      #if defined(INCLUDE_PARAMETER_SERVICE) && (NUM_SUPPORTED_PARAM_NOTIFY != 0)
+        for (int i=0; i<CR_NUM_SESSIONS; i++)
+        {
+            const cr_session_t *session = &stack->sessions[i];
+            if (!session->notify_due_valid || 
+                !sCr_ticks_before(stack->current_ticks, session->notify_due))
+                depth++;
+        }
+        if (__atomic_load_n(&stack->param_changed_any, __ATOMIC_ACQUIRE))
+            depth++;
+      #endif
+        break;
+    default:
+        break;
+    }
+    return depth;
+}
+
+/// @private
+/// Does one unit of work of the class, if it has any.
+/// @return true if work was done, with its result in *rval.
+static bool sCr_do_work(cr_WorkClass work_class, bool *got_prompt, int *rval)
+{
+    switch (work_class)
+    {
+    case cr_WorkClass_PROMPT:
+        *rval = sCr_handle_prompt(got_prompt);
+        return *got_prompt;
+    case cr_WorkClass_CONTINUATION:
+        // Support for continued transactions:
+        //   zero indicates valid data was produced.
+        //   cr_ErrorCodes_NO_DATA indicates no data was produced.
+        //   Other non-zero values indicate an error report was produced.
+        *rval = sCr_handle_session_continuations();
+        return *rval != cr_ErrorCodes_NO_DATA;
+    case cr_WorkClass_NOTIFICATION:
+        if (sCr_work_depth(pvtCr_active_stack, cr_WorkClass_NOTIFICATION) == 0)
+            return false;
+        // The notifications send themselves.
+        sCr_check_session_notifications();
+        *rval = cr_ErrorCodes_NO_DATA;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// @private
+/// Chooses and does one unit of work.  Each class with credit left in this
+/// round is offered a turn, most urgent first.  When none of them has work
+/// a new round begins with the credits set to the weights.
+/// @return The class that did work or cr_WorkClass_COUNT if there was none.
+static cr_WorkClass sCr_schedule(bool *got_prompt, int *rval)
+{
+    cr_stack_t *stack = pvtCr_active_stack;
+    uint32_t now = stack->current_ticks;
+
+    for (int c=0; c<cr_WorkClass_COUNT; c++)
+    {
+        uint8_t bit = 1u << c;
+        if (sCr_work_depth(stack, (cr_WorkClass)c) == 0)
+            stack->sched_waiting &= ~bit;   // done or cancelled
+        else if (!(stack->sched_waiting & bit))
+        {
+            stack->sched_waiting |= bit;
+            stack->sched_ready_since[c] = now;
+        }
+    }
+
+    uint8_t offered = 0;
+    for (int round=0; round<2; round++)
+    {
+        for (int c=0; c<cr_WorkClass_COUNT; c++)
+        {
+            uint8_t bit = 1u << c;
+            if ((stack->sched_credit[c] == 0) || (offered & bit))
+                continue;
+            offered |= bit;
+            if (!sCr_do_work((cr_WorkClass)c, got_prompt, rval))
+                continue;
+
+            // The notification check counts its own parameter reads.
+            if (c != cr_WorkClass_NOTIFICATION)
+                pvtCr_budget_charge(1);
+
+            cr_WorkClassStatistics *stats = &stack->sched_stats[c];
+            uint32_t wait = (stack->sched_waiting & bit) ? 
+                                now - stack->sched_ready_since[c] : 0;
+            stack->sched_waiting &= ~bit;
+            stack->sched_credit[c]--;
+            stats->served++;
+            stats->last_wait = wait;
+            if (wait > stats->max_wait)
+                stats->max_wait = wait;
+            return (cr_WorkClass)c;
+        }
+        for (int c=0; c<cr_WorkClass_COUNT; c++)
+            stack->sched_credit[c] = sCr_sched_weights[c];
+    }
+    return cr_WorkClass_COUNT;
+}
+
+/**
+* @brief   cr_get_scheduler_statistics
+* @details How the work of cr_process() is shared between the classes.
+* @param   work_class : The class to report.
+* @param   stats : Filled in.  served and max_wait are zeroed.
+* @return  cr_ErrorCodes_NO_ERROR or cr_ErrorCodes_INVALID_PARAMETER.
+*/
+int cr_get_scheduler_statistics(cr_WorkClass work_class, cr_WorkClassStatistics *stats)
+{
+    return cr_get_scheduler_statistics_ctx(pvtCr_active_stack, work_class, stats);
+}
+
+/**
+* @brief   cr_get_scheduler_statistics_ctx
+* @details As cr_get_scheduler_statistics(), for the given stack instance. 
+* @param   stack: The instance to query. 
+* @param   work_class : The class to report.
+* @param   stats : Filled in.  served and max_wait are zeroed.
+* @return  cr_ErrorCodes_NO_ERROR or cr_ErrorCodes_INVALID_PARAMETER.
+*/
+int cr_get_scheduler_statistics_ctx(cr_stack_t *stack, cr_WorkClass work_class, 
+                                    cr_WorkClassStatistics *stats)
+{
+    if ((stack == NULL) || (stats == NULL) || 
+        (work_class < 0) || (work_class >= cr_WorkClass_COUNT))
+        return cr_ErrorCodes_INVALID_PARAMETER;
+
+    *stats = stack->sched_stats[work_class];
+    stats->depth = sCr_work_depth(stack, work_class);
+    stack->sched_stats[work_class].served   = 0;
+    stack->sched_stats[work_class].max_wait = 0;
+    return cr_ErrorCodes_NO_ERROR;
+}
+
+/// @private
+/// The transmit class of the last encoded response.
+static cr_TxClass sCr_response_tx_class(void)
+{
+    return (pvtCr_active_stack->response_type == cr_ReachMessageTypes_TRANSFER_DATA) ?
+                cr_TxClass_BULK : cr_TxClass_RESPONSE;
+}
+
+#if CR_SPECULATIVE_PAGE
+/// @private
+/// Called while the transmit queue is full.  Builds the next page of a 
+/// continued transaction into the spare buffer, so that the encoding and 
+/// any crcb_read_file() overlap the sending of the frames ahead of it.  
+/// The continuation scheduled next sends it.
+static void sCr_speculate(void)
+{
+    cr_stack_t *st = pvtCr_active_stack;
+    if ((st->spare_session != NULL) || pvtCr_budget_spent())
+        return;
+
+    cr_session_t *served = pvtCr_session;
+    int rval = sCr_handle_session_continuations();
+    if (rval != cr_ErrorCodes_NO_DATA)
+    {
+        pvtCr_budget_charge(1);
+        st->process_stats.num_prebuilt++;
+        if (st->response_frame)
+        {
+            // Encoded into a buffer lent by the transport, which takes it now.
+            pvtCr_send_frame(sCr_response_tx_class(), st->response_frame, 
+                             sCr_encoded_response_size);
+        }
+        else
+        {
+            memcpy(st->spare_frame, sCr_encoded_response_buffer, sCr_encoded_response_size);
+            st->spare_size           = sCr_encoded_response_size;
+            st->spare_header_size    = st->response_header_size;
+            st->spare_rval           = rval;
+            st->spare_type           = st->response_type;
+            st->spare_transaction_id = pvtCr_cursor->transaction_id;
+            st->spare_session        = pvtCr_session;
+        }
+    }
+    pvtCr_session = served;
+}
+#endif  // CR_SPECULATIVE_PAGE
+
+/// @private
+/// One message in or out.  *got_prompt is true if a prompt was handled.
+static int sCr_process_one(bool *got_prompt)
+{
+    // Buffers are cleared by the prompt and continuation handlers, not here, 
+    // so that an idle call does no clearing.
+
+    int rval = cr_ErrorCodes_NO_DATA;
+    *got_prompt = false;
+
+    cr_WorkClass work_class = sCr_schedule(got_prompt, &rval);
+    if ((work_class == cr_WorkClass_COUNT) || (work_class == cr_WorkClass_NOTIFICATION))
+        return cr_ErrorCodes_NO_DATA;
+
+    // these two cases require no response/reply
+    if (*got_prompt && 
+        ((rval == cr_ErrorCodes_NO_DATA) || (rval == cr_ErrorCodes_NO_RESPONSE)))
+    {
+        if (pvtCr_active_stack->response_frame)
+            sCr_tx_return_buffer(&pvtCr_active_stack->response_frame, 0);
+        return rval;
+    }
+
+    pvtCr_send_frame(sCr_response_tx_class(),
+                     pvtCr_active_stack->response_frame ? 
+                        pvtCr_active_stack->response_frame : sCr_encoded_response_buffer, 
+                     sCr_encoded_response_size);
+
+    return cr_ErrorCodes_NO_ERROR;
+}
+
+
+/**
+* @brief   cr_get_current_ticks
+* @details The tick count is passed in to cr_process(). This function gives 
+*          other Reach functions access to that value. 
+* @return  The same tick count passed into cr_process().
+*/
+uint32_t cr_get_current_ticks()
+{
+    // a 32 bit number will roll over in 49 days at 1kHz.
+    return sCr_currentTicks;
+}
+
+/**
+* @brief   cr_set_comm_link_connected
+* @details The communication stack must inform the Reach stack of the status of 
+*          the communication link. The integration must inform Reach when
+*          the connection status changes. The Reach loop only runs when the
+*          connection is valid. All parameter notifications are cleared when a
+*          connection is established. The client must reenable notifications on
+*          each connection.
+* @param   connected true if connected.
+*/
+void cr_set_comm_link_connected(bool connected)
+{ 
+    cr_set_comm_link_connected_ctx(pvtCr_active_stack, connected);
+} 
+
+/**
+* @brief   cr_set_comm_link_connected_ctx
+* @details As cr_set_comm_link_connected(), for the given stack instance. 
+* @param   stack: The instance whose link changed. 
+* @param   connected true if connected.
+*/
+void cr_set_comm_link_connected_ctx(cr_stack_t *stack, bool connected)
+{ 
+   cr_stack_t *prev = pvtCr_active_stack;
+   pvtCr_active_stack = stack;
+   if (sCr_comm_link_is_connected != connected)
+   {
+       // Nothing queued for one link is sent on the next, and a completion
+       // lost with the old link does not hold the queue.
+       sCr_tx_reset(stack);
+       sCr_prompt_queue_drain(stack);
+   }
+   if (!sCr_comm_link_is_connected && connected)
+   {
+       // we are newly connected, so clear any stale data.
+       // This includes the continuations and notifications of every session.
+       for (int i=0; i<CR_NUM_SESSIONS; i++)
+           sCr_session_reset(&stack->sessions[i]);
+       stack->session = &stack->sessions[0];
+       stack->sched_waiting = 0;
+       crcb_invalidate_challenge_key();
+   }
+   // Lent transmit buffers go back to the transport unsent.
+   if (stack->response_frame)
+       sCr_tx_return_buffer(&stack->response_frame, 0);
+   if (stack->notification_frame)
+       sCr_tx_return_buffer(&stack->notification_frame, 0);
+   sCr_comm_link_is_connected = connected;
+   pvtCr_active_stack = prev;
+} 
+
+/// @private
+/// Frees every slot of the transmit queue, whether queued or in flight, 
+/// and drops the page built ahead.
+static void sCr_tx_reset(cr_stack_t *stack)
+{
+  #if CR_TX_QUEUE_DEPTH > 0
+    for (int i=0; i<CR_TX_QUEUE_DEPTH; i++)
+        stack->tx_state[i] = cr_TxSlot_FREE;
+    __atomic_store_n(&stack->tx_done, false, __ATOMIC_RELAXED);
+  #endif
+  #if CR_SPECULATIVE_PAGE
+    stack->spare_session = NULL;
+  #endif
+    (void)stack;
+}
+
+/// @private
+/// Discards the prompts waiting in the queue.  Buffers loaned by the 
+/// transport are returned to it.
+static void sCr_prompt_queue_drain(cr_stack_t *stack)
+{
+  #if CR_PROMPT_QUEUE_DEPTH > 0
+    uint32_t head = __atomic_load_n(&stack->prompt_queue_head, __ATOMIC_ACQUIRE);
+    while (stack->prompt_queue_tail != head)
+    {
+        uint32_t slot = stack->prompt_queue_tail & (CR_PROMPT_QUEUE_DEPTH - 1);
+        if (stack->prompt_queue_loan[slot])
+        {
+            crcb_return_coded_prompt(stack, stack->prompt_queue_loan[slot]);
+            stack->prompt_queue_loan[slot] = NULL;
+        }
+        __atomic_store_n(&stack->prompt_queue_tail, stack->prompt_queue_tail + 1, 
+                         __ATOMIC_RELEASE);
+    }
+  #else
+    (void)stack;
+  #endif
+}
+
+/**
+* @brief   cr_get_comm_link_connected
+* @details Returns what was set using cr_set_comm_link_connected().
+* @return  true if the communication link is connected.
+*/
+bool cr_get_comm_link_connected(void)
+{ 
+   return sCr_comm_link_is_connected;
+} 
+
+/**
+* @brief   cr_get_comm_link_connected_ctx
+* @param   stack: The instance to query. 
+* @return  true if the communication link of this instance is connected.
+*/
+bool cr_get_comm_link_connected_ctx(const cr_stack_t *stack)
+{ 
+   return stack->comm_link_is_connected;
+} 
+
+/**
+* @brief   cr_report_error
+* @details The system can report errors to the client.  This 
+*          takes some memory and so users are given the option
+*          to configure this with ERROR_REPORT_FORMAT defined in
+*          reach-server.h.  ERROR_FORMAT_FULL causes another 240
+*          byte buffer to be allocated so that the error string
+*          can be forwarded to the client at any time without
+*          sharing buffers.  ERROR_FORMAT_SHORT causes only the
+*          error code to be passed to the client.
+*          ERROR_FORMAT_LOG_ONLY disables the remote
+*          notification and only prints the error code in the
+*          local log.
+* @param error_code : Use of the cr_ErrorCodes_ enum is encouraged but not 
+*                   required.
+* @param fmt : A printf-like string with variables. 
+*/
+
+#ifndef ERROR_REPORT_FORMAT
+    #warning  ERROR_REPORT_FORMAT should be defined in reach-server.h
+    void cr_report_error(int error_code, const char *fmt, ...)
+    {
+        (void)fmt;
+        i3_log(LOG_MASK_ERROR, "cr_report_error(%d) is disabled", error_code);
+    }
+#else
+  #if (ERROR_REPORT_FORMAT == ERROR_FORMAT_LOG_ONLY)
+    void cr_report_error(int error_code, const char *fmt, ...)
+    {
         (void)fmt;
         i3_log(LOG_MASK_ERROR, "cr_report_error(%d) to log only", err);
     }
   #elif (ERROR_REPORT_FORMAT == ERROR_FORMAT_SHORT)
-    #define SHORT_ERROR_BUF_LEN  16
     // The asynchronous version requires a buffer.
-    /// @private
-    static uint8_t sCr_short_error_buffer[SHORT_ERROR_BUF_LEN] ALIGN_TO_WORD;
+    #define sCr_short_error_buffer  (pvtCr_active_stack->short_error_buffer)
 
     void cr_report_error(int error_code, const char *fmt, ...)
     {
@@ -583,8 +1883,7 @@ bool cr_get_comm_link_connected(void)
     }
   #else  // (ERROR_REPORT_FORMAT == ERROR_FORMAT_FULL)
     // The asynchronous version requires a buffer.
-    /// @private
-    static uint8_t sCr_async_error_buffer[UNCODED_PAYLOAD_SIZE] ALIGN_TO_WORD;
+    #define sCr_async_error_buffer  (pvtCr_active_stack->async_error_buffer)
 
     void cr_report_error(int error_code, const char *fmt, ...)
     {
@@ -642,18 +1941,20 @@ static int handle_coded_classic_prompt()
     cr_ReachMessage *msgPtr = &sCr_uncoded_message_structure;
     memset(msgPtr, 0, sizeof(cr_ReachMessage));
     if(!decode_reach_message(msgPtr, 
-                             (pb_byte_t *)sCr_encoded_message_buffer, 
+                             (const pb_byte_t *)sCr_encoded_message_buffer, 
                              sCr_encoded_message_size))
     {
         cr_report_error(cr_ErrorCodes_DECODING_FAILED, "%s:Reach header Decode failed", __FUNCTION__);
         return cr_ErrorCodes_DECODING_FAILED;
     }
+    // The payload now lives in msgPtr so the stack's own prompt buffer is 
+    // free to hold the decoded payload.
+    sCr_decoded_prompt_buffer = pvtCr_active_stack->encoded_message_buffer;
 
     cr_ReachMessageHeader *hdr = &msgPtr->header;
     uint8_t *coded_data = (uint8_t *)msgPtr->payload.bytes;
+    pvtCr_session_select(hdr->client_id, hdr->endpoint_id);
     sCr_transaction_id = hdr->transaction_id;
-    sCr_endpoint_id    = hdr->endpoint_id;
-    sCr_client_id      = hdr->client_id;
 
     I3_LOG(LOG_MASK_REACH, "Message type: \t%s", msg_type_string(msgPtr->header.message_type));
     LOG_DUMP_WIRE("handle_coded_prompt (message): ",
@@ -693,36 +1994,35 @@ static int handle_coded_prompt() // ahsoka version
 
     // Store the size of message is in the first two bytes.
     // endian?
-    uint16_t coded_header_size = *(uint16_t*)&sCr_encoded_message_buffer;
-
-    // feed the header into the stream buffer, skipping the leading size
-    pb_istream_t is_stream = 
-        pb_istream_from_buffer(((pb_byte_t *)&sCr_encoded_message_buffer) + 2, 
-                               coded_header_size);
+    uint16_t coded_header_size;
+    memcpy(&coded_header_size, sCr_encoded_message_buffer, sizeof(coded_header_size));
+    if ((size_t)coded_header_size + 2 > sCr_encoded_message_size)
+    {
+        cr_report_error(cr_ErrorCodes_DECODING_FAILED, 
+                        "%s: Ahsoka header size %u too big", __FUNCTION__, coded_header_size);
+        return cr_ErrorCodes_DECODING_FAILED;
+    }
 
-    // Decode the header from the incoming buffer.
-    memset(&header, 0, sizeof(cr_AhsokaMessageHeader));
-    bool status = pb_decode(&is_stream, cr_AhsokaMessageHeader_fields, (void *)&header);
-    if (!status)
+    // Decode the header from the incoming buffer, skipping the leading size
+    if (!decode_ahsoka_header(&header, sCr_encoded_message_buffer + 2, coded_header_size))
     {
-        LOG_ERROR("Ahsoka Header Decoding failed: %s\n", PB_GET_ERROR(&is_stream));
         cr_report_error(cr_ErrorCodes_DECODING_FAILED, 
                         "%s: Ahsoka header Decode failed", __FUNCTION__);
         return cr_ErrorCodes_DECODING_FAILED;
     }
 
     // save the things we need out of the header.
+    uint32_t client_id = 0;
+    memcpy(&client_id, header.client_id.bytes, 
+           header.client_id.size < sizeof(client_id) ? header.client_id.size : sizeof(client_id));
+    pvtCr_session_select(client_id, header.endpoint_id);
     sCr_transaction_id = header.transaction_id;
-    sCr_endpoint_id    = header.endpoint_id;
-    memcpy(&sCr_client_id, header.client_id.bytes, header.client_id.size);
-    pvtCr_num_remaining_objects = header.remaining_objects;
 
-    // The coded data begins after the header
-    uint8_t *coded_data = (uint8_t *)((unsigned int)(&sCr_encoded_message_buffer)
-                                      + 2 + coded_header_size);
+    // The coded data begins after the header.  It is decoded where it lies,
+    // possibly in a buffer loaned by the transport.
+    const uint8_t *coded_payload = sCr_encoded_message_buffer + 2 + coded_header_size;
     uint16_t remaining_objects = sCr_encoded_message_size - 2 - coded_header_size;
-    uint8_t *coded_payload = (uint8_t *)&sCr_uncoded_message_structure;
-    memcpy(coded_payload, coded_data, remaining_objects);
+    sCr_decoded_prompt_buffer = pvtCr_active_stack->decoded_prompt_buffer;
 
     I3_LOG(LOG_MASK_REACH, "Message type: \t%s",
            msg_type_string(header.message_type));
@@ -819,59 +2119,557 @@ void cr_test_sizes()
     rval += sCr_checkSize(cr_StreamData_size,               MAX_BLE_SZ, "cr_StreamData_size");
 
 
-    /// <summary>
-    /// MAX_RAW_SZ is used to check the unencoded structure sizes. 
-    /// </summary>
-    #define MAX_RAW_SZ  CR_DECODED_BUFFER_SIZE
+    /// <summary>
+    /// MAX_RAW_SZ is used to check the unencoded structure sizes. 
+    /// </summary>
+    #define MAX_RAW_SZ  CR_DECODED_BUFFER_SIZE
+
+    rval += sCr_checkSize(sizeof(cr_StreamInfo),            MAX_RAW_SZ, "sizeof(cr_StreamInfo)");
+    rval += sCr_checkSize(sizeof(cr_ErrorReport),           MAX_RAW_SZ, "sizeof(cr_ErrorReport)");
+    rval += sCr_checkSize(sizeof(cr_ParameterReadResponse), MAX_RAW_SZ, "sizeof(cr_ParameterReadResponse)");
+    rval += sCr_checkSize(sizeof(cr_ParameterWrite),        MAX_RAW_SZ, "sizeof(cr_ParameterWrite)");
+    rval += sCr_checkSize(sizeof(cr_ParameterNotifyConfig), MAX_RAW_SZ, "sizeof(cr_ParameterNotifyConfig)");
+    rval += sCr_checkSize(sizeof(cr_ParameterNotification), MAX_RAW_SZ, "sizeof(cr_ParameterNotification)");
+    rval += sCr_checkSize(sizeof(cr_ParameterNotifyConfigResponse), MAX_RAW_SZ, "sizeof(cr_ParameterNotifyConfigResponse)");
+    rval += sCr_checkSize(sizeof(cr_ParameterValue),        MAX_RAW_SZ, "sizeof(cr_ParameterValue)");
+    rval += sCr_checkSize(sizeof(cr_CLIData),               MAX_RAW_SZ, "sizeof(cr_CLI_Data)");
+    rval += sCr_checkSize(sizeof(cr_ParameterRead),         MAX_RAW_SZ, "sizeof(cr_ParameterRead)");
+    rval += sCr_checkSize(sizeof(cr_FileTransferData),      MAX_RAW_SZ, "sizeof(cr_FileTransferData)");
+    rval += sCr_checkSize(sizeof(cr_ParameterInfo),         MAX_RAW_SZ, "sizeof(cr_ParameterInfo)");
+
+
+    rval += sCr_checkSize(sizeof(cr_WiFiConnectionRequest),         MAX_RAW_SZ, "cr_WiFiConnectionRequest");
+    rval += sCr_checkSize(sizeof(cr_WiFiConnectionResponse_size),   MAX_RAW_SZ, "cr_WiFiConnectionResponse");
+    rval += sCr_checkSize(sizeof(cr_DiscoverWiFiResponse_size),     MAX_RAW_SZ, "cr_DiscoverWiFiResponse");
+    rval += sCr_checkSize(sizeof(cr_WiFiConnectionRequest),         MAX_RAW_SZ, "cr_WiFiConnectionRequest");
+
+
+    // If these don't match, check the structures associated with them
+    affirm(sizeof(reach_sizes_t) == REACH_SIZE_STRUCT_SIZE);
+    affirm(REACH_MAX_RESPONSE_SIZE == CR_CODED_BUFFER_SIZE);
+
+  #ifdef VERBOSE_SIZES
+    i3_log(LOG_MASK_ALWAYS, "\n");
+  #endif  // def VERBOSE_SIZES
+
+    // affirm(rval == 0);     // halt if failure
+
+   #ifndef VERBOSE_SIZES
+    i3_log(LOG_MASK_ALWAYS, TEXT_GREEN "     Size tests all pass.");
+  #endif  // def VERBOSE_SIZES
+
+}
+
+//----------------------------------------------------------------------------
+// Message dispatch
+//----------------------------------------------------------------------------
+
+// The handlers and loggers take typed pointers.  These adapt them to the 
+// generic signatures of the dispatch table.
+#define CR_DISPATCH_HANDLER(fn, req_t, resp_t)                              \
+    static int fn##_msg(const void *request, void *response)                \
+    { return fn((req_t *)request, (resp_t *)response); }
+
+#ifndef NO_REACH_LOGGING
+  #define CR_DISPATCH_LOGGER(fn, msg_t)                                     \
+    static void fn##_msg(const void *message) { fn((msg_t *)message); }
+  #define CR_LOG(fn)    fn##_msg
+#else
+  #define CR_DISPATCH_LOGGER(fn, msg_t)
+  #define CR_LOG(fn)    NULL
+#endif  // ndef NO_REACH_LOGGING
+
+/// @private
+/// Lets a handler choose a different response type for this prompt.
+static void sCr_set_response_type(int32_t message_type)
+{
+    pvtCr_active_stack->dispatch_response_type = message_type;
+}
+
+CR_DISPATCH_HANDLER(handle_error_report, const cr_ErrorReport, cr_ErrorReport)
+CR_DISPATCH_HANDLER(handle_ping, const cr_PingRequest, cr_PingResponse)
+CR_DISPATCH_HANDLER(handle_get_device_info, const cr_DeviceInfoRequest, cr_DeviceInfoResponse)
+CR_DISPATCH_LOGGER(message_util_log_ping_request, const cr_PingRequest)
+CR_DISPATCH_LOGGER(message_util_log_ping_response, const cr_PingResponse)
+CR_DISPATCH_LOGGER(message_util_log_device_info_response, const cr_DeviceInfoResponse)
+
+#ifndef NO_REACH_LOGGING
+static void sCr_log_device_info_request_msg(const void *message)
+{
+    (void)message;
+    message_util_log_device_info_request();
+}
+#endif  // ndef NO_REACH_LOGGING
+
+#ifdef INCLUDE_PARAMETER_SERVICE
+CR_DISPATCH_HANDLER(pvtCrParam_discover_parameters, const cr_ParameterInfoRequest, cr_ParameterInfoResponse)
+CR_DISPATCH_HANDLER(pvtCrParam_discover_parameters_ex, const cr_ParameterInfoRequest, cr_ParamExInfoResponse)
+CR_DISPATCH_HANDLER(pvtCrParam_read_param, const cr_ParameterRead, cr_ParameterReadResponse)
+CR_DISPATCH_HANDLER(pvtCrParam_write_param, cr_ParameterWrite, cr_ParameterWriteResponse)
+CR_DISPATCH_HANDLER(pvtCrParam_discover_notifications, const cr_DiscoverParameterNotifications, 
+                    cr_DiscoverParameterNotificationsResponse)
+CR_DISPATCH_LOGGER(message_util_log_param_info_request, const cr_ParameterInfoRequest)
+CR_DISPATCH_LOGGER(message_util_log_param_info_response, const cr_ParameterInfoResponse)
+CR_DISPATCH_LOGGER(message_util_log_param_info_ex_response, const cr_ParamExInfoResponse)
+CR_DISPATCH_LOGGER(message_util_log_read_param, const cr_ParameterRead)
+CR_DISPATCH_LOGGER(message_util_log_read_param_response, const cr_ParameterReadResponse)
+CR_DISPATCH_LOGGER(message_util_log_write_param, const cr_ParameterWrite)
+CR_DISPATCH_LOGGER(message_util_log_write_param_response, const cr_ParameterWriteResponse)
+CR_DISPATCH_LOGGER(message_util_log_discover_notifications, const cr_DiscoverParameterNotifications)
+CR_DISPATCH_LOGGER(message_util_log_discover_notifications_response, 
+                   const cr_DiscoverParameterNotificationsResponse)
+  #if NUM_SUPPORTED_PARAM_NOTIFY != 0
+CR_DISPATCH_HANDLER(pvtCrParam_param_enable_notify, const cr_ParameterEnableNotifications, 
+                    cr_ParameterNotifyConfigResponse)
+CR_DISPATCH_HANDLER(pvtCrParam_param_disable_notify, const cr_ParameterDisableNotifications, 
+                    cr_ParameterNotifyConfigResponse)
+CR_DISPATCH_LOGGER(message_util_log_config_notify_param, const cr_ParameterNotifyConfigResponse)
+  #endif  // NUM_SUPPORTED_PARAM_NOTIFY != 0
+#endif  // def INCLUDE_PARAMETER_SERVICE
+
+#ifdef INCLUDE_FILE_SERVICE
+CR_DISPATCH_HANDLER(pvtCrFile_discover, const cr_DiscoverFiles, cr_DiscoverFilesResponse)
+CR_DISPATCH_HANDLER(pvtCrFile_transfer_init, const cr_FileTransferRequest, cr_FileTransferResponse)
+CR_DISPATCH_HANDLER(pvtCrFile_transfer_data, const cr_FileTransferData, cr_FileTransferDataNotification)
+CR_DISPATCH_HANDLER(pvtCrFile_transfer_data_notification, const cr_FileTransferDataNotification, 
+                    cr_FileTransferData)
+CR_DISPATCH_HANDLER(pvtCrFile_erase_file, const cr_FileEraseRequest, cr_FileEraseResponse)
+CR_DISPATCH_LOGGER(message_util_log_discover_files_response, const cr_DiscoverFilesResponse)
+CR_DISPATCH_LOGGER(message_util_log_file_transfer_request, const cr_FileTransferRequest)
+CR_DISPATCH_LOGGER(message_util_log_file_transfer_response, const cr_FileTransferResponse)
+CR_DISPATCH_LOGGER(message_util_log_transfer_data, const cr_FileTransferData)
+CR_DISPATCH_LOGGER(message_util_log_file_erase_request, cr_FileEraseRequest)
+CR_DISPATCH_LOGGER(message_util_log_file_erase_response, cr_FileEraseResponse)
+
+/// @private
+static int sCr_transfer_data_notification_msg(const void *request, void *response)
+{
+    const cr_FileTransferDataNotification *note = (const cr_FileTransferDataNotification *)request;
+    int rval = pvtCrFile_transfer_data_notification(note, (cr_FileTransferData *)response);
+    // for continuing transactions we need more data.
+    if (!note->is_complete)
+        sCr_set_response_type(cr_ReachMessageTypes_TRANSFER_DATA);
+    return rval;
+}
+  #ifndef NO_REACH_LOGGING
+static void sCr_log_discover_files_msg(const void *message)
+{
+    (void)message;
+    message_util_log_discover_files();
+}
+static void sCr_log_transfer_data_notification_request(const void *message)
+{
+    message_util_log_transfer_data_notification(true, (const cr_FileTransferDataNotification *)message);
+}
+static void sCr_log_transfer_data_notification_response(const void *message)
+{
+    message_util_log_transfer_data_notification(false, (const cr_FileTransferDataNotification *)message);
+}
+  #endif  // ndef NO_REACH_LOGGING
+#endif  // def INCLUDE_FILE_SERVICE
+
+#ifdef INCLUDE_STREAM_SERVICE
+CR_DISPATCH_HANDLER(pvtCr_discover_streams, const cr_DiscoverStreams, cr_DiscoverStreamsResponse)
+CR_DISPATCH_HANDLER(pvtCr_open_stream, const cr_StreamOpen, cr_StreamResponse)
+CR_DISPATCH_HANDLER(pvtCr_close_stream, const cr_StreamClose, cr_StreamResponse)
+CR_DISPATCH_LOGGER(message_util_log_discover_streams_response, const cr_DiscoverStreamsResponse)
+CR_DISPATCH_LOGGER(message_util_log_open_stream, const cr_StreamOpen)
+CR_DISPATCH_LOGGER(message_util_log_open_stream_response, const cr_StreamResponse)
+CR_DISPATCH_LOGGER(message_util_log_close_stream, const cr_StreamClose)
+CR_DISPATCH_LOGGER(message_util_log_close_stream_response, const cr_StreamResponse)
+CR_DISPATCH_LOGGER(message_util_log_receive_stream_notification, const cr_StreamData)
+CR_DISPATCH_LOGGER(message_util_log_send_stream_notification, const cr_StreamData)
+
+/// @private
+static int sCr_stream_receive_notification_msg(const void *request, void *response)
+{
+    (void)response;     // A stream write has no response.
+    return pvtCr_stream_receive_notification((cr_StreamData *)request);
+}
+  #ifndef NO_REACH_LOGGING
+static void sCr_log_discover_streams_msg(const void *message)
+{
+    (void)message;
+    message_util_log_discover_streams();
+}
+  #endif  // ndef NO_REACH_LOGGING
+#endif  // def INCLUDE_STREAM_SERVICE
+
+#ifdef INCLUDE_COMMAND_SERVICE
+CR_DISPATCH_HANDLER(handle_discover_commands, const cr_DiscoverCommands, cr_DiscoverCommandsResponse)
+CR_DISPATCH_HANDLER(handle_send_command, const cr_SendCommand, cr_SendCommandResponse)
+CR_DISPATCH_LOGGER(message_util_log_discover_commands_response, const cr_DiscoverCommandsResponse)
+CR_DISPATCH_LOGGER(message_util_log_send_command, const cr_SendCommand)
+CR_DISPATCH_LOGGER(message_util_log_command_response, const cr_SendCommandResponse)
+  #ifndef NO_REACH_LOGGING
+static void sCr_log_discover_commands_msg(const void *message)
+{
+    (void)message;
+    message_util_log_discover_commands();
+}
+  #endif  // ndef NO_REACH_LOGGING
+#endif  // def INCLUDE_COMMAND_SERVICE
+
+#ifdef INCLUDE_CLI_SERVICE
+CR_DISPATCH_HANDLER(handle_cli_notification, const cr_CLIData, cr_CLIData)
+  #ifndef NO_REACH_LOGGING
+static void sCr_log_cli_received(const void *message)
+{
+    message_util_log_cli_notification(false, (const cr_CLIData *)message);
+}
+static void sCr_log_cli_sent(const void *message)
+{
+    message_util_log_cli_notification(true, (const cr_CLIData *)message);
+}
+  #endif  // ndef NO_REACH_LOGGING
+#endif  // def INCLUDE_CLI_SERVICE
+
+#ifdef INCLUDE_TIME_SERVICE
+CR_DISPATCH_HANDLER(handle_time_set, const cr_TimeSetRequest, cr_TimeSetResponse)
+CR_DISPATCH_HANDLER(handle_time_get, const cr_TimeGetRequest, cr_TimeGetResponse)
+CR_DISPATCH_LOGGER(message_util_log_time_set_request, const cr_TimeSetRequest)
+CR_DISPATCH_LOGGER(message_util_log_time_set_response, const cr_TimeSetResponse)
+CR_DISPATCH_LOGGER(message_util_log_time_get_request, const cr_TimeGetRequest)
+CR_DISPATCH_LOGGER(message_util_log_time_get_response, const cr_TimeGetResponse)
+#endif  // def INCLUDE_TIME_SERVICE
+
+#ifdef INCLUDE_WIFI_SERVICE
+CR_DISPATCH_HANDLER(handle_discover_wifi, const cr_DiscoverWiFi, cr_DiscoverWiFiResponse)
+CR_DISPATCH_HANDLER(handle_wifi_connect, const cr_WiFiConnectionRequest, cr_WiFiConnectionResponse)
+CR_DISPATCH_LOGGER(message_util_log_discover_wifi_request, const cr_DiscoverWiFi)
+CR_DISPATCH_LOGGER(message_util_log_discover_wifi_response, cr_DiscoverWiFiResponse)
+CR_DISPATCH_LOGGER(message_util_log_WiFi_connection_request, const cr_WiFiConnectionRequest)
+CR_DISPATCH_LOGGER(message_util_log_WiFi_connection_response, cr_WiFiConnectionResponse)
+#endif  // def INCLUDE_WIFI_SERVICE
+
+#ifdef NO_REACH_LOGGING
+  // The loggers that are not made by CR_DISPATCH_LOGGER().
+  #define sCr_log_device_info_request_msg               NULL
+  #define sCr_log_discover_files_msg                    NULL
+  #define sCr_log_transfer_data_notification_request    NULL
+  #define sCr_log_transfer_data_notification_response   NULL
+  #define sCr_log_discover_streams_msg                  NULL
+  #define sCr_log_discover_commands_msg                 NULL
+  #define sCr_log_cli_received                          NULL
+  #define sCr_log_cli_sent                              NULL
+#endif  // def NO_REACH_LOGGING
+
+/// @private
+/// The built in message types, indexed by type.  A type that is not 
+/// included in this build has an empty entry.
+static const cr_MessageDescriptor sCr_message_table[_cr_ReachMessageTypes_MAX + 1] =
+{
+    // From the client, an error report of cr_ErrorCodes_ABORT cancels.
+    [cr_ReachMessageTypes_ERROR_REPORT] = {
+        cr_ReachMessageTypes_ERROR_REPORT, cr_ErrorReport_fields, cr_ErrorReport_fields,
+        handle_error_report_msg, NULL, NULL, 0 },
+    [cr_ReachMessageTypes_PING] = {
+        cr_ReachMessageTypes_PING, cr_PingRequest_fields, cr_PingResponse_fields,
+        handle_ping_msg, CR_LOG(message_util_log_ping_request), 
+        CR_LOG(message_util_log_ping_response), 0 },
+    [cr_ReachMessageTypes_GET_DEVICE_INFO] = {
+        cr_ReachMessageTypes_GET_DEVICE_INFO, cr_DeviceInfoRequest_fields, cr_DeviceInfoResponse_fields,
+        handle_get_device_info_msg, sCr_log_device_info_request_msg, 
+        CR_LOG(message_util_log_device_info_response), 0 },
+
+  #ifdef INCLUDE_PARAMETER_SERVICE
+    [cr_ReachMessageTypes_DISCOVER_PARAMETERS] = {
+        cr_ReachMessageTypes_DISCOVER_PARAMETERS, cr_ParameterInfoRequest_fields, cr_ParameterInfoResponse_fields,
+        pvtCrParam_discover_parameters_msg, CR_LOG(message_util_log_param_info_request), 
+        CR_LOG(message_util_log_param_info_response), 0, NULL, NULL,
+        pvtCrParam_discover_parameters_msg },
+    [cr_ReachMessageTypes_DISCOVER_PARAM_EX] = {
+        cr_ReachMessageTypes_DISCOVER_PARAM_EX, cr_ParameterInfoRequest_fields, cr_ParamExInfoResponse_fields,
+        pvtCrParam_discover_parameters_ex_msg, CR_LOG(message_util_log_param_info_request), 
+        CR_LOG(message_util_log_param_info_ex_response), 0, NULL, NULL,
+        pvtCrParam_discover_parameters_ex_msg },
+    [cr_ReachMessageTypes_READ_PARAMETERS] = {
+        cr_ReachMessageTypes_READ_PARAMETERS, cr_ParameterRead_fields, cr_ParameterReadResponse_fields,
+        pvtCrParam_read_param_msg, CR_LOG(message_util_log_read_param), 
+        CR_LOG(message_util_log_read_param_response), 0, NULL, NULL,
+        pvtCrParam_read_param_msg },
+    [cr_ReachMessageTypes_WRITE_PARAMETERS] = {
+        cr_ReachMessageTypes_WRITE_PARAMETERS, cr_ParameterWrite_fields, cr_ParameterWriteResponse_fields,
+        pvtCrParam_write_param_msg, CR_LOG(message_util_log_write_param), 
+        CR_LOG(message_util_log_write_param_response), 0 },
+    [cr_ReachMessageTypes_DISCOVER_NOTIFICATIONS] = {
+        cr_ReachMessageTypes_DISCOVER_NOTIFICATIONS, cr_DiscoverParameterNotifications_fields, 
+        cr_DiscoverParameterNotificationsResponse_fields,
+        pvtCrParam_discover_notifications_msg, CR_LOG(message_util_log_discover_notifications), 
+        CR_LOG(message_util_log_discover_notifications_response), 0, NULL, NULL,
+        pvtCrParam_discover_notifications_msg },
+    #if NUM_SUPPORTED_PARAM_NOTIFY != 0
+    [cr_ReachMessageTypes_PARAM_ENABLE_NOTIFY] = {
+        cr_ReachMessageTypes_PARAM_ENABLE_NOTIFY, cr_ParameterEnableNotifications_fields, 
+        cr_ParameterNotifyConfigResponse_fields,
+        pvtCrParam_param_enable_notify_msg, NULL, 
+        CR_LOG(message_util_log_config_notify_param), 0 },
+    [cr_ReachMessageTypes_PARAM_DISABLE_NOTIFY] = {
+        cr_ReachMessageTypes_PARAM_DISABLE_NOTIFY, cr_ParameterDisableNotifications_fields, 
+        cr_ParameterNotifyConfigResponse_fields,
+        pvtCrParam_param_disable_notify_msg, NULL, 
+        CR_LOG(message_util_log_config_notify_param), 0 },
+    [cr_ReachMessageTypes_PARAMETER_NOTIFICATION] = {
+        cr_ReachMessageTypes_PARAMETER_NOTIFICATION, NULL, cr_ParameterNotification_fields,
+        NULL, NULL, NULL, 0, NULL, encode_parameter_notification },
+    #endif  // NUM_SUPPORTED_PARAM_NOTIFY != 0
+  #endif  // def INCLUDE_PARAMETER_SERVICE
+
+  #ifdef INCLUDE_FILE_SERVICE
+    [cr_ReachMessageTypes_DISCOVER_FILES] = {
+        cr_ReachMessageTypes_DISCOVER_FILES, cr_DiscoverFiles_fields, cr_DiscoverFilesResponse_fields,
+        pvtCrFile_discover_msg, sCr_log_discover_files_msg, 
+        CR_LOG(message_util_log_discover_files_response), 0, NULL, NULL,
+        pvtCrFile_discover_msg },
+    [cr_ReachMessageTypes_TRANSFER_INIT] = {
+        cr_ReachMessageTypes_TRANSFER_INIT, cr_FileTransferRequest_fields, cr_FileTransferResponse_fields,
+        pvtCrFile_transfer_init_msg, CR_LOG(message_util_log_file_transfer_request), 
+        CR_LOG(message_util_log_file_transfer_response), 0 },
+    // A file write is acknowledged with a transfer data notification.
+    // A file read is sent as pages of transfer data.
+    [cr_ReachMessageTypes_TRANSFER_DATA] = {
+        cr_ReachMessageTypes_TRANSFER_DATA, cr_FileTransferData_fields, cr_FileTransferData_fields,
+        pvtCrFile_transfer_data_msg, CR_LOG(message_util_log_transfer_data), 
+        CR_LOG(message_util_log_transfer_data), cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION,
+        decode_file_transfer_data, encode_file_transfer_data,
+        pvtCrFile_transfer_data_notification_msg },
+    [cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION] = {
+        cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION, cr_FileTransferDataNotification_fields, 
+        cr_FileTransferDataNotification_fields,
+        sCr_transfer_data_notification_msg, sCr_log_transfer_data_notification_request, 
+        sCr_log_transfer_data_notification_response, 0 },
+    [cr_ReachMessageTypes_ERASE_FILE] = {
+        cr_ReachMessageTypes_ERASE_FILE, cr_FileEraseRequest_fields, cr_FileEraseResponse_fields,
+        pvtCrFile_erase_file_msg, CR_LOG(message_util_log_file_erase_request), 
+        CR_LOG(message_util_log_file_erase_response), 0 },
+  #endif  // def INCLUDE_FILE_SERVICE
+
+  #ifdef INCLUDE_STREAM_SERVICE
+    [cr_ReachMessageTypes_DISCOVER_STREAMS] = {
+        cr_ReachMessageTypes_DISCOVER_STREAMS, cr_DiscoverStreams_fields, cr_DiscoverStreamsResponse_fields,
+        pvtCr_discover_streams_msg, sCr_log_discover_streams_msg, 
+        CR_LOG(message_util_log_discover_streams_response), 0, NULL, NULL,
+        pvtCr_discover_streams_msg },
+    [cr_ReachMessageTypes_OPEN_STREAM] = {
+        cr_ReachMessageTypes_OPEN_STREAM, cr_StreamOpen_fields, cr_StreamResponse_fields,
+        pvtCr_open_stream_msg, CR_LOG(message_util_log_open_stream), 
+        CR_LOG(message_util_log_open_stream_response), 0 },
+    [cr_ReachMessageTypes_CLOSE_STREAM] = {
+        cr_ReachMessageTypes_CLOSE_STREAM, cr_StreamClose_fields, cr_StreamResponse_fields,
+        pvtCr_close_stream_msg, CR_LOG(message_util_log_close_stream), 
+        CR_LOG(message_util_log_close_stream_response), 0 },
+    [cr_ReachMessageTypes_STREAM_DATA_NOTIFICATION] = {
+        cr_ReachMessageTypes_STREAM_DATA_NOTIFICATION, cr_StreamData_fields, cr_StreamData_fields,
+        sCr_stream_receive_notification_msg, CR_LOG(message_util_log_receive_stream_notification), 
+        CR_LOG(message_util_log_send_stream_notification), 0,
+        decode_stream_data, encode_stream_data },
+  #endif  // def INCLUDE_STREAM_SERVICE
+
+  #ifdef INCLUDE_COMMAND_SERVICE
+    [cr_ReachMessageTypes_DISCOVER_COMMANDS] = {
+        cr_ReachMessageTypes_DISCOVER_COMMANDS, cr_DiscoverCommands_fields, cr_DiscoverCommandsResponse_fields,
+        handle_discover_commands_msg, sCr_log_discover_commands_msg, 
+        CR_LOG(message_util_log_discover_commands_response), 0, NULL, NULL,
+        handle_discover_commands_msg },
+    [cr_ReachMessageTypes_SEND_COMMAND] = {
+        cr_ReachMessageTypes_SEND_COMMAND, cr_SendCommand_fields, cr_SendCommandResponse_fields,
+        handle_send_command_msg, CR_LOG(message_util_log_send_command), 
+        CR_LOG(message_util_log_command_response), 0 },
+  #endif  // def INCLUDE_COMMAND_SERVICE
+
+  #ifdef INCLUDE_CLI_SERVICE
+    [cr_ReachMessageTypes_CLI_NOTIFICATION] = {
+        cr_ReachMessageTypes_CLI_NOTIFICATION, cr_CLIData_fields, cr_CLIData_fields,
+        handle_cli_notification_msg, sCr_log_cli_received, sCr_log_cli_sent, 0 },
+  #endif  // def INCLUDE_CLI_SERVICE
+
+  #ifdef INCLUDE_TIME_SERVICE
+    [cr_ReachMessageTypes_SET_TIME] = {
+        cr_ReachMessageTypes_SET_TIME, cr_TimeSetRequest_fields, cr_TimeSetResponse_fields,
+        handle_time_set_msg, CR_LOG(message_util_log_time_set_request), 
+        CR_LOG(message_util_log_time_set_response), 0 },
+    [cr_ReachMessageTypes_GET_TIME] = {
+        cr_ReachMessageTypes_GET_TIME, cr_TimeGetRequest_fields, cr_TimeGetResponse_fields,
+        handle_time_get_msg, CR_LOG(message_util_log_time_get_request), 
+        CR_LOG(message_util_log_time_get_response), 0 },
+  #endif  // def INCLUDE_TIME_SERVICE
+
+  #ifdef INCLUDE_WIFI_SERVICE
+    [cr_ReachMessageTypes_DISCOVER_WIFI] = {
+        cr_ReachMessageTypes_DISCOVER_WIFI, cr_DiscoverWiFi_fields, cr_DiscoverWiFiResponse_fields,
+        handle_discover_wifi_msg, CR_LOG(message_util_log_discover_wifi_request), 
+        CR_LOG(message_util_log_discover_wifi_response), 0, NULL, NULL,
+        handle_discover_wifi_msg },
+    [cr_ReachMessageTypes_WIFI_CONNECT] = {
+        cr_ReachMessageTypes_WIFI_CONNECT, cr_WiFiConnectionRequest_fields, cr_WiFiConnectionResponse_fields,
+        handle_wifi_connect_msg, CR_LOG(message_util_log_WiFi_connection_request), 
+        CR_LOG(message_util_log_WiFi_connection_response), 0 },
+  #endif  // def INCLUDE_WIFI_SERVICE
+};
+
+/// @private
+/// Message types added by cr_register_message_type().
+static const cr_MessageDescriptor *sCr_custom_messages[CR_NUM_CUSTOM_MESSAGE_TYPES];
+
+/**
+* @brief   cr_get_message_descriptor
+* @details The built in types are found by index.  Registered types are 
+*          searched.
+* @param   message_type: A built in or registered type.  
+* @return  The descriptor of the type, or NULL if it is not supported.
+*/
+const cr_MessageDescriptor *cr_get_message_descriptor(int32_t message_type)
+{
+    if ((message_type > cr_ReachMessageTypes_INVALID) && 
+        (message_type <= _cr_ReachMessageTypes_MAX) &&
+        (sCr_message_table[message_type].message_type == message_type))
+        return &sCr_message_table[message_type];
+
+    for (int i=0; i<CR_NUM_CUSTOM_MESSAGE_TYPES; i++)
+    {
+        if (sCr_custom_messages[i] && (sCr_custom_messages[i]->message_type == message_type))
+            return sCr_custom_messages[i];
+    }
+    return NULL;
+}
+
+/**
+* @brief   cr_register_message_type
+* @details Adds a vendor specific message type.  
+* @param   desc: Describes the new type.  Must remain valid.
+* @return  cr_ErrorCodes_NO_ERROR or a non-zero error code.
+*/
+int cr_register_message_type(const cr_MessageDescriptor *desc)
+{
+    if ((desc == NULL) || (desc->message_type == cr_ReachMessageTypes_INVALID))
+        return cr_ErrorCodes_INVALID_PARAMETER;
+    if (cr_get_message_descriptor(desc->message_type) != NULL)
+        return cr_ErrorCodes_INVALID_ID;
 
-    rval += sCr_checkSize(sizeof(cr_StreamInfo),            MAX_RAW_SZ, "sizeof(cr_StreamInfo)");
-    rval += sCr_checkSize(sizeof(cr_ErrorReport),           MAX_RAW_SZ, "sizeof(cr_ErrorReport)");
-    rval += sCr_checkSize(sizeof(cr_ParameterReadResponse), MAX_RAW_SZ, "sizeof(cr_ParameterReadResponse)");
-    rval += sCr_checkSize(sizeof(cr_ParameterWrite),        MAX_RAW_SZ, "sizeof(cr_ParameterWrite)");
-    rval += sCr_checkSize(sizeof(cr_ParameterNotifyConfig), MAX_RAW_SZ, "sizeof(cr_ParameterNotifyConfig)");
-    rval += sCr_checkSize(sizeof(cr_ParameterNotification), MAX_RAW_SZ, "sizeof(cr_ParameterNotification)");
-    rval += sCr_checkSize(sizeof(cr_ParameterNotifyConfigResponse), MAX_RAW_SZ, "sizeof(cr_ParameterNotifyConfigResponse)");
-    rval += sCr_checkSize(sizeof(cr_ParameterValue),        MAX_RAW_SZ, "sizeof(cr_ParameterValue)");
-    rval += sCr_checkSize(sizeof(cr_CLIData),               MAX_RAW_SZ, "sizeof(cr_CLI_Data)");
-    rval += sCr_checkSize(sizeof(cr_ParameterRead),         MAX_RAW_SZ, "sizeof(cr_ParameterRead)");
-    rval += sCr_checkSize(sizeof(cr_FileTransferData),      MAX_RAW_SZ, "sizeof(cr_FileTransferData)");
-    rval += sCr_checkSize(sizeof(cr_ParameterInfo),         MAX_RAW_SZ, "sizeof(cr_ParameterInfo)");
+    for (int i=0; i<CR_NUM_CUSTOM_MESSAGE_TYPES; i++)
+    {
+        if (sCr_custom_messages[i] == NULL)
+        {
+            sCr_custom_messages[i] = desc;
+            return cr_ErrorCodes_NO_ERROR;
+        }
+    }
+    LOG_ERROR("%s: All %d custom message types are in use.", __FUNCTION__, CR_NUM_CUSTOM_MESSAGE_TYPES);
+    return cr_ErrorCodes_NO_RESOURCE;
+}
 
+/// @private
+/// The continued type a prompt may open or go on with, or INVALID if none.
+/// Types that page through the same application iterator, or the same
+/// file transfer, share one so that only one of them is open at a time.
+static cr_ReachMessageTypes sCr_cursor_family(int32_t message_type)
+{
+    switch (message_type)
+    {
+    case cr_ReachMessageTypes_DISCOVER_PARAMETERS:
+    case cr_ReachMessageTypes_READ_PARAMETERS:
+    case cr_ReachMessageTypes_DISCOVER_NOTIFICATIONS:
+        return cr_ReachMessageTypes_DISCOVER_PARAMETERS;
+    case cr_ReachMessageTypes_TRANSFER_INIT:
+    case cr_ReachMessageTypes_TRANSFER_DATA:
+    case cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION:
+        return cr_ReachMessageTypes_TRANSFER_DATA;
+    default:
+        break;
+    }
+    const cr_MessageDescriptor *desc = cr_get_message_descriptor(message_type);
+    if ((desc != NULL) && (desc->next_page != NULL))
+        return (cr_ReachMessageTypes)message_type;
+    return cr_ReachMessageTypes_INVALID;
+}
 
-    rval += sCr_checkSize(sizeof(cr_WiFiConnectionRequest),         MAX_RAW_SZ, "cr_WiFiConnectionRequest");
-    rval += sCr_checkSize(sizeof(cr_WiFiConnectionResponse_size),   MAX_RAW_SZ, "cr_WiFiConnectionResponse");
-    rval += sCr_checkSize(sizeof(cr_DiscoverWiFiResponse_size),     MAX_RAW_SZ, "cr_DiscoverWiFiResponse");
-    rval += sCr_checkSize(sizeof(cr_WiFiConnectionRequest),         MAX_RAW_SZ, "cr_WiFiConnectionRequest");
+/// @private
+/// Chooses the cursor for a prompt of the active session: the open one 
+/// with its transaction_id or of its family, otherwise a closed one.  When
+/// all are open the handler is given the scratch cursor.
+/// @param   replaces : true for a prompt of a continued type, which closes 
+///                     the transaction of the cursor it is given.
+static cr_cursor_t *sCr_cursor_select(int32_t message_type, bool replaces)
+{
+    cr_session_t *session = pvtCr_session;
+    cr_ReachMessageTypes family = sCr_cursor_family(message_type);
+    cr_cursor_t *closed = NULL;
 
+    for (int i=0; i<CR_CURSORS_PER_SESSION; i++)
+    {
+        cr_cursor_t *cursor = &session->cursors[i];
+        if (cursor->message_type == cr_ReachMessageTypes_INVALID)
+        {
+            if (closed == NULL)
+                closed = cursor;
+            continue;
+        }
+        if ((cursor->transaction_id != sCr_transaction_id) &&
+            ((family == cr_ReachMessageTypes_INVALID) || 
+             (sCr_cursor_family(cursor->message_type) != family)))
+            continue;
 
-    // If these don't match, check the structures associated with them
-    affirm(sizeof(reach_sizes_t) == REACH_SIZE_STRUCT_SIZE);
-    affirm(REACH_MAX_RESPONSE_SIZE == CR_CODED_BUFFER_SIZE);
+        if (replaces)
+        {
+          #if CR_SPECULATIVE_PAGE
+            // A page built ahead for the replaced transaction is not sent.
+            sCr_spare_discard(session, cursor->transaction_id);
+          #endif
+            pvtCr_cursor_close(cursor);
+        }
+        return cursor;
+    }
+    if (closed != NULL)
+        return closed;
 
-  #ifdef VERBOSE_SIZES
-    i3_log(LOG_MASK_ALWAYS, "\n");
-  #endif  // def VERBOSE_SIZES
+    pvtCr_cursor_close(&pvtCr_active_stack->scratch_cursor);
+    return &pvtCr_active_stack->scratch_cursor;
+}
 
-    // affirm(rval == 0);     // halt if failure
+/// @private
+/// Called when a prompt has been handled with the cursor.  A transaction 
+/// opened in the scratch cursor takes the place of the least recently 
+/// active one of the session.  Any other transaction of the same family is
+/// closed.
+static void sCr_cursor_place(cr_cursor_t *cursor)
+{
+    if (cursor->message_type == cr_ReachMessageTypes_INVALID)
+        return;
 
-   #ifndef VERBOSE_SIZES
-    i3_log(LOG_MASK_ALWAYS, TEXT_GREEN "     Size tests all pass.");
-  #endif  // def VERBOSE_SIZES
+    cr_session_t *session = pvtCr_session;
+    if (cursor == &pvtCr_active_stack->scratch_cursor)
+    {
+        cr_cursor_t *oldest = &session->cursors[0];
+        for (int i=1; i<CR_CURSORS_PER_SESSION; i++)
+        {
+            if ((uint32_t)(sCr_currentTicks - session->cursors[i].last_active) >
+                (uint32_t)(sCr_currentTicks - oldest->last_active))
+                oldest = &session->cursors[i];
+        }
+        LOG_ERROR("Continued %d of client 0x%x replaced by %d.", 
+                  oldest->message_type, session->client_id, cursor->message_type);
+        *oldest = *cursor;
+        pvtCr_cursor_close(cursor);
+        cursor = oldest;
+        pvtCr_cursor = oldest;
+    }
 
+    cr_ReachMessageTypes family = sCr_cursor_family(cursor->message_type);
+    for (int i=0; i<CR_CURSORS_PER_SESSION; i++)
+    {
+        cr_cursor_t *other = &session->cursors[i];
+        if ((other != cursor) && (other->message_type != cr_ReachMessageTypes_INVALID) &&
+            (sCr_cursor_family(other->message_type) == family))
+            pvtCr_cursor_close(other);
+    }
 }
 
-// <summary> Decodes the payload and calls the appropriate 
-// handler function. 
-// </summary>
-// <param name="hdr"> Includes type of message</param>
-// <param name="data">The actual message</param>
-// <param name="size">in bytes</param>
-// <returns>0 on success or an error</returns>
-
 /*********************************************************************************
   * The caller separated the wrapper into header and coded_data.
-  * The header and coded_data point into sCr_uncoded_message_structure.
-  * In this function: 
+  * The coded_data points into the prompt, or into sCr_uncoded_message_structure
+  * for a classic prompt.
+  * In this function:
+  *   The message type is looked up in the dispatch table.
   *   The prompt is decoded into sCr_decoded_prompt_buffer and handled.
   *   The result is coded into sCr_encoded_response_buffer with length.
   *   First the payload is determined.  Then it is encoded.
@@ -884,185 +2682,90 @@ handle_message(const cr_ReachMessageHeader *hdr, const uint8_t *coded_data, size
     affirm(coded_data);
 
     cr_ReachMessageTypes message_type = (cr_ReachMessageTypes)hdr->message_type;
-    cr_ReachMessageTypes encode_message_type = message_type; // default 
+    const cr_MessageDescriptor *desc = cr_get_message_descriptor(message_type);
+    if ((desc == NULL) || (desc->handler == NULL))
+    {
+        cr_report_error(cr_ErrorCodes_NOT_IMPLEMENTED, "Unhandled message type %d.", message_type);
+        LOG_ERROR("Unhandled message type %d.", message_type);
+        return cr_ErrorCodes_NOT_IMPLEMENTED;
+    }
 
-    //LOG_REACH("call decode_reach_payload(from 0x%x, to 0x%x, sz %d)", 
-    //          coded_data, sCr_decoded_prompt_buffer, size);
+  #if CR_RESPONSE_CACHE_ENTRIES > 0
+    // A prompt sent again is answered as before without handling it again.
+    bool cacheable = sCr_response_cacheable(desc);
+    uint32_t prompt_hash = 0;
+    if (cacheable)
+    {
+        int cached_rval;
+        prompt_hash = sCr_hash_bytes(coded_data, size);
+        if (sCr_response_cache_send(message_type, prompt_hash, size, &cached_rval))
+            return cached_rval;
+    }
+  #endif
 
     if (!decode_reach_payload(message_type,
                               sCr_decoded_prompt_buffer,
                               coded_data, size))
     {
-        cr_report_error(cr_ErrorCodes_DECODING_FAILED, "%s: decode payload %d failed.", 
+        cr_report_error(cr_ErrorCodes_DECODING_FAILED, "%s: decode payload %d failed.",
                         __FUNCTION__, message_type);
         return cr_ErrorCodes_DECODING_FAILED;
     }
 
-    pvtCr_num_remaining_objects = 0;  // default
-
-    int rval = 0;
-    switch (message_type)
+    // A prompt of a type that is continued replaces the transaction of its
+    // cursor.  Other prompts leave it as it was, so that a ping between
+    // pages does not end it, unless the handler closes it.  If the handler 
+    // opens the cursor this prompt begins a continued transaction.
+    cr_cursor_t *cursor = sCr_cursor_select(message_type, desc->next_page != NULL);
+    pvtCr_cursor = cursor;
+    if (sCr_replay_begin(message_type, sCr_decoded_prompt_buffer))
     {
-    case cr_ReachMessageTypes_PING:
-        rval = handle_ping((cr_PingRequest *)sCr_decoded_prompt_buffer,
-                    (cr_PingResponse *)sCr_uncoded_response_buffer);
-        break;
-
-    case cr_ReachMessageTypes_GET_DEVICE_INFO:
-        rval = handle_get_device_info((cr_DeviceInfoRequest *)sCr_decoded_prompt_buffer,
-                               (cr_DeviceInfoResponse *)sCr_uncoded_response_buffer);
-        break;
-  #ifdef INCLUDE_PARAMETER_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_PARAMETERS:
-        rval = pvtCrParam_discover_parameters((cr_ParameterInfoRequest *)sCr_decoded_prompt_buffer,
-                                   (cr_ParameterInfoResponse *)sCr_uncoded_response_buffer);
-        break;
-
-    case cr_ReachMessageTypes_DISCOVER_PARAM_EX:
-        rval = pvtCrParam_discover_parameters_ex((cr_ParameterInfoRequest *)sCr_decoded_prompt_buffer,
-                                   (cr_ParamExInfoResponse *)sCr_uncoded_response_buffer);
-        break;
-
-    case cr_ReachMessageTypes_READ_PARAMETERS:
-        rval = pvtCrParam_read_param((cr_ParameterRead *)sCr_decoded_prompt_buffer,
-                          (cr_ParameterReadResponse *)sCr_uncoded_response_buffer);
-        break;
-
-    case cr_ReachMessageTypes_WRITE_PARAMETERS:
-        rval = pvtCrParam_write_param((cr_ParameterWrite *)sCr_decoded_prompt_buffer,
-                           (cr_ParameterWriteResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_DISCOVER_NOTIFICATIONS:
-        rval = pvtCrParam_discover_notifications((cr_DiscoverParameterNotifications *)sCr_decoded_prompt_buffer,
-                           (cr_DiscoverParameterNotificationsResponse *)sCr_uncoded_response_buffer);
-        break;
-
-    #if NUM_SUPPORTED_PARAM_NOTIFY != 0
-    case cr_ReachMessageTypes_PARAM_ENABLE_NOTIFY:
-        rval = pvtCrParam_param_enable_notify((cr_ParameterEnableNotifications *)sCr_decoded_prompt_buffer,
-                           (cr_ParameterNotifyConfigResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_PARAM_DISABLE_NOTIFY:
-        rval = pvtCrParam_param_disable_notify((cr_ParameterDisableNotifications *)sCr_decoded_prompt_buffer,
-                           (cr_ParameterNotifyConfigResponse *)sCr_uncoded_response_buffer);
-        break;
-    #endif
-  #endif // def INCLUDE_PARAMETER_SERVICE
-
-  #ifdef INCLUDE_FILE_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_FILES:
-        rval = pvtCrFile_discover((cr_DiscoverFiles *)sCr_decoded_prompt_buffer,
-                              (cr_DiscoverFilesResponse *)sCr_uncoded_response_buffer);
-        break;
+        cursor->last_active = sCr_currentTicks;
+        int rval = sCr_replay_send_page(message_type);
+        sCr_cursor_place(cursor);
+        return rval;
+    }
 
-    case cr_ReachMessageTypes_TRANSFER_INIT:
-        rval = pvtCrFile_transfer_init((cr_FileTransferRequest *)sCr_decoded_prompt_buffer,
-                             (cr_FileTransferResponse *)sCr_uncoded_response_buffer);
-        break;
+    cr_ReachMessageTypes open_type = cursor->message_type;
+    uint32_t open_remaining = cursor->num_remaining_objects;
+    cursor->num_remaining_objects = 0;  // default
+    pvtCr_active_stack->dispatch_response_type =
+        desc->response_type ? desc->response_type : (int32_t)message_type;
 
-    case cr_ReachMessageTypes_TRANSFER_DATA:
-        // file write:
-        rval = pvtCrFile_transfer_data((cr_FileTransferData *)sCr_decoded_prompt_buffer,
-                             (cr_FileTransferDataNotification *)sCr_uncoded_response_buffer);
-        // returns cr_ErrorCodes_NO_RESPONSE and hence no error when no response is desired.
-        // when zero is returned we need to ack with a notification.
-        if (rval == cr_ErrorCodes_NO_ERROR)
-            encode_message_type = cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION;
-        break;
+    int rval = desc->handler(sCr_decoded_prompt_buffer, sCr_uncoded_response_buffer);
+    uint32_t remaining_objects = cursor->num_remaining_objects;
 
-    case cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION:
+    if (cursor->message_type == cr_ReachMessageTypes_INVALID)
+        pvtCr_cursor_close(cursor);
+    else if (cursor->message_type != open_type)
     {
-        cr_FileTransferDataNotification *request = 
-            (cr_FileTransferDataNotification *)sCr_decoded_prompt_buffer;
-        rval = pvtCrFile_transfer_data_notification(request,
-                                          (cr_FileTransferData *)sCr_uncoded_response_buffer);
-        // for continuing transactions we need more data.
-        if (!request->is_complete)
-            encode_message_type = cr_ReachMessageTypes_TRANSFER_DATA;
-        break;
+        cursor->transaction_id = sCr_transaction_id;
+        cursor->last_active    = sCr_currentTicks;
+        if (rval != 0)
+            pvtCr_cursor_close(cursor);
     }
-    case cr_ReachMessageTypes_ERASE_FILE:
-        I3_LOG(LOG_MASK_REACH, "%s(): Delete file.", __FUNCTION__);
-        rval = pvtCrFile_erase_file((cr_FileEraseRequest *)sCr_decoded_prompt_buffer,
-                                (cr_FileEraseResponse *)sCr_uncoded_response_buffer);
-        if (rval == cr_ErrorCodes_NO_ERROR)
-            encode_message_type = cr_ReachMessageTypes_ERASE_FILE;
-        break;
-
-  #endif // def INCLUDE_FILE_SERVICE
-
-  #ifdef INCLUDE_STREAM_SERVICE
-
-    case cr_ReachMessageTypes_DISCOVER_STREAMS:
-        rval = pvtCr_discover_streams( (cr_DiscoverStreams *)sCr_decoded_prompt_buffer,
-                                       (cr_DiscoverStreamsResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_OPEN_STREAM:
-        rval = pvtCr_open_stream( (cr_StreamOpen *)sCr_decoded_prompt_buffer,
-                                   (cr_StreamResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_CLOSE_STREAM:
-        rval = pvtCr_close_stream( (cr_StreamClose *)sCr_decoded_prompt_buffer,
-                                   (cr_StreamResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_STREAM_DATA_NOTIFICATION:
-        rval = pvtCr_stream_receive_notification( (cr_StreamData *)sCr_decoded_prompt_buffer);
-        break;
-  #endif // def INCLUDE_STREAM_SERVICE
-
-  #ifdef INCLUDE_COMMAND_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_COMMANDS:
-        rval = handle_discover_commands((cr_DiscoverCommands *)sCr_decoded_prompt_buffer,
-                                 (cr_DiscoverCommandsResponse *)sCr_uncoded_response_buffer);
-        break;
-
-    case cr_ReachMessageTypes_SEND_COMMAND:
-        rval = handle_send_command((cr_SendCommand *)sCr_decoded_prompt_buffer,
-                            (cr_SendCommandResponse *)sCr_uncoded_response_buffer);
-        break;
-  #endif  // def INCLUDE_COMMAND_SERVICE
-
-  #ifdef INCLUDE_CLI_SERVICE
-    case cr_ReachMessageTypes_CLI_NOTIFICATION:
-        rval = handle_cli_notification((cr_CLIData *)sCr_decoded_prompt_buffer,
-                                 (cr_CLIData *)sCr_uncoded_response_buffer);
-        break;
-  #endif // def INCLUDE_CLI_SERVICE
-
-  #ifdef INCLUDE_TIME_SERVICE
-    case cr_ReachMessageTypes_SET_TIME:
-        rval = handle_time_set((cr_TimeSetRequest *)sCr_decoded_prompt_buffer, 
-                                (cr_TimeSetResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_GET_TIME:
-        rval = handle_time_get((cr_TimeGetRequest *)sCr_decoded_prompt_buffer, 
-                                (cr_TimeGetResponse *)sCr_uncoded_response_buffer);
-        break;
-  #endif  // def INCLUDE_TIME_SERVICE
-
-  #ifdef INCLUDE_WIFI_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_WIFI:
-        rval = handle_discover_wifi((cr_DiscoverWiFi *)sCr_decoded_prompt_buffer,
-                                (cr_DiscoverWiFiResponse *)sCr_uncoded_response_buffer);
-        break;
-    case cr_ReachMessageTypes_WIFI_CONNECT:
-        rval = handle_wifi_connect((cr_WiFiConnectionRequest *)sCr_decoded_prompt_buffer, 
-                                   (cr_WiFiConnectionResponse *)sCr_uncoded_response_buffer);
-        break;
-  #endif  // def INCLUDE_WIFI_SERVICE
+    else
+        cursor->num_remaining_objects = open_remaining;
+    sCr_cursor_place(cursor);
 
-    default:
-        cr_report_error(cr_ErrorCodes_NOT_IMPLEMENTED, "Unhandled message type %d.", message_type);
-        LOG_ERROR("Unhandled message type %d.", message_type);
-        rval = cr_ErrorCodes_NOT_IMPLEMENTED; 
-        break;
-    }
     if (rval != 0)
+    {
+      #if CR_DISCOVERY_CACHE_SIZE > 0
+        sCr_cache_abandon();
+      #endif
+      #if CR_RESPONSE_CACHE_ENTRIES > 0
+        if (cacheable && (rval == cr_ErrorCodes_NO_RESPONSE))
+            sCr_response_cache_store(message_type, prompt_hash, size, NULL, 0);
+      #endif
         return rval;
+    }
+
+    cr_ReachMessageTypes encode_message_type =
+        (cr_ReachMessageTypes)pvtCr_active_stack->dispatch_response_type;
 
     cr_ReachMessageHeader msg_header;
     msg_header.message_type      = encode_message_type;
-    msg_header.remaining_objects = pvtCr_num_remaining_objects;
+    msg_header.remaining_objects = remaining_objects;
     msg_header.transaction_id    = sCr_transaction_id;
     msg_header.endpoint_id       = sCr_endpoint_id;
     msg_header.client_id         = sCr_client_id;
@@ -1072,18 +2775,89 @@ handle_message(const cr_ReachMessageHeader *hdr, const uint8_t *coded_data, size
                               &msg_header);
     if (rval != 0)
     {
+      #if CR_DISCOVERY_CACHE_SIZE > 0
+        sCr_cache_abandon();
+      #endif
         cr_report_error(cr_ErrorCodes_ENCODING_FAILED, "Reach encode failed (%d).", rval);
         return cr_ErrorCodes_ENCODING_FAILED;
     }
+
+  #if CR_RESPONSE_CACHE_ENTRIES > 0
+    // The response that begins a continued transaction is not kept, as 
+    // sending it again would not start the pages again.
+    if (cacheable && (cursor->message_type == open_type))
+        sCr_response_cache_store(message_type, prompt_hash, size,
+                                 pvtCr_active_stack->response_frame ? 
+                                    pvtCr_active_stack->response_frame : sCr_encoded_response_buffer,
+                                 sCr_encoded_response_size);
+  #endif
     return 0;
 }
 
+/// @private
+/// An error report sent by the client.  One with the result 
+/// cr_ErrorCodes_ABORT cancels the transaction with the transaction_id of 
+/// its header, or every transaction of the client if that is zero.  A
+/// continued transaction sends no more pages and a file transfer is 
+/// abandoned with its watchdog.  Nothing is sent in response.
+static int handle_error_report(const cr_ErrorReport *request, cr_ErrorReport *response)
+{
+    (void)response;
+    if (request->result != cr_ErrorCodes_ABORT)
+    {
+        LOG_ERROR("Client reported error %d: %s", request->result, request->result_message);
+        return cr_ErrorCodes_NO_RESPONSE;
+    }
+
+    uint32_t transaction_id = sCr_transaction_id;
+    cr_session_t *session = pvtCr_session;
+    bool cancelled = false;
+
+  #if CR_SPECULATIVE_PAGE
+    // A page built ahead is not sent.
+    cancelled = sCr_spare_discard(session, transaction_id);
+  #endif
+  #if CR_TX_QUEUE_DEPTH > 0
+    // Nor are the pages waiting in the transmit queue.
+    if (sCr_tx_cancel(session, transaction_id))
+        cancelled = true;
+  #endif
+
+    for (int i=0; i<CR_CURSORS_PER_SESSION; i++)
+    {
+        cr_cursor_t *cursor = &session->cursors[i];
+        if ((cursor->message_type == cr_ReachMessageTypes_INVALID) ||
+            ((transaction_id != 0) && (transaction_id != cursor->transaction_id)))
+            continue;
+        I3_LOG(LOG_MASK_REACH, "Cancelled continued %d, transaction %u.", 
+               cursor->message_type, cursor->transaction_id);
+      #if CR_DISCOVERY_CACHE_SIZE > 0
+        sCr_cache_abandon();
+      #endif
+        pvtCr_cursor_close(cursor);
+        cancelled = true;
+    }
+  #ifdef INCLUDE_FILE_SERVICE
+    if (pvtCrFile_cancel(transaction_id))
+    {
+        cr_cursor_t *cursor = sCr_find_open_cursor(session, cr_ReachMessageTypes_TRANSFER_DATA);
+        if (cursor != NULL)
+            pvtCr_cursor_close(cursor);
+        cancelled = true;
+    }
+  #endif  // def INCLUDE_FILE_SERVICE
+
+    if (!cancelled)
+        I3_LOG(LOG_MASK_REACH, "No transaction %u to cancel.", transaction_id);
+    return cr_ErrorCodes_NO_RESPONSE;
+}
+
 // handle_ping attempts to reuse the encoded prompt
 static int handle_ping(const cr_PingRequest *request, cr_PingResponse *response) 
 {
     int8_t rssi;
 
-    if (!crcb_challenge_key_is_valid()) {
+    if (!pvtCr_challenge_key_is_valid()) {
         return cr_ErrorCodes_NO_DATA;
     }
 
@@ -1122,14 +2896,15 @@ static void sCr_populate_device_info_sizes(cr_DeviceInfoResponse *dir)
     sizes_struct.short_string_len             = REACH_SHORT_STRING_LEN;
     sizes_struct.param_notify_config_count    = REACH_PARAM_NOTE_SETUP_COUNT;
     sizes_struct.num_descriptors_in_response  = REACH_NUM_MEDIUM_STRUCTS_IN_MESSAGE;
-    sizes_struct.num_param_notifications      = NUM_SUPPORTED_PARAM_NOTIFY;
+    // one byte, so more than 255 is reported as 255.
+    sizes_struct.num_param_notifications      = (NUM_SUPPORTED_PARAM_NOTIFY > 0xFF) ?
+                                                0xFF : NUM_SUPPORTED_PARAM_NOTIFY;
     sizes_struct.num_commands_in_response     = REACH_NUM_COMMANDS_IN_RESPONSE;
     sizes_struct.num_param_desc_in_response   = REACH_COUNT_PARAM_DESC_IN_RESPONSE;
     dir->sizes_struct.size = sizeof(reach_sizes_t);
     memcpy(dir->sizes_struct.bytes, &sizes_struct,  sizeof(reach_sizes_t));
 }
 
-uint8_t sClientProtocolVersion[3];
 /**
  * @brief   handle_get_device_info 
  * @details In response to a request for device info, get the 
@@ -1157,6 +2932,8 @@ handle_get_device_info(const cr_DeviceInfoRequest *request,  // in
     memset(response, 0, sizeof(cr_DeviceInfoResponse));
     crcb_device_get_info(request, response);
     crcb_configure_access_control(request, response);
+    // The access granted by the challenge key belongs to this session.
+    pvtCr_session->challenge_key_valid = crcb_challenge_key_is_valid();
     if (response->services &  cr_ServiceIds_PARAMETER_REPO)
         response->parameter_metadata_hash = crcb_compute_parameter_hash();
 
@@ -1381,8 +3158,6 @@ static int handle_send_command(const cr_SendCommand *request,
         * Client sends WiFiConnectionRequest w/pw, etc.
         * Server responds with status
     */
-    static uint8_t sCr_requested_WiFI_index = 0;
-
     static int handle_discover_wifi(const cr_DiscoverWiFi *request,
                                     cr_DiscoverWiFiResponse *response)
     {
@@ -1449,394 +3224,239 @@ static int handle_send_command(const cr_SendCommand *request,
             I3_LOG(LOG_MASK_DEBUG, "%s: Completed with %d", __FUNCTION__, num_ap);
             return 0;
             // and we're done.
-        } 
-        // otherwise there are more so set up for continued commands
-        response->cd_count = REACH_WIFI_AP_IN_DISCOVER;
-        pvtCr_continued_message_type = cr_ReachMessageTypes_DISCOVER_WIFI;
-        pvtCr_num_remaining_objects = num_ap - REACH_WIFI_AP_IN_DISCOVER;
-        I3_LOG(LOG_MASK_DEBUG, "%s: continuing with %d", __FUNCTION__, pvtCr_num_remaining_objects);
-        return 0;
-    }
-
-    static int handle_wifi_connect(const cr_WiFiConnectionRequest *request, 
-                                      cr_WiFiConnectionResponse *response)
-    {
-        (void)request;
-        if (!crcb_access_granted(cr_ServiceIds_WIFI, -1)) {
-            response->result = cr_ErrorCodes_CHALLENGE_FAILED;
-            return 0;
-        }
-
-        crcb_wifi_connection(request, response);
-        return 0;
-    }
-
-#endif  // def INCLUDE_WIFI_SERVICE
-
-
-/*
- *  Encode Section
- */
-
-static bool sTestHeader = false;
-
-static
-bool encode_reach_payload(cr_ReachMessageTypes message_type,    // in
-                          const void *data,                     // in:  data to be encoded
-                          uint8_t *buffer,                      // out: Encode to here.
-                          pb_size_t buffer_size,                // in:  max size of encoded data
-                          size_t *encode_size)                  // out: encoded data size
-{
-
-  /* Create a stream that writes to the buffer. */
-  pb_ostream_t os_stream = pb_ostream_from_buffer(buffer, buffer_size);
-  bool status = false;
-
-  /* Now we are ready to encode the message. */
-  switch (message_type) 
-  {
-
-  case cr_ReachMessageTypes_GET_DEVICE_INFO:
-      if (sTestHeader)
-      {
-          // encode GDI, not response.
-          status = pb_encode(&os_stream, cr_DeviceInfoRequest_fields, data);
-          if (status) {
-            *encode_size = os_stream.bytes_written;
-            LOG_REACH("Encoded get device info request: \n%s\n");
-          }
-          break;
-      }
-      status = pb_encode(&os_stream, cr_DeviceInfoResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_device_info_response((cr_DeviceInfoResponse *)data);
-      }
-      break;
-
-  case cr_ReachMessageTypes_ERROR_REPORT:
-      status = pb_encode(&os_stream, cr_ErrorReport_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        // cr_ErrorReport *er = (cr_ErrorReport *)data;
-        // I3_LOG(LOG_MASK_REACH, "Error Report: %s", er->result_string);
-      }
-      break;
-  case cr_ReachMessageTypes_PING:
-      if (sTestHeader)
-      {
-          status = pb_encode(&os_stream, cr_PingRequest_fields, data);
-          if (status) {
-            *encode_size = os_stream.bytes_written;
-            LOG_REACH("Encoded Ping request\n");
-          }
-          break;
-      }
-      status = pb_encode(&os_stream, cr_PingResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_ping_response((cr_PingResponse *)data);
-      }
-      break;
-
-#ifdef INCLUDE_PARAMETER_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_PARAMETERS:
-      status = pb_encode(&os_stream, cr_ParameterInfoResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_param_info_response((cr_ParameterInfoResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_DISCOVER_PARAM_EX:
-      status = pb_encode(&os_stream, cr_ParamExInfoResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_param_info_ex_response((cr_ParamExInfoResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_READ_PARAMETERS:
-      status = pb_encode(&os_stream, cr_ParameterReadResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_read_param_response((cr_ParameterReadResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_WRITE_PARAMETERS:
-      status = pb_encode(&os_stream, cr_ParameterWriteResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_write_param_response((cr_ParameterWriteResponse *)data);
-      }
-      else
-      {
-          LOG_ERROR("pb_encode() failed for write params.");
-      }
-      break;
-
-  #if NUM_SUPPORTED_PARAM_NOTIFY != 0
-  case cr_ReachMessageTypes_PARAM_ENABLE_NOTIFY:
-  case cr_ReachMessageTypes_PARAM_DISABLE_NOTIFY:
-      status = pb_encode(&os_stream, cr_ParameterNotifyConfigResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_config_notify_param((cr_ParameterNotifyConfigResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_DISCOVER_NOTIFICATIONS:
-      status = pb_encode(&os_stream, cr_DiscoverParameterNotificationsResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_discover_notifications_response((cr_DiscoverParameterNotificationsResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_PARAMETER_NOTIFICATION:
-      status = pb_encode(&os_stream, cr_ParameterNotification_fields, data);
-      if (status) {
-          *encode_size = os_stream.bytes_written;
-      }
-      break;
-  #endif  // NUM_SUPPORTED_PARAM_NOTIFY != 0
-#endif // def INCLUDE_PARAMETER_SERVICE
-
-#ifdef INCLUDE_FILE_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_FILES:
-      status = pb_encode(&os_stream, cr_DiscoverFilesResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_discover_files_response((cr_DiscoverFilesResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_TRANSFER_INIT:
-
-      status = pb_encode(&os_stream, cr_FileTransferResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_file_transfer_response((cr_FileTransferResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_TRANSFER_DATA:
-      status = pb_encode(&os_stream, cr_FileTransferData_fields, data);
-      if (status) {
-          *encode_size = os_stream.bytes_written;
-          cr_FileTransferData *td = (cr_FileTransferData *)data;
-          message_util_log_transfer_data(td);
-          LOG_DUMP_MASK(LOG_MASK_REACH, "Data Sent", 
-                        td->message_data.bytes, td->message_data.size);
-      }
-      break;
-  case cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION:
-      status =
-          pb_encode(&os_stream, cr_FileTransferDataNotification_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_transfer_data_notification(false,
-                      (cr_FileTransferDataNotification *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_ERASE_FILE:
-      status =
-          pb_encode(&os_stream, cr_FileEraseResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_file_erase_response((cr_FileEraseResponse *)data);
-      }
-      break;
-#endif // def INCLUDE_FILE_SERVICE
-
-#ifdef INCLUDE_STREAM_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_STREAMS:
-      status = pb_encode(&os_stream, cr_DiscoverStreamsResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_discover_streams_response((cr_DiscoverStreamsResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_OPEN_STREAM:
-      status = pb_encode(&os_stream, cr_StreamResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_open_stream_response((cr_StreamResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_CLOSE_STREAM:
-      status = pb_encode(&os_stream, cr_StreamResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_close_stream_response((cr_StreamResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_STREAM_DATA_NOTIFICATION:
-      status = pb_encode(&os_stream, cr_StreamData_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_send_stream_notification((cr_StreamData *)data);
-      }
-    break;
+        } 
+        // otherwise there are more so set up for continued commands
+        response->cd_count = REACH_WIFI_AP_IN_DISCOVER;
+        pvtCr_continued_message_type = cr_ReachMessageTypes_DISCOVER_WIFI;
+        pvtCr_num_remaining_objects = num_ap - REACH_WIFI_AP_IN_DISCOVER;
+        I3_LOG(LOG_MASK_DEBUG, "%s: continuing with %d", __FUNCTION__, pvtCr_num_remaining_objects);
+        return 0;
+    }
 
-#endif // def INCLUDE_STREAM_SERVICE 
+    static int handle_wifi_connect(const cr_WiFiConnectionRequest *request, 
+                                      cr_WiFiConnectionResponse *response)
+    {
+        (void)request;
+        if (!crcb_access_granted(cr_ServiceIds_WIFI, -1)) {
+            response->result = cr_ErrorCodes_CHALLENGE_FAILED;
+            return 0;
+        }
 
-#ifdef INCLUDE_COMMAND_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_COMMANDS:
-      status = pb_encode(&os_stream, cr_DiscoverCommandsResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_discover_commands_response((cr_DiscoverCommandsResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_SEND_COMMAND:
-      status = pb_encode(&os_stream, cr_SendCommandResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_command_response((cr_SendCommandResponse *)data);
-      }
-      break;
-#endif  // def INCLUDE_COMMAND_SERVICE
+        crcb_wifi_connection(request, response);
+        return 0;
+    }
 
-#ifdef INCLUDE_CLI_SERVICE
-  case cr_ReachMessageTypes_CLI_NOTIFICATION:
-      status = pb_encode(&os_stream, cr_CLIData_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_cli_notification(true, (cr_CLIData *)data);
-      }
-      break;
-#endif  // def INCLUDE_CLI_SERVICE
+#endif  // def INCLUDE_WIFI_SERVICE
 
-#ifdef INCLUDE_TIME_SERVICE
-  case cr_ReachMessageTypes_SET_TIME:
-      status = pb_encode(&os_stream, cr_TimeSetResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_time_set_response((cr_TimeSetResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_GET_TIME:
-      status = pb_encode(&os_stream, cr_TimeGetResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_time_get_response((cr_TimeGetResponse *)data);
-      }
-      break;
-#endif  // def INCLUDE_TIME_SERVICE
 
+/*
+ *  Encode Section
+ */
 
-#ifdef INCLUDE_WIFI_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_WIFI:
-      status = pb_encode(&os_stream, cr_DiscoverWiFiResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_discover_wifi_response((cr_DiscoverWiFiResponse *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_WIFI_CONNECT:
-      status = pb_encode(&os_stream, cr_WiFiConnectionResponse_fields, data);
-      if (status) {
-        *encode_size = os_stream.bytes_written;
-        message_util_log_WiFi_connection_request((cr_WiFiConnectionRequest *)data);
-      }
-      break;
-#endif  // def INCLUDE_WIFI_SERVICE
+static bool sTestHeader = false;
 
-  default:
+static
+bool encode_reach_payload(cr_ReachMessageTypes message_type,    // in
+                          const void *data,                     // in:  data to be encoded
+                          uint8_t *buffer,                      // out: Encode to here.
+                          pb_size_t buffer_size,                // in:  max size of encoded data
+                          size_t *encode_size)                  // out: encoded data size
+{
+  const cr_MessageDescriptor *desc = cr_get_message_descriptor(message_type);
+  // The header test encodes the prompt rather than the response.
+  const pb_msgdesc_t *fields = NULL;
+  if (desc)
+      fields = sTestHeader ? desc->request_fields : desc->response_fields;
+  if (fields == NULL)
+  {
       LOG_ERROR("No encoder for %d", message_type);
-      status = cr_ErrorCodes_NO_DATA;
-      break;
+      return false;
   }
 
-  // but there must also be room for the header.
-  affirm (*encode_size < buffer_size);
-
-  if (status)
-      return true;
-
-  LOG_ERROR("Encoding failed: %s\n", PB_GET_ERROR(&os_stream));
-  return false;
-}
-
-static
-bool encode_reach_message(const cr_ReachMessage *message,   // in:  message to be encoded
-                          uint8_t *buffer,                  // out: Buffer to encode into
-                          size_t buffer_size,               // in:  max size of encoded message
-                          size_t *encode_size)              // out: actual size of encoded message.
-{
-  pb_ostream_t os_stream = pb_ostream_from_buffer(buffer, buffer_size);
-
-  bool status = pb_encode(&os_stream, cr_ReachMessage_fields, (void *)message);
-  if (status) {
-    *encode_size = os_stream.bytes_written;
-  } else {
-    LOG_ERROR("Encoding failed: %s\n", PB_GET_ERROR(&os_stream));
+  if (!sTestHeader && desc->encode_response)
+  {
+      if (!desc->encode_response(data, buffer, buffer_size, encode_size))
+          return false;
   }
+  else
+  {
+      /* Create a stream that writes to the buffer. */
+      pb_ostream_t os_stream = pb_ostream_from_buffer(buffer, buffer_size);
 
-  LOG_DUMP_WIRE("The encoded message", buffer, *encode_size);
+      if (!pb_encode(&os_stream, fields, data))
+      {
+          LOG_ERROR("Encoding failed: %s\n", PB_GET_ERROR(&os_stream));
+          return false;
+      }
+      *encode_size = os_stream.bytes_written;
+  }
+  // but there must also be room for the header.
+  affirm (*encode_size < buffer_size);
 
-  return status;
+  if (!sTestHeader && desc->log_response)
+      desc->log_response(data);
+  return true;
 }
 
-// encodes message to sCr_encoded_response_buffer.
+// Encodes the message to sCr_encoded_response_buffer, or to a buffer lent 
+// by the transport, in a single pass.
+// The payload is written straight into the payload field of the envelope 
+// so it is neither encoded into a buffer of its own nor copied.
 // The caller must populate the header
 static int sCr_encode_classic_message(cr_ReachMessageTypes message_type,   // in
                              const void *payload,                  // in:  to be encoded
                              cr_ReachMessageHeader *hdr)           // in
 {
-    // I3_LOG(LOG_MASK_REACH, "%s(): hdr: type %d, remain %d, trans_id %d.", __FUNCTION__,
-    //        hdr->message_type, hdr->remaining_objects, hdr->transaction_id);
-
-    if (!encode_reach_payload(message_type, payload,
-                              sCr_encoded_payload_buffer,
-                              sizeof(sCr_encoded_payload_buffer),
-                              &sCr_encoded_payload_size))
+    const cr_MessageDescriptor *desc = cr_get_message_descriptor(message_type);
+    const pb_msgdesc_t *fields = NULL;
+    if (desc)
+        fields = sTestHeader ? desc->request_fields : desc->response_fields;
+    if (fields == NULL)
+    {
+        cr_report_error(cr_ErrorCodes_ENCODING_FAILED, "No encoder for %d.", message_type);
+        return cr_ErrorCodes_ENCODING_FAILED;
+    }
+    // The client decodes the payload into a fixed size field.
+    if (!pb_get_encoded_size(&sCr_encoded_payload_size, fields, payload) ||
+        (sCr_encoded_payload_size > sizeof(sCr_uncoded_message_structure.payload.bytes)))
     {
         cr_report_error(cr_ErrorCodes_ENCODING_FAILED, "encode payload %d failed.", message_type);
         return cr_ErrorCodes_ENCODING_FAILED;
     }
     i3_log(LOG_MASK_REACH, TEXT_MAGENTA "Encode classic header:");
-
-    // build the message envelope
-    sCr_uncoded_message_structure.header     = *hdr;
-    sCr_uncoded_message_structure.has_header = true;
-    memcpy(sCr_uncoded_message_structure.payload.bytes, 
-           sCr_encoded_payload_buffer, 
-           sCr_encoded_payload_size);
-    sCr_uncoded_message_structure.payload.size = sCr_encoded_payload_size;  
-
     I3_LOG(LOG_MASK_REACH, "%s(): type %d, remain %d, trans_id %d, client %d, ep %d.", 
-           __FUNCTION__,
-           sCr_uncoded_message_structure.header.message_type, 
-           sCr_uncoded_message_structure.header.remaining_objects, 
-           sCr_uncoded_message_structure.header.transaction_id,
-           sCr_uncoded_message_structure.header.client_id,
-           sCr_uncoded_message_structure.header.endpoint_id);
-
-    // encode the wrapped message
-    if (!encode_reach_message(&sCr_uncoded_message_structure,
-                              sCr_encoded_response_buffer,
-                              sizeof(sCr_encoded_response_buffer),
-                              &sCr_encoded_response_size))
+           __FUNCTION__, hdr->message_type, hdr->remaining_objects, 
+           hdr->transaction_id, hdr->client_id, hdr->endpoint_id);
+
+    size_t buffer_size;
+    uint8_t *encBuffer = sCr_tx_target(&pvtCr_active_stack->response_frame,
+                                       &pvtCr_active_stack->response_frame_size,
+                                       sCr_encoded_response_buffer, &buffer_size);
+    pb_ostream_t os_stream = pb_ostream_from_buffer(encBuffer, buffer_size);
+
+    // The envelope is the header submessage followed by the payload bytes.
+    bool status = pb_encode_tag(&os_stream, PB_WT_STRING, cr_ReachMessage_header_tag) &&
+                  pb_encode_submessage(&os_stream, cr_ReachMessageHeader_fields, hdr) &&
+                  pb_encode_tag(&os_stream, PB_WT_STRING, cr_ReachMessage_payload_tag) &&
+                  pb_encode_varint(&os_stream, sCr_encoded_payload_size);
+    size_t payload_start = os_stream.bytes_written;
+    status = status && pb_encode(&os_stream, fields, payload);
+    if (!status || (os_stream.bytes_written - payload_start != sCr_encoded_payload_size))
     {
+        LOG_ERROR("Encoding failed: %s\n", PB_GET_ERROR(&os_stream));
         cr_report_error(cr_ErrorCodes_ENCODING_FAILED, "encode message %d failed.", message_type);
         return cr_ErrorCodes_ENCODING_FAILED;
     }
+    sCr_encoded_response_size = os_stream.bytes_written;
+    pvtCr_active_stack->response_header_size = 0;
+    LOG_DUMP_WIRE("The encoded message", encBuffer, sCr_encoded_response_size);
+
+    if (!sTestHeader && desc->log_response)
+        desc->log_response(payload);
     return 0;
 }
 
+/// @private
+/// Writes a protobuf varint.  An int32 is sign extended to 64 bits first,
+/// as nanopb does.  Returns the number of bytes written.
+static size_t sCr_put_varint(uint8_t *buffer, uint64_t value)
+{
+    size_t n = 0;
+    while (value > 0x7F)
+    {
+        buffer[n++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    buffer[n++] = (uint8_t)value;
+    return n;
+}
+
+/// @private
+/// Builds the part of the Ahsoka header that is the same for every message 
+/// to a client:  the client_id and the endpoint_id fields.  
+/// Returns the size of the template.
+static size_t sCr_build_header_template(uint8_t *tpl, uint32_t client_id, uint32_t endpoint_id)
+{
+    size_t n = 0;
+    tpl[n++] = (cr_AhsokaMessageHeader_client_id_tag << 3) | PB_WT_STRING;
+    tpl[n++] = sizeof(client_id);
+    memcpy(&tpl[n], &client_id, sizeof(client_id));
+    n += sizeof(client_id);
+    if (endpoint_id != 0)
+    {
+        tpl[n++] = (cr_AhsokaMessageHeader_endpoint_id_tag << 3) | PB_WT_VARINT;
+        n += sCr_put_varint(&tpl[n], endpoint_id);
+    }
+    return n;
+}
+
+/// @private
+/// Size of the client_id field at the start of a header template.
+#define sCr_TEMPLATE_CLIENT_SIZE    (2 + sizeof(uint32_t))
+
+/// @private
+/// Encodes an Ahsoka header with the same bytes as pb_encode() would, 
+/// without the generic field iterator.  The client_id and endpoint_id 
+/// fields are copied from a template kept by the session.  
 static
-bool encode_ahsoka_header(const cr_AhsokaMessageHeader *header,  // in:  message to be encoded
-                          uint8_t *buffer,                      // out: Buffer to encode into
-                          size_t buffer_size,                   // in:  max size of encoded message
-                          size_t *encode_size)                  // out: actual size of encoded message.
-{
-  pb_ostream_t os_stream = pb_ostream_from_buffer(buffer, buffer_size);
-
-  bool status = pb_encode(&os_stream, cr_AhsokaMessageHeader_fields, (void *)header);
-  if (status) {
-     *encode_size = os_stream.bytes_written;
-  } else {
-    LOG_ERROR("Encoding ahsoka header failed: %s\n", PB_GET_ERROR(&os_stream));
-  }
-  I3_LOG(LOG_MASK_AHSOKA, "The encoded ahsoka header", buffer, *encode_size);
+bool encode_ahsoka_header(int32_t message_type,         // in
+                          int32_t transaction_id,       // in
+                          int32_t remaining_objects,    // in
+                          uint32_t client_id,           // in
+                          uint32_t endpoint_id,         // in
+                          uint8_t *buffer,              // out: Buffer to encode into
+                          size_t buffer_size,           // in:  max size of encoded header
+                          size_t *encode_size)          // out: actual size of encoded header.
+{
+    if (buffer_size < cr_AhsokaMessageHeader_size)
+    {
+        LOG_ERROR("Encoding ahsoka header failed: buffer of %u too small.", buffer_size);
+        return false;
+    }
+
+    const uint8_t *tpl;
+    size_t tpl_size;
+    uint8_t local_tpl[CR_HEADER_TEMPLATE_SIZE];
+    if ((client_id == sCr_client_id) && (endpoint_id == sCr_endpoint_id))
+    {
+        if (pvtCr_session->header_template_size == 0)
+            pvtCr_session->header_template_size = 
+                sCr_build_header_template(pvtCr_session->header_template, 
+                                          client_id, endpoint_id);
+        tpl      = pvtCr_session->header_template;
+        tpl_size = pvtCr_session->header_template_size;
+    }
+    else
+    {
+        tpl      = local_tpl;
+        tpl_size = sCr_build_header_template(local_tpl, client_id, endpoint_id);
+    }
+
+    // The fields are in tag order, zeros omitted, exactly as nanopb does.
+    size_t n = 0;
+    if (message_type != 0)
+    {
+        buffer[n++] = (cr_AhsokaMessageHeader_message_type_tag << 3) | PB_WT_VARINT;
+        n += sCr_put_varint(&buffer[n], (uint64_t)(int64_t)message_type);
+    }
+    if (transaction_id != 0)
+    {
+        buffer[n++] = (cr_AhsokaMessageHeader_transaction_id_tag << 3) | PB_WT_VARINT;
+        n += sCr_put_varint(&buffer[n], (uint64_t)(int64_t)transaction_id);
+    }
+    memcpy(&buffer[n], tpl, sCr_TEMPLATE_CLIENT_SIZE);
+    n += sCr_TEMPLATE_CLIENT_SIZE;
+    if (remaining_objects != 0)
+    {
+        buffer[n++] = (cr_AhsokaMessageHeader_remaining_objects_tag << 3) | PB_WT_VARINT;
+        n += sCr_put_varint(&buffer[n], (uint64_t)(int64_t)remaining_objects);
+    }
+    memcpy(&buffer[n], &tpl[sCr_TEMPLATE_CLIENT_SIZE], tpl_size - sCr_TEMPLATE_CLIENT_SIZE);
+    n += tpl_size - sCr_TEMPLATE_CLIENT_SIZE;
 
-  return status;
+    *encode_size = n;
+    LOG_DUMP_MASK(LOG_MASK_AHSOKA, "The encoded ahsoka header", buffer, n);
+    return true;
 }
 
 // Encodes a message transission format.
@@ -1846,6 +3466,12 @@ int pvtCr_encode_message(cr_ReachMessageTypes message_type, // in
                          const void *payload,               // in:  to be encoded
                          cr_ReachMessageHeader *hdr)        // in
 {   // Ahsoka version
+    if (hdr)
+    {
+        pvtCr_active_stack->response_type = message_type;   // to choose the tx class
+        pvtCr_active_stack->response_transaction_id = hdr->transaction_id;
+    }
+
     if (sClassic_header_format)
     {
         if (hdr)
@@ -1855,38 +3481,32 @@ int pvtCr_encode_message(cr_ReachMessageTypes message_type, // in
         return 0;
     }
 
-    cr_AhsokaMessageHeader     ahdr;
     uint8_t *encBuffer;
     size_t enbBufferSize;
 
     if (hdr)  // normal response
     {
         LOG_REACH("Encode Ahsoka response:");
-        ahdr.message_type          = message_type;
-        ahdr.client_id.size        = sizeof(hdr->client_id);
-        memcpy(ahdr.client_id.bytes, &hdr->client_id, sizeof(hdr->client_id));
-        ahdr.endpoint_id           = hdr->endpoint_id;
-        ahdr.transaction_id        = hdr->transaction_id;
-        ahdr.remaining_objects     = hdr->remaining_objects;
-        ahdr.is_message_compressed = false;
-        encBuffer = (uint8_t *)sCr_encoded_response_buffer;
-        enbBufferSize = sizeof(sCr_encoded_response_buffer);
-
-        // I3_LOG(LOG_MASK_REACH, "%s(): hdr: type %d, remain %d, trans_id %d.", __FUNCTION__,
-        //        hdr->message_type, hdr->remaining_objects, hdr->transaction_id);
+        encBuffer = sCr_tx_target(&pvtCr_active_stack->response_frame,
+                                  &pvtCr_active_stack->response_frame_size,
+                                  sCr_encoded_response_buffer, &enbBufferSize);
 
         // encode the header
-        if (!encode_ahsoka_header(&ahdr,
+        if (!encode_ahsoka_header(message_type, hdr->transaction_id, 
+                                  hdr->remaining_objects,
+                                  hdr->client_id, hdr->endpoint_id,
                                   &encBuffer[2],
-                                  sizeof(sCr_encoded_response_buffer) - 2,
+                                  enbBufferSize - 2,
                                   &sCr_encoded_response_size))
         {
             cr_report_error(cr_ErrorCodes_ENCODING_FAILED, "encode ahsoka header %d failed.", message_type);
             return cr_ErrorCodes_ENCODING_FAILED;
         }
         // copy the size to the start of the buffer
+        // A lent buffer may not be aligned, so the size is copied bytewise.
         uint16_t header_size = sCr_encoded_response_size;
-        *(uint16_t *)encBuffer = header_size;
+        memcpy(encBuffer, &header_size, sizeof(header_size));
+        pvtCr_active_stack->response_header_size = header_size;
         
         I3_LOG(LOG_MASK_AHSOKA, "Place header_size %d at head of buffer.", header_size);
         LOG_DUMP_MASK(LOG_MASK_AHSOKA, "Ahsoka header with size prefix: ",
@@ -1903,31 +3523,25 @@ int pvtCr_encode_message(cr_ReachMessageTypes message_type, // in
         sCr_encoded_response_size = sCr_encoded_payload_size + header_size + 2;
         LOG_DUMP_MASK(LOG_MASK_AHSOKA, "ahsoka response message complete: ",
                       encBuffer, sCr_encoded_response_size);
+      #if CR_DISCOVERY_CACHE_SIZE > 0
+        sCr_cache_store_page(message_type, &encBuffer[header_size+2],
+                             sCr_encoded_payload_size, hdr->remaining_objects);
+      #endif
         return 0;
     }
 
     // hdr is NULL for notifications.
     I3_LOG(LOG_MASK_AHSOKA, "Encode Ahsoka Notification:");
-    memset(&ahdr, 0, sizeof(ahdr));
-    ahdr.message_type          = message_type;
-    ahdr.client_id.size        = 4;
+    encBuffer = sCr_tx_target(&pvtCr_active_stack->notification_frame,
+                              &pvtCr_active_stack->notification_frame_size,
+                              sCr_coded_notification, &enbBufferSize);
+
+    // The notification goes to the client of the active session.
     // The transaction ID should always be 0 for the app
-    // To Do:  Get the endpoint and client ID's from cr_stack.c
-    ahdr.endpoint_id           = 0;
-    ahdr.transaction_id        = 0;
-    ahdr.remaining_objects     = 0;
-    ahdr.is_message_compressed = false;
-    encBuffer = (uint8_t *)sCr_coded_notification;
-    enbBufferSize = sizeof(sCr_coded_notification);
-
-    /*I3_LOG(LOG_MASK_REACH, "%s(): ahdr: type %d, remain %d, trans_id %d. client %d. ep %d", __FUNCTION__,
-            ahdr.message_type, ahdr.remaining_objects, ahdr.transaction_id,
-            *(int*)ahdr.client_id.bytes, ahdr.endpoint_id);*/
-
-    // encode the header
-    if (!encode_ahsoka_header(&ahdr,
+    if (!encode_ahsoka_header(message_type, 0, 0, 
+                              sCr_client_id, sCr_endpoint_id,
                               &encBuffer[2],
-                              sizeof(sCr_coded_notification) - 2,
+                              enbBufferSize - 2,
                               &sCr_encoded_notification_size))
     {
         cr_report_error(cr_ErrorCodes_ENCODING_FAILED, "encode ahsoka header %d failed.", 
@@ -1936,7 +3550,8 @@ int pvtCr_encode_message(cr_ReachMessageTypes message_type, // in
     }
     // copy the size to the start of the buffer
     uint16_t header_size = sCr_encoded_notification_size;
-    *(uint16_t *)encBuffer = header_size;
+    memcpy(encBuffer, &header_size, sizeof(header_size));
+    pvtCr_active_stack->notification_header_size = header_size;
 
     I3_LOG(LOG_MASK_AHSOKA, "Place header_size %d at head of buffer.", header_size);
     LOG_DUMP_MASK(LOG_MASK_AHSOKA, "Ahsoka header with size prefix: ",
@@ -1955,7 +3570,422 @@ int pvtCr_encode_message(cr_ReachMessageTypes message_type, // in
     }
     sCr_encoded_notification_size = encoded_payload_size + header_size + 2;
     LOG_DUMP_MASK(LOG_MASK_AHSOKA, "ahsoka notification message complete: ",
-                  sCr_coded_notification, sCr_encoded_notification_size);
+                  encBuffer, sCr_encoded_notification_size);
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// Response cache
+//----------------------------------------------------------------------------
+
+#if CR_RESPONSE_CACHE_ENTRIES > 0
+
+/// The responses kept by the active stack.
+#define sCr_response_cache  (pvtCr_active_stack->response_cache)
+
+/// @private
+/// FNV-1a of the bytes.
+static uint32_t sCr_hash_bytes(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<size; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+/// @private
+/// Whether the response to a prompt of the active session can be kept.  
+/// Only prompts with a transaction_id are, and not those that continue or
+/// cancel transactions.
+static bool sCr_response_cacheable(const cr_MessageDescriptor *desc)
+{
+    return (sCr_transaction_id != 0) && !sClassic_header_format &&
+           (desc->next_page == NULL) &&
+           (desc->message_type != cr_ReachMessageTypes_ERROR_REPORT);
+}
+
+/// @private
+/// If the prompt of the active session was handled recently, its response 
+/// is made the response to this one.
+/// @return true with the result of the first prompt in *rval if it was.
+static bool sCr_response_cache_send(int32_t message_type, uint32_t prompt_hash, 
+                                    size_t prompt_size, int *rval)
+{
+    for (int i=0; i<CR_RESPONSE_CACHE_ENTRIES; i++)
+    {
+        cr_ResponseCacheEntry *entry = &sCr_response_cache.entries[i];
+        if ((entry->session != pvtCr_session) ||
+            (entry->client_id != sCr_client_id) ||
+            (entry->transaction_id != sCr_transaction_id) ||
+            (entry->message_type != message_type) ||
+            (entry->prompt_hash != prompt_hash) ||
+            (entry->prompt_size != prompt_size))
+            continue;
+
+        if ((uint32_t)(sCr_currentTicks - entry->stored_ticks) > CR_RESPONSE_CACHE_TICKS)
+        {
+            entry->session = NULL;
+            return false;
+        }
+        I3_LOG(LOG_MASK_REACH, "Prompt %d, transaction %u, sent again.", 
+               message_type, sCr_transaction_id);
+        if (entry->response_size == 0)
+        {
+            *rval = cr_ErrorCodes_NO_RESPONSE;
+            return true;
+        }
+        memcpy(sCr_encoded_response_buffer, entry->response, entry->response_size);
+        sCr_encoded_response_size = entry->response_size;
+        pvtCr_active_stack->response_header_size = entry->response_header_size;
+        pvtCr_active_stack->response_type = entry->response_type;
+        pvtCr_active_stack->response_transaction_id = entry->transaction_id;
+        *rval = 0;
+        return true;
+    }
+    return false;
+}
+
+/// @private
+/// Keeps the response to a prompt of the active session.  A NULL response
+/// records that it had none.
+static void sCr_response_cache_store(int32_t message_type, uint32_t prompt_hash, 
+                                     size_t prompt_size, const uint8_t *response, 
+                                     size_t response_size)
+{
+    affirm(response_size <= CR_CODED_BUFFER_SIZE);
+    cr_ResponseCacheEntry *entry = &sCr_response_cache.entries[sCr_response_cache.next];
+    sCr_response_cache.next = (sCr_response_cache.next + 1) % CR_RESPONSE_CACHE_ENTRIES;
+
+    entry->session        = pvtCr_session;
+    entry->client_id      = sCr_client_id;
+    entry->transaction_id = sCr_transaction_id;
+    entry->message_type   = message_type;
+    entry->prompt_hash    = prompt_hash;
+    entry->prompt_size    = prompt_size;
+    entry->stored_ticks   = sCr_currentTicks;
+    entry->response_type  = pvtCr_active_stack->response_type;
+    entry->response_size  = response ? response_size : 0;
+    entry->response_header_size = pvtCr_active_stack->response_header_size;
+    if (response)
+        memcpy(entry->response, response, response_size);
+}
+
+/// @private
+/// Drops the responses of a session that is reset.
+static void sCr_response_cache_forget(const cr_session_t *session)
+{
+    for (int i=0; i<CR_RESPONSE_CACHE_ENTRIES; i++)
+    {
+        if (sCr_response_cache.entries[i].session == session)
+            sCr_response_cache.entries[i].session = NULL;
+    }
+}
+
+#endif  // CR_RESPONSE_CACHE_ENTRIES > 0
+
+//----------------------------------------------------------------------------
+// Discovery replay
+//----------------------------------------------------------------------------
+
+/// @private
+/// The message type of each slot.
+static const cr_ReachMessageTypes sCr_discovery_types[cr_DiscoverySlot_COUNT] = {
+    cr_ReachMessageTypes_DISCOVER_PARAMETERS,
+    cr_ReachMessageTypes_DISCOVER_PARAM_EX,
+    cr_ReachMessageTypes_DISCOVER_COMMANDS,
+};
+
+#if CR_DISCOVERY_CACHE_SIZE > 0
+
+/// The discovery cache of the active stack.
+#define sCr_discovery_cache  (pvtCr_active_stack->discovery_cache)
+
+/// @private
+/// Empties the cache.  A replay in progress sees the new generation and ends.
+static void sCr_cache_clear(void)
+{
+    memset(sCr_discovery_cache.entries, 0, sizeof(sCr_discovery_cache.entries));
+    sCr_discovery_cache.num_pages    = 0;
+    sCr_discovery_cache.used         = 0;
+    sCr_discovery_cache.fill_session = NULL;
+    sCr_discovery_cache.generation++;
+}
+
+void cr_discovery_cache_invalidate(void)
+{
+    sCr_cache_clear();
+    sCr_discovery_cache.hash_valid = false;
+}
+
+/// @private
+/// Drops the pages of the discovery being recorded.
+static void sCr_cache_abort_fill(void)
+{
+    cr_CacheEntry *entry = &sCr_discovery_cache.entries[sCr_discovery_cache.fill_slot];
+    sCr_discovery_cache.num_pages = entry->first_page;
+    if (entry->num_pages != 0)
+        sCr_discovery_cache.used = 
+            sCr_discovery_cache.pages[entry->first_page].payload - sCr_discovery_cache.pool;
+    entry->num_pages = 0;
+    sCr_discovery_cache.fill_session = NULL;
+}
+
+/// @private
+/// Stops recording if the active session was recording.
+static void sCr_cache_abandon(void)
+{
+    if (sCr_discovery_cache.fill_session == pvtCr_session)
+        sCr_cache_abort_fill();
+}
+
+/// @private
+/// Looks for the complete response to a discovery in the cache.  If it is
+/// not there the pages encoded for this one may be recorded.
+/// @return true if the session is set to replay from the cache.
+static bool sCr_cache_begin(cr_DiscoverySlot slot, uint32_t hash)
+{
+    if (!sCr_discovery_cache.hash_valid || (hash != sCr_discovery_cache.hash))
+    {
+        I3_LOG(LOG_MASK_REACH, "Discovery cache emptied, hash 0x%x.", hash);
+        sCr_cache_clear();
+        sCr_discovery_cache.hash       = hash;
+        sCr_discovery_cache.hash_valid = true;
+    }
+
+    cr_CacheEntry *entry = &sCr_discovery_cache.entries[slot];
+    bool key_valid = pvtCr_challenge_key_is_valid();
+    if (entry->complete)
+    {
+        // The application may describe less without the challenge key.
+        if (entry->key_valid != key_valid)
+            return false;
+        pvtCr_cursor->replay_pages      = &sCr_discovery_cache.pages[entry->first_page];
+        pvtCr_cursor->replay_count      = entry->num_pages;
+        pvtCr_cursor->replay_cached     = true;
+        pvtCr_cursor->replay_generation = sCr_discovery_cache.generation;
+        return true;
+    }
+
+    // A recording is abandoned if its client went on to something else.
+    cr_session_t *filler = sCr_discovery_cache.fill_session;
+    if ((filler != NULL) && 
+        !sCr_find_open_cursor(filler, sCr_discovery_types[sCr_discovery_cache.fill_slot]))
+        sCr_cache_abort_fill();
+
+    if ((sCr_discovery_cache.fill_session == NULL) && !entry->too_large)
+    {
+        entry->first_page = sCr_discovery_cache.num_pages;
+        entry->num_pages  = 0;
+        entry->key_valid  = key_valid;
+        sCr_discovery_cache.fill_session = pvtCr_session;
+        sCr_discovery_cache.fill_slot    = slot;
+    }
+    return false;
+}
+
+/// @private
+/// Keeps an encoded response payload if it is a page of the discovery 
+/// being recorded.  The last page has no remaining objects.
+static void sCr_cache_store_page(cr_ReachMessageTypes message_type, 
+                                 const uint8_t *payload, size_t size,
+                                 uint32_t remaining_objects)
+{
+    if ((sCr_discovery_cache.fill_session != pvtCr_session) ||
+        (message_type != sCr_discovery_types[sCr_discovery_cache.fill_slot]))
+        return;
+
+    cr_CacheEntry *entry = &sCr_discovery_cache.entries[sCr_discovery_cache.fill_slot];
+    if ((sCr_discovery_cache.num_pages >= CR_DISCOVERY_CACHE_PAGES) ||
+        (size > (size_t)(CR_DISCOVERY_CACHE_SIZE - sCr_discovery_cache.used)))
+    {
+        I3_LOG(LOG_MASK_REACH, "Discovery %d does not fit the cache.", message_type);
+        sCr_cache_abort_fill();
+        entry->too_large = true;
+        return;
+    }
+
+    uint8_t *stored = &sCr_discovery_cache.pool[sCr_discovery_cache.used];
+    memcpy(stored, payload, size);
+    sCr_discovery_cache.used += size;
+
+    cr_EncodedPage *page = &sCr_discovery_cache.pages[sCr_discovery_cache.num_pages++];
+    page->payload           = stored;
+    page->size              = size;
+    page->remaining_objects = remaining_objects;
+    entry->num_pages++;
+
+    if (remaining_objects == 0)
+    {
+        entry->complete = true;
+        sCr_discovery_cache.fill_session = NULL;
+        I3_LOG(LOG_MASK_REACH, "Discovery %d cached in %d pages.", 
+               message_type, entry->num_pages);
+    }
+}
+
+#else   // CR_DISCOVERY_CACHE_SIZE > 0
+
+void cr_discovery_cache_invalidate(void)
+{
+}
+
+#endif  // CR_DISCOVERY_CACHE_SIZE > 0
+
+/// @private
+/// The slot of a discovery request, or -1 if the response cannot be sent 
+/// from pages already encoded.  Only requests for everything, with access 
+/// granted, are.
+static int sCr_discovery_slot(cr_ReachMessageTypes message_type, const void *request)
+{
+    if (sClassic_header_format)
+        return -1;
+
+    switch (message_type)
+    {
+  #ifdef INCLUDE_PARAMETER_SERVICE
+    case cr_ReachMessageTypes_DISCOVER_PARAMETERS:
+    case cr_ReachMessageTypes_DISCOVER_PARAM_EX:
+        if (((const cr_ParameterInfoRequest *)request)->parameter_ids_count != 0)
+            return -1;
+        if (!crcb_access_granted(cr_ServiceIds_PARAMETER_REPO, -1))
+            return -1;
+        return (message_type == cr_ReachMessageTypes_DISCOVER_PARAMETERS) ?
+            cr_DiscoverySlot_PARAMETERS : cr_DiscoverySlot_PARAM_EX;
+  #endif  // def INCLUDE_PARAMETER_SERVICE
+  #ifdef INCLUDE_COMMAND_SERVICE
+    case cr_ReachMessageTypes_DISCOVER_COMMANDS:
+        return cr_DiscoverySlot_COMMANDS;
+  #endif  // def INCLUDE_COMMAND_SERVICE
+    default:
+        return -1;
+    }
+}
+
+/// @private
+/// Called with a decoded prompt before it is handled.  A discovery is 
+/// answered from pages built into the application if it has them for the 
+/// current parameter hash, otherwise from the discovery cache.
+/// @return true if the session is set to replay the response.
+static bool sCr_replay_begin(cr_ReachMessageTypes message_type, const void *request)
+{
+    // A new discovery ends any the client had started.
+    for (int i=0; i<cr_DiscoverySlot_COUNT; i++)
+    {
+        if (message_type == sCr_discovery_types[i])
+        {
+            pvtCr_cursor->replay_pages = NULL;
+          #if CR_DISCOVERY_CACHE_SIZE > 0
+            sCr_cache_abandon();
+          #endif
+            break;
+        }
+    }
+
+    int slot = sCr_discovery_slot(message_type, request);
+    if (slot < 0)
+        return false;
+
+  #ifdef INCLUDE_PARAMETER_SERVICE
+    uint32_t hash = crcb_compute_parameter_hash();
+  #else
+    uint32_t hash = 0;
+  #endif
+
+    // Pages built for the other challenge key state would show this client
+    // more or less than it may see.
+    bool key_valid = pvtCr_challenge_key_is_valid();
+    const cr_PrebuiltDiscovery *prebuilt = crcb_get_prebuilt_discovery(message_type, key_valid);
+    if ((prebuilt != NULL) && (prebuilt->num_pages != 0) &&
+        (prebuilt->challenge_key_valid == key_valid))
+    {
+        if (prebuilt->parameter_hash == hash)
+        {
+            pvtCr_cursor->replay_pages  = prebuilt->pages;
+            pvtCr_cursor->replay_count  = prebuilt->num_pages;
+            pvtCr_cursor->replay_cached = false;
+            pvtCr_cursor->replay_type   = message_type;
+            pvtCr_cursor->replay_next   = 0;
+            pvtCr_cursor->transaction_id = sCr_transaction_id;
+            return true;
+        }
+        LOG_ERROR("Prebuilt discovery %d is for hash 0x%x, not 0x%x.", 
+                  message_type, prebuilt->parameter_hash, hash);
+    }
+
+  #if CR_DISCOVERY_CACHE_SIZE > 0
+    if (sCr_cache_begin((cr_DiscoverySlot)slot, hash))
+    {
+        pvtCr_cursor->replay_type = message_type;
+        pvtCr_cursor->replay_next = 0;
+        pvtCr_cursor->transaction_id = sCr_transaction_id;
+        return true;
+    }
+  #endif
+    return false;
+}
+
+/// @private
+/// True if the continued transaction of the active session is a replay.
+static bool sCr_replaying(void)
+{
+    if (pvtCr_cursor->replay_pages == NULL)
+        return false;
+    if (pvtCr_continued_message_type == pvtCr_cursor->replay_type)
+        return true;
+    // another transaction replaced it.
+    pvtCr_cursor->replay_pages = NULL;
+    return false;
+}
+
+/// @private
+/// Sends the next page of the active session's replay as the response.  
+/// The payload is copied, only the header is encoded.
+static int sCr_replay_send_page(cr_ReachMessageTypes message_type)
+{
+  #if CR_DISCOVERY_CACHE_SIZE > 0
+    if (pvtCr_cursor->replay_cached &&
+        (pvtCr_cursor->replay_generation != sCr_discovery_cache.generation))
+    {
+        // The cache was emptied during the replay.
+        LOG_ERROR("Discovery cache changed during replay of %d.", message_type);
+        pvtCr_cursor_close(pvtCr_cursor);
+        return cr_ErrorCodes_NO_DATA;
+    }
+  #endif
+
+    const cr_EncodedPage *page = &pvtCr_cursor->replay_pages[pvtCr_cursor->replay_next++];
+
+    pvtCr_active_stack->response_type = message_type;
+    pvtCr_active_stack->response_transaction_id = pvtCr_cursor->transaction_id;
+    size_t buffer_size;
+    size_t header_size;
+    uint8_t *encBuffer = sCr_tx_target(&pvtCr_active_stack->response_frame,
+                                       &pvtCr_active_stack->response_frame_size,
+                                       sCr_encoded_response_buffer, &buffer_size);
+    if (!encode_ahsoka_header(message_type, pvtCr_cursor->transaction_id, 
+                              page->remaining_objects,
+                              sCr_client_id, sCr_endpoint_id,
+                              &encBuffer[2], buffer_size - 2, &header_size) ||
+        ((header_size + 2 + page->size) > buffer_size))
+    {
+        pvtCr_cursor_close(pvtCr_cursor);
+        cr_report_error(cr_ErrorCodes_ENCODING_FAILED, "encode replayed %d failed.", message_type);
+        return cr_ErrorCodes_ENCODING_FAILED;
+    }
+    uint16_t size_prefix = header_size;
+    memcpy(encBuffer, &size_prefix, sizeof(size_prefix));
+    pvtCr_active_stack->response_header_size = size_prefix;
+    memcpy(&encBuffer[header_size+2], page->payload, page->size);
+    sCr_encoded_payload_size  = page->size;
+    sCr_encoded_response_size = page->size + header_size + 2;
+    I3_LOG(LOG_MASK_REACH, "Replayed page %d of %d of discovery %d.", 
+           pvtCr_cursor->replay_next, pvtCr_cursor->replay_count, message_type);
+
+    pvtCr_num_remaining_objects = page->remaining_objects;
+    if (pvtCr_cursor->replay_next >= pvtCr_cursor->replay_count)
+        pvtCr_cursor_close(pvtCr_cursor);
+    else
+        pvtCr_continued_message_type = message_type;
     return 0;
 }
 
@@ -1966,7 +3996,8 @@ void pvtCr_get_raw_notification_buffer(uint8_t **pRaw, size_t *pSize)
 }
 void pvtCr_get_coded_notification_buffers(uint8_t **pCoded, size_t *pSize)
 {
-    *pCoded = sCr_coded_notification;
+    *pCoded = pvtCr_active_stack->notification_frame ? 
+              pvtCr_active_stack->notification_frame : sCr_coded_notification;
     *pSize  = sCr_encoded_notification_size;
 }
 
@@ -1977,6 +4008,10 @@ int pvtCr_cli_respond(char *cli)
 {
     if (!cr_get_comm_link_connected())
         return 0;
+    // There are no notifications in the classic format.  Logging that would
+    // come right back here.
+    if (sClassic_header_format)
+        return 0;
 
     uint8_t *pRaw, *pCoded;
     size_t size;
@@ -1989,9 +4024,7 @@ int pvtCr_cli_respond(char *cli)
     pvtCr_get_coded_notification_buffers(&pCoded, &size);
 
     LOG_DUMP_WIRE("CLI", pCoded, size);
-    crcb_send_coded_response(pCoded, size);
-
-    return 0;
+    return pvtCr_send_frame(cr_TxClass_CLI, pCoded, size);
 }
 
 int pvtCr_notify_error(cr_ErrorReport *err)
@@ -2009,8 +4042,7 @@ int pvtCr_notify_error(cr_ErrorReport *err)
     pvtCr_get_coded_notification_buffers(&pCoded, &size);
 
     LOG_DUMP_WIRE("error report", pCoded, size);
-    crcb_send_coded_response(pCoded, size);
-    return 0;
+    return pvtCr_send_frame(cr_TxClass_ERROR, pCoded, size);
 }
 
 int pvtCr_notify_stream(cr_StreamData *data)
@@ -2028,8 +4060,7 @@ int pvtCr_notify_stream(cr_StreamData *data)
     pvtCr_get_coded_notification_buffers(&pCoded, &size);
 
     LOG_DUMP_WIRE("stream data notification", pCoded, size);
-    crcb_send_coded_response(pCoded, size);
-    return 0;
+    return pvtCr_send_frame(cr_TxClass_BULK, pCoded, size);
 }
 
 // sanitize in place using a buffer on the stack
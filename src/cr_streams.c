@@ -95,7 +95,7 @@ int pvtCr_discover_streams(const cr_DiscoverStreams *request,
         // Here implies we are responding to the initial request.
         crcb_stream_discover_reset(0);
         pvtCr_num_remaining_objects = crcb_stream_get_count();
-        if (pvtCr_num_remaining_objects > REACH_COUNT_PARAM_READ_VALUES)
+        if (pvtCr_num_remaining_objects > REACH_COUNT_STREAM_DESC_IN_RESPONSE)
         {
             pvtCr_continued_message_type = cr_ReachMessageTypes_DISCOVER_STREAMS;
             I3_LOG(LOG_MASK_PARAMS, "discover files, Too many for one.");
@@ -115,11 +115,15 @@ int pvtCr_discover_streams(const cr_DiscoverStreams *request,
                 I3_LOG(LOG_MASK_FILES, "No streams with i=0.");
                 return cr_ErrorCodes_NO_DATA; 
             }
-            return rval;
+            return 0;
         }
         //I3_LOG(LOG_MASK_PARAMS, "Added stream %d.", response->streams_count);
         response->streams_count++;
     }
+    // A full page.  The rest follow as a continued transaction.
+    pvtCr_num_remaining_objects = 
+        (pvtCr_num_remaining_objects > REACH_COUNT_STREAM_DESC_IN_RESPONSE) ?
+            pvtCr_num_remaining_objects - REACH_COUNT_STREAM_DESC_IN_RESPONSE : 0;
     return 0;
 }
 
@@ -160,8 +164,7 @@ int pvtCr_stream_send_notification(cr_StreamData *data)
     pvtCr_get_coded_notification_buffers(&pCoded, &size);
 
     LOG_DUMP_WIRE("Stream", pCoded, size);
-    crcb_send_coded_response(pCoded, size);
-    return 0;
+    return pvtCr_send_frame(cr_TxClass_BULK, pCoded, size);
 }
 
 
@@ -52,6 +52,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "cr_stack.h"
 #include "i3_log.h"
@@ -115,6 +116,119 @@ int __attribute__((weak)) crcb_send_coded_response(const uint8_t *response, size
   #endif
 }
 
+/**
+* @brief   crcb_get_coded_prompt_ctx
+* @details Called by cr_process_ctx() to get a prompt for one stack instance.  
+*          The weak implementation defers to crcb_get_coded_prompt().
+* @param   stack  The instance asking for a prompt.  
+* @param   prompt    Pointer to raw data (output)
+* @param   len    Pointer to the number of bytes in the supplied prompt (output)
+* @return  cr_ErrorCodes_NO_ERROR on success.  cr_ErrorCodes_NO_DATA if no data is available.
+*/
+int __attribute__((weak)) crcb_get_coded_prompt_ctx(cr_stack_t *stack, uint8_t *prompt, size_t *len)
+{
+    (void)stack;
+    return crcb_get_coded_prompt(prompt, len);
+}
+
+/**
+* @brief   crcb_send_coded_response_ctx
+* @details Called by the stack to send on the link of one stack instance.  
+*          The weak implementation defers to crcb_send_coded_response().
+* @param   stack  The instance sending.  
+* @param   response    Pointer to coded data to be send (input)
+* @param   len    Number of bytes to be sent (input)
+* @return  cr_ErrorCodes_NO_ERROR on success or a non-zero error preferably from the 
+*          cr_ErrorCodes_ enumeration
+*/
+int __attribute__((weak)) crcb_send_coded_response_ctx(cr_stack_t *stack, const uint8_t *response, size_t len)
+{
+    (void)stack;
+    return crcb_send_coded_response(response, len);
+}
+
+/**
+* @brief   crcb_return_coded_prompt
+* @details Called by the stack when it no longer needs a buffer lent by 
+*          cr_loan_coded_prompt().  The weak implementation does nothing.
+* @param   stack  The instance that handled the prompt.  
+* @param   prompt The pointer that was lent.
+*/
+void __attribute__((weak)) crcb_return_coded_prompt(cr_stack_t *stack, const uint8_t *prompt)
+{
+    (void)stack;
+    (void)prompt;
+}
+
+/**
+* @brief   crcb_get_tx_buffer
+* @details Lends the stack a transport buffer to encode the next frame into. 
+*          The weak implementation has none to lend.
+* @param   stack  The instance that will encode the frame.  
+* @param   size   The size of the buffer (output).
+* @return  NULL so that the stack encodes into its own buffers.
+*/
+__attribute__((weak)) uint8_t *crcb_get_tx_buffer(cr_stack_t *stack, size_t *size)
+{
+    (void)stack;
+    *size = 0;
+    return NULL;
+}
+
+/**
+* @brief   crcb_send_tx_buffer
+* @details Sends a frame encoded into a buffer lent by crcb_get_tx_buffer(). 
+*          Only called if that is overridden, so it must be as well.
+* @param   stack  The instance that encoded the frame.  
+* @param   buffer The buffer that was lent.
+* @param   len    Number of bytes to be sent.  Zero to send nothing.
+* @return  cr_ErrorCodes_NOT_IMPLEMENTED
+*/
+int __attribute__((weak)) crcb_send_tx_buffer(cr_stack_t *stack, uint8_t *buffer, size_t len)
+{
+    (void)stack;
+    (void)buffer;
+    (void)len;
+    i3_log(LOG_MASK_WARN, "%s not implemented", __FUNCTION__);
+    return cr_ErrorCodes_NOT_IMPLEMENTED;
+}
+
+/**
+* @brief   crcb_send_coded_segments
+* @details Sends a frame given in segments.  The stack's frames are 
+*          contiguous, so the weak implementation sends the whole span with
+*          crcb_send_coded_response_ctx().  Segments that are not
+*          contiguous are gathered first.
+* @param   stack    The instance sending.  
+* @param   segments The pieces of the frame, in order.
+* @param   count    Number of segments.
+* @return  As crcb_send_coded_response().
+*/
+int __attribute__((weak)) crcb_send_coded_segments(cr_stack_t *stack, const cr_TxSegment *segments, int count)
+{
+    size_t len = 0;
+    bool contiguous = true;
+    for (int i=0; i<count; i++)
+    {
+        if ((i > 0) && (segments[i].data != segments[0].data + len))
+            contiguous = false;
+        len += segments[i].len;
+    }
+    if (contiguous)
+        return crcb_send_coded_response_ctx(stack, segments[0].data, len);
+
+    uint8_t frame[CR_CODED_BUFFER_SIZE];
+    if (len > sizeof(frame))
+        return cr_ErrorCodes_BUFFER_TOO_SMALL;
+    len = 0;
+    for (int i=0; i<count; i++)
+    {
+        memcpy(&frame[len], segments[i].data, segments[i].len);
+        len += segments[i].len;
+    }
+    return crcb_send_coded_response_ctx(stack, frame, len);
+}
+
 
 ///*************************************************************************
 ///  Device Service
@@ -196,6 +310,30 @@ void __attribute__((weak)) crcb_configure_access_control(const cr_DeviceInfoRequ
     I3_LOG(LOG_MASK_WEAK, "%s: weak default.\n", __FUNCTION__);
 }
 
+/**
+* @brief   crcb_get_prebuilt_discovery
+* @details Returns discovery responses encoded when the application was 
+*          built.  
+* @return  NULL so that discovery responses are built as usual.
+*/
+const cr_PrebuiltDiscovery * __attribute__((weak)) crcb_get_prebuilt_discovery(cr_ReachMessageTypes message_type,
+                                                                             bool challenge_key_valid)
+{
+    (void)message_type;
+    (void)challenge_key_valid;
+    return NULL;
+}
+
+/**
+* @brief   crcb_get_budget_clock
+* @details The clock used to measure and limit cr_process().  
+* @return  zero, as there is no clock.
+*/
+uint32_t __attribute__((weak)) crcb_get_budget_clock(void)
+{
+    return 0;
+}
+
 
 
 ///*************************************************************************
@@ -431,6 +569,17 @@ int __attribute__((weak)) crcb_ping_get_signal_strength(int8_t *rssi)
         return 0;
     }
 
+    /**
+    * @brief   crcb_get_parameter_table
+    * @details Gives the stack a const table of the parameters to index.
+    * @return  NULL, so that parameters are found through 
+    *          crcb_parameter_discover_reset() and crcb_parameter_discover_next().
+    */
+    const cr_ParameterTable * __attribute__((weak)) crcb_get_parameter_table(void)
+    {
+        return NULL;
+    }
+
   #if NUM_SUPPORTED_PARAM_NOTIFY != 0
     /**
     * @brief   crcb_parameter_notification_init
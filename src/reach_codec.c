@@ -0,0 +1,604 @@
+/*
+ * Copyright (c) 2023-2024 i3 Product Development
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file      reach_codec.c
+ * @brief     Type specialized protobuf codecs for the messages that carry
+ *            most of the traffic:  file data, stream data and parameter
+ *            notifications.
+ * @details   nanopb walks a field descriptor for every field and sets the
+ *            whole destination structure to defaults before decoding.  These
+ *            routines are written for one message each.  They touch only the
+ *            fields that are present and produce the same bytes as nanopb.
+ *            Anything unusual on the decode side is passed to pb_decode() so
+ *            that the result never differs.
+ *            They follow the FIELDLIST macros of reach.pb.h and must be
+ *            updated if those messages change in reach.proto.
+ *            They are reached through the message descriptors used by
+ *            encode_reach_payload() and decode_reach_payload().
+ *            cr_benchmark_codecs(), which compares them with nanopb, is
+ *            only built when CR_BUILD_CODEC_BENCHMARK is defined.
+ *
+ * @copyright (c) Copyright 2023 i3 Product Development. All Rights Reserved.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+
+#include "reach-server.h"
+#include "cr_stack.h"
+#include "i3_log.h"
+#include "reach_codec.h"
+
+#ifdef CR_BUILD_CODEC_BENCHMARK
+  #include <time.h>
+#endif
+
+// A parameter value is always short enough for a one byte length.
+#if cr_ParameterValue_size > 127
+  #error "encode_parameter_notification() assumes a one byte value length."
+#endif
+
+//----------------------------------------------------------------------------
+// Encoding
+//----------------------------------------------------------------------------
+
+/// @private
+typedef struct
+{
+    uint8_t *pos;
+    uint8_t *end;
+    bool     ok;
+} sCodec_writer_t;
+
+/// @private
+static void sCodec_put_varint(sCodec_writer_t *w, uint64_t value)
+{
+    // A varint is at most 10 bytes.
+    if ((w->end - w->pos) < 10)
+    {
+        uint8_t tmp[10];
+        uint8_t *p = tmp;
+        do {
+            *p = (uint8_t)(value & 0x7F);
+            value >>= 7;
+            if (value)
+                *p |= 0x80;
+            p++;
+        } while (value);
+        if ((p - tmp) > (w->end - w->pos))
+        {
+            w->ok = false;
+            return;
+        }
+        memcpy(w->pos, tmp, p - tmp);
+        w->pos += p - tmp;
+        return;
+    }
+    while (value > 0x7F)
+    {
+        *w->pos++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *w->pos++ = (uint8_t)value;
+}
+
+/// @private
+static void sCodec_put_bytes(sCodec_writer_t *w, const void *data, size_t len)
+{
+    if (len > (size_t)(w->end - w->pos))
+    {
+        w->ok = false;
+        return;
+    }
+    memcpy(w->pos, data, len);
+    w->pos += len;
+}
+
+/// @private
+/// Writes a little endian fixed32 or fixed64.
+static void sCodec_put_fixed(sCodec_writer_t *w, uint64_t value, size_t len)
+{
+    uint8_t bytes[8];
+    for (size_t i=0; i<len; i++)
+        bytes[i] = (uint8_t)(value >> (8*i));
+    sCodec_put_bytes(w, bytes, len);
+}
+
+/// @private
+#define sCodec_tag(field, wire_type)    ((uint64_t)(((field) << 3) | (wire_type)))
+
+/// @private
+/// An int32 is sign extended, so a negative value takes 10 bytes.
+#define sCodec_int32(v)                 ((uint64_t)(int64_t)(int32_t)(v))
+
+/// @private
+/// zigzag encoding of the sint types
+#define sCodec_zigzag32(v)  ((uint64_t)(((uint32_t)(v) << 1) ^ (uint32_t)((int32_t)(v) >> 31)))
+#define sCodec_zigzag64(v)  (((uint64_t)(v) << 1) ^ (uint64_t)((int64_t)(v) >> 63))
+
+/// @private
+static void sCodec_put_length_delimited(sCodec_writer_t *w, uint32_t field,
+                                        const void *data, size_t len)
+{
+    sCodec_put_varint(w, sCodec_tag(field, PB_WT_STRING));
+    sCodec_put_varint(w, len);
+    sCodec_put_bytes(w, data, len);
+}
+
+/// @private
+static bool sCodec_finish(sCodec_writer_t *w, uint8_t *buffer, size_t *encode_size)
+{
+    if (!w->ok)
+    {
+        LOG_ERROR("Specialized encode failed.");
+        return false;
+    }
+    *encode_size = w->pos - buffer;
+    return true;
+}
+
+bool encode_file_transfer_data(const void *message, uint8_t *buffer,
+                               size_t buffer_size, size_t *encode_size)
+{
+    const cr_FileTransferData *msg = (const cr_FileTransferData *)message;
+    sCodec_writer_t w = {buffer, buffer + buffer_size, true};
+
+    if (msg->message_data.size > sizeof(msg->message_data.bytes))
+        return false;
+    if (msg->result != 0)
+    {
+        sCodec_put_varint(&w, sCodec_tag(cr_FileTransferData_result_tag, PB_WT_VARINT));
+        sCodec_put_varint(&w, sCodec_int32(msg->result));
+    }
+    if (msg->transfer_id != 0)
+    {
+        sCodec_put_varint(&w, sCodec_tag(cr_FileTransferData_transfer_id_tag, PB_WT_VARINT));
+        sCodec_put_varint(&w, msg->transfer_id);
+    }
+    if (msg->message_number != 0)
+    {
+        sCodec_put_varint(&w, sCodec_tag(cr_FileTransferData_message_number_tag, PB_WT_VARINT));
+        sCodec_put_varint(&w, msg->message_number);
+    }
+    if (msg->message_data.size != 0)
+        sCodec_put_length_delimited(&w, cr_FileTransferData_message_data_tag,
+                                    msg->message_data.bytes, msg->message_data.size);
+    if (msg->has_checksum)
+    {
+        sCodec_put_varint(&w, sCodec_tag(cr_FileTransferData_checksum_tag, PB_WT_VARINT));
+        sCodec_put_varint(&w, sCodec_int32(msg->checksum));
+    }
+    return sCodec_finish(&w, buffer, encode_size);
+}
+
+bool encode_stream_data(const void *message, uint8_t *buffer,
+                        size_t buffer_size, size_t *encode_size)
+{
+    const cr_StreamData *msg = (const cr_StreamData *)message;
+    sCodec_writer_t w = {buffer, buffer + buffer_size, true};
+
+    if (msg->message_data.size > sizeof(msg->message_data.bytes))
+        return false;
+    if (msg->stream_id != 0)
+    {
+        sCodec_put_varint(&w, sCodec_tag(cr_StreamData_stream_id_tag, PB_WT_VARINT));
+        sCodec_put_varint(&w, msg->stream_id);
+    }
+    if (msg->roll_count != 0)
+    {
+        sCodec_put_varint(&w, sCodec_tag(cr_StreamData_roll_count_tag, PB_WT_VARINT));
+        sCodec_put_varint(&w, msg->roll_count);
+    }
+    if (msg->message_data.size != 0)
+        sCodec_put_length_delimited(&w, cr_StreamData_message_data_tag,
+                                    msg->message_data.bytes, msg->message_data.size);
+    if (msg->has_checksum)
+    {
+        sCodec_put_varint(&w, sCodec_tag(cr_StreamData_checksum_tag, PB_WT_VARINT));
+        sCodec_put_varint(&w, sCodec_int32(msg->checksum));
+    }
+    return sCodec_finish(&w, buffer, encode_size);
+}
+
+/// @private
+/// Encodes the fields of one cr_ParameterValue.
+static void sCodec_put_parameter_value(sCodec_writer_t *w, const cr_ParameterValue *val)
+{
+    if (val->parameter_id != 0)
+    {
+        sCodec_put_varint(w, sCodec_tag(cr_ParameterValue_parameter_id_tag, PB_WT_VARINT));
+        sCodec_put_varint(w, val->parameter_id);
+    }
+    if (val->timestamp != 0)
+    {
+        sCodec_put_varint(w, sCodec_tag(cr_ParameterValue_timestamp_tag, PB_WT_VARINT));
+        sCodec_put_varint(w, val->timestamp);
+    }
+
+    // A member of the oneof is encoded even when it is zero.
+    uint32_t bits32;
+    uint64_t bits64;
+    size_t   len;
+    switch (val->which_value)
+    {
+    case cr_ParameterValue_uint32_value_tag:
+    case cr_ParameterValue_enum_value_tag:
+        sCodec_put_varint(w, sCodec_tag(val->which_value, PB_WT_VARINT));
+        sCodec_put_varint(w, val->value.uint32_value);
+        break;
+    case cr_ParameterValue_int32_value_tag:
+        sCodec_put_varint(w, sCodec_tag(val->which_value, PB_WT_VARINT));
+        sCodec_put_varint(w, sCodec_zigzag32(val->value.int32_value));
+        break;
+    case cr_ParameterValue_uint64_value_tag:
+    case cr_ParameterValue_bitfield_value_tag:
+        sCodec_put_varint(w, sCodec_tag(val->which_value, PB_WT_VARINT));
+        sCodec_put_varint(w, val->value.uint64_value);
+        break;
+    case cr_ParameterValue_int64_value_tag:
+        sCodec_put_varint(w, sCodec_tag(val->which_value, PB_WT_VARINT));
+        sCodec_put_varint(w, sCodec_zigzag64(val->value.int64_value));
+        break;
+    case cr_ParameterValue_bool_value_tag:
+        sCodec_put_varint(w, sCodec_tag(val->which_value, PB_WT_VARINT));
+        sCodec_put_varint(w, val->value.bool_value ? 1 : 0);
+        break;
+    case cr_ParameterValue_float32_value_tag:
+        memcpy(&bits32, &val->value.float32_value, sizeof(bits32));
+        sCodec_put_varint(w, sCodec_tag(val->which_value, PB_WT_32BIT));
+        sCodec_put_fixed(w, bits32, sizeof(bits32));
+        break;
+    case cr_ParameterValue_float64_value_tag:
+        memcpy(&bits64, &val->value.float64_value, sizeof(bits64));
+        sCodec_put_varint(w, sCodec_tag(val->which_value, PB_WT_64BIT));
+        sCodec_put_fixed(w, bits64, sizeof(bits64));
+        break;
+    case cr_ParameterValue_string_value_tag:
+    {
+        // nanopb refuses a string that is not terminated.
+        const char *end = memchr(val->value.string_value, 0, sizeof(val->value.string_value));
+        if (end == NULL)
+        {
+            w->ok = false;
+            break;
+        }
+        len = end - val->value.string_value;
+        sCodec_put_length_delimited(w, val->which_value, val->value.string_value, len);
+        break;
+    }
+    case cr_ParameterValue_bytes_value_tag:
+        if (val->value.bytes_value.size > sizeof(val->value.bytes_value.bytes))
+        {
+            w->ok = false;
+            break;
+        }
+        sCodec_put_length_delimited(w, val->which_value, val->value.bytes_value.bytes,
+                                    val->value.bytes_value.size);
+        break;
+    default:
+        // Like nanopb, no value unless which_value names one.
+        break;
+    }
+}
+
+bool encode_parameter_notification(const void *message, uint8_t *buffer,
+                                   size_t buffer_size, size_t *encode_size)
+{
+    const cr_ParameterNotification *msg = (const cr_ParameterNotification *)message;
+    sCodec_writer_t w = {buffer, buffer + buffer_size, true};
+
+    if (msg->values_count > (sizeof(msg->values)/sizeof(msg->values[0])))
+        return false;
+    for (pb_size_t i=0; (i<msg->values_count) && w.ok; i++)
+    {
+        // Reserve the tag and the one byte length, then fill in the length.
+        if ((w.end - w.pos) < 2)
+        {
+            w.ok = false;
+            break;
+        }
+        uint8_t *start = w.pos;
+        start[0] = (uint8_t)sCodec_tag(cr_ParameterNotification_values_tag, PB_WT_STRING);
+        w.pos += 2;
+        sCodec_put_parameter_value(&w, &msg->values[i]);
+        start[1] = (uint8_t)(w.pos - start - 2);
+    }
+    return sCodec_finish(&w, buffer, encode_size);
+}
+
+//----------------------------------------------------------------------------
+// Decoding
+//----------------------------------------------------------------------------
+
+/// @private
+/// Reads a varint.  Returns the number of bytes read or zero if it is cut
+/// off or too long.
+static size_t sCodec_get_varint(const uint8_t *buffer, size_t size, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t i=0; (i<size) && (i<10); i++)
+    {
+        result |= (uint64_t)(buffer[i] & 0x7F) << (7*i);
+        if ((buffer[i] & 0x80) == 0)
+        {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/// @private
+/// True if value is what nanopb accepts for an int32.
+#define sCodec_fits_int32(v)    (((int64_t)(v) >= INT32_MIN) && ((int64_t)(v) <= INT32_MAX))
+
+/// @private
+/// Describes the fields of the two data messages, which have the same shape:
+/// varints, one bytes field and one optional int32 checksum.
+typedef struct
+{
+    uint32_t  tag;          ///< field number
+    bool      is_signed;    ///< int32 rather than uint32
+    size_t    offset;       ///< of the value in the structure
+} sCodec_varint_field_t;
+
+/// @private
+/// Decodes one of the data messages.  Returns false to fall back to nanopb.
+static bool sCodec_decode_data(const uint8_t *buffer, size_t size,
+                               uint8_t *msg,
+                               const sCodec_varint_field_t *fields, int num_fields,
+                               uint32_t data_tag, pb_size_t *data_size,
+                               uint8_t *data_bytes, size_t data_max,
+                               uint32_t checksum_tag, bool *has_checksum, int32_t *checksum)
+{
+    // Defaults.  The data bytes are not cleared.
+    for (int i=0; i<num_fields; i++)
+        memset(msg + fields[i].offset, 0, sizeof(uint32_t));
+    *data_size    = 0;
+    *has_checksum = false;
+    *checksum     = 0;
+
+    size_t pos = 0;
+    while (pos < size)
+    {
+        uint64_t key, value;
+        size_t len = sCodec_get_varint(&buffer[pos], size - pos, &key);
+        if ((len == 0) || (key > UINT32_MAX))
+            return false;
+        pos += len;
+
+        uint32_t tag = (uint32_t)(key >> 3);
+        if ((key & 7) == PB_WT_STRING)
+        {
+            if (tag != data_tag)
+                return false;
+            len = sCodec_get_varint(&buffer[pos], size - pos, &value);
+            if ((len == 0) || (value > data_max) || (value > size - pos - len))
+                return false;
+            pos += len;
+            memcpy(data_bytes, &buffer[pos], (size_t)value);
+            *data_size = (pb_size_t)value;
+            pos += (size_t)value;
+            continue;
+        }
+        if ((key & 7) != PB_WT_VARINT)
+            return false;
+        len = sCodec_get_varint(&buffer[pos], size - pos, &value);
+        if (len == 0)
+            return false;
+        pos += len;
+
+        if (tag == checksum_tag)
+        {
+            if (!sCodec_fits_int32(value))
+                return false;
+            *checksum     = (int32_t)value;
+            *has_checksum = true;
+            continue;
+        }
+        int i;
+        for (i=0; i<num_fields; i++)
+        {
+            if (fields[i].tag == tag)
+                break;
+        }
+        if (i == num_fields)
+            return false;
+        if (fields[i].is_signed ? !sCodec_fits_int32(value) : (value > UINT32_MAX))
+            return false;
+        uint32_t v32 = (uint32_t)value;
+        memcpy(msg + fields[i].offset, &v32, sizeof(v32));
+    }
+    return true;
+}
+
+/// @private
+static bool sCodec_slow_decode(const pb_msgdesc_t *fields, void *message,
+                               const uint8_t *buffer, size_t size)
+{
+    pb_istream_t is_stream = pb_istream_from_buffer(buffer, size);
+    if (pb_decode(&is_stream, fields, message))
+        return true;
+    LOG_ERROR("Decoding failed: %s\n", PB_GET_ERROR(&is_stream));
+    return false;
+}
+
+bool decode_file_transfer_data(void *message, const uint8_t *buffer, size_t size)
+{
+    static const sCodec_varint_field_t fields[] = {
+        { cr_FileTransferData_result_tag,         true,  offsetof(cr_FileTransferData, result) },
+        { cr_FileTransferData_transfer_id_tag,    false, offsetof(cr_FileTransferData, transfer_id) },
+        { cr_FileTransferData_message_number_tag, false, offsetof(cr_FileTransferData, message_number) },
+    };
+    cr_FileTransferData *msg = (cr_FileTransferData *)message;
+    if (sCodec_decode_data(buffer, size, (uint8_t *)msg, fields, 3,
+                           cr_FileTransferData_message_data_tag, &msg->message_data.size,
+                           msg->message_data.bytes, sizeof(msg->message_data.bytes),
+                           cr_FileTransferData_checksum_tag, &msg->has_checksum, &msg->checksum))
+        return true;
+    return sCodec_slow_decode(cr_FileTransferData_fields, message, buffer, size);
+}
+
+bool decode_stream_data(void *message, const uint8_t *buffer, size_t size)
+{
+    static const sCodec_varint_field_t fields[] = {
+        { cr_StreamData_stream_id_tag,  false, offsetof(cr_StreamData, stream_id) },
+        { cr_StreamData_roll_count_tag, false, offsetof(cr_StreamData, roll_count) },
+    };
+    cr_StreamData *msg = (cr_StreamData *)message;
+    if (sCodec_decode_data(buffer, size, (uint8_t *)msg, fields, 2,
+                           cr_StreamData_message_data_tag, &msg->message_data.size,
+                           msg->message_data.bytes, sizeof(msg->message_data.bytes),
+                           cr_StreamData_checksum_tag, &msg->has_checksum, &msg->checksum))
+        return true;
+    return sCodec_slow_decode(cr_StreamData_fields, message, buffer, size);
+}
+
+#ifdef CR_BUILD_CODEC_BENCHMARK
+//----------------------------------------------------------------------------
+// Benchmark
+//----------------------------------------------------------------------------
+
+/// @private
+static double sCodec_seconds(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+* @brief   cr_benchmark_codecs
+* @details Times the specialized codecs against pb_encode() and pb_decode()
+*          on typical messages and checks that both give the same result.
+*          The times are logged.  Uses clock().
+* @param   iterations: The number of times each message is coded.
+* @return  The number of messages for which the two paths differ.
+*/
+int cr_benchmark_codecs(uint32_t iterations)
+{
+    static cr_FileTransferData      ftd, ftd_out;
+    static cr_StreamData            sd, sd_out;
+    static cr_ParameterNotification pn;
+    static uint8_t  fast[REACH_MAX_RESPONSE_SIZE], slow[REACH_MAX_RESPONSE_SIZE];
+    size_t fast_size = 0, slow_size = 0;
+    int    errors = 0;
+
+    ftd.transfer_id    = 3;
+    ftd.message_number = 100;
+    ftd.message_data.size = sizeof(ftd.message_data.bytes);
+    for (size_t i=0; i<sizeof(ftd.message_data.bytes); i++)
+        ftd.message_data.bytes[i] = (uint8_t)i;
+    ftd.has_checksum = true;
+    ftd.checksum     = 0x1234;
+
+    sd.stream_id  = 1;
+    sd.roll_count = 500;
+    sd.message_data.size = sizeof(sd.message_data.bytes) / 2;
+    memcpy(sd.message_data.bytes, ftd.message_data.bytes, sd.message_data.size);
+
+    pn.values_count = sizeof(pn.values)/sizeof(pn.values[0]);
+    for (pb_size_t i=0; i<pn.values_count; i++)
+    {
+        pn.values[i].parameter_id = 10 + i;
+        pn.values[i].timestamp    = 123456;
+    }
+    pn.values[0].which_value = cr_ParameterValue_uint32_value_tag;
+    pn.values[0].value.uint32_value = 1000;
+    pn.values[1].which_value = cr_ParameterValue_float32_value_tag;
+    pn.values[1].value.float32_value = 3.5f;
+    pn.values[2].which_value = cr_ParameterValue_int32_value_tag;
+    pn.values[2].value.int32_value = -42;
+    pn.values[3].which_value = cr_ParameterValue_string_value_tag;
+    strcpy(pn.values[3].value.string_value, "ready");
+
+    struct {
+        const char         *name;
+        const pb_msgdesc_t *fields;
+        const void         *message;
+        void               *decoded;
+        size_t              decoded_size;
+        cr_PayloadEncoder   encode;
+        cr_PayloadDecoder   decode;
+    } cases[] = {
+        { "file data",    cr_FileTransferData_fields, &ftd, &ftd_out, sizeof(ftd_out),
+          encode_file_transfer_data, decode_file_transfer_data },
+        { "stream data",  cr_StreamData_fields, &sd, &sd_out, sizeof(sd_out),
+          encode_stream_data, decode_stream_data },
+        { "notification", cr_ParameterNotification_fields, &pn, NULL, 0,
+          encode_parameter_notification, NULL },
+    };
+
+    for (size_t c=0; c<sizeof(cases)/sizeof(cases[0]); c++)
+    {
+        clock_t start = clock();
+        for (uint32_t i=0; i<iterations; i++)
+        {
+            pb_ostream_t os_stream = pb_ostream_from_buffer(slow, sizeof(slow));
+            pb_encode(&os_stream, cases[c].fields, cases[c].message);
+            slow_size = os_stream.bytes_written;
+        }
+        double slow_encode = sCodec_seconds(start);
+
+        start = clock();
+        for (uint32_t i=0; i<iterations; i++)
+            cases[c].encode(cases[c].message, fast, sizeof(fast), &fast_size);
+        double fast_encode = sCodec_seconds(start);
+
+        if ((fast_size != slow_size) || memcmp(fast, slow, slow_size))
+        {
+            i3_log(LOG_MASK_ALWAYS, TEXT_RED "  %s: encodings differ." TEXT_RESET, cases[c].name);
+            errors++;
+        }
+        i3_log(LOG_MASK_ALWAYS, "  %s encode: nanopb %.3f s, specialized %.3f s.",
+               cases[c].name, slow_encode, fast_encode);
+
+        if (!cases[c].decode)
+            continue;
+
+        start = clock();
+        for (uint32_t i=0; i<iterations; i++)
+        {
+            pb_istream_t is_stream = pb_istream_from_buffer(slow, slow_size);
+            pb_decode(&is_stream, cases[c].fields, cases[c].decoded);
+        }
+        double slow_decode = sCodec_seconds(start);
+
+        start = clock();
+        for (uint32_t i=0; i<iterations; i++)
+            cases[c].decode(cases[c].decoded, slow, slow_size);
+        double fast_decode = sCodec_seconds(start);
+
+        if (memcmp(cases[c].decoded, cases[c].message, cases[c].decoded_size))
+        {
+            i3_log(LOG_MASK_ALWAYS, TEXT_RED "  %s: decodings differ." TEXT_RESET, cases[c].name);
+            errors++;
+        }
+        i3_log(LOG_MASK_ALWAYS, "  %s decode: nanopb %.3f s, specialized %.3f s.",
+               cases[c].name, slow_decode, fast_decode);
+    }
+    return errors;
+}
+#endif  // def CR_BUILD_CODEC_BENCHMARK
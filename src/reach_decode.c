@@ -48,9 +48,11 @@
  * @copyright (c) Copyright 2023 i3 Product Development. All Rights Reserved.
  */
 
+#include <string.h>
 #include <pb_decode.h>
 
 #include "reach-server.h"
+#include "cr_stack.h"
 #include "i3_log.h"
 #include "message_util.h"
 #include "reach_decode.h"
@@ -97,8 +99,9 @@ bool decode_reach_message(cr_ReachMessage *message,  // out: decoded
 /**
 * @brief   decode_reach_payload
 * @details Apply the protobuf decode function to the buffer. 
-*          Feeds pb_decode() the necessary structure based on
-*          the message type.
+*          The request fields of the message type are found with 
+*          cr_get_message_descriptor().  A message type with a 
+*          specialized decoder uses that instead.
 * @param   message_type :  in:  from the header
 * @param   data :  out:  decode to here
 * @param   buffer :  in:  encoded, from the header
@@ -110,201 +113,130 @@ bool decode_reach_payload(cr_ReachMessageTypes message_type,     // in:  from th
                           const uint8_t *buffer,    // in:  encoded from the header
                           size_t size)              // in:  encoded size
 {
+  const cr_MessageDescriptor *desc = cr_get_message_descriptor(message_type);
+  if ((desc == NULL) || (desc->request_fields == NULL))
+  {
+      LOG_ERROR("No decoder for %d", message_type);
+      return false;
+  }
 
-  /* Create a stream that reads from the buffer. */
-  pb_istream_t is_stream = pb_istream_from_buffer(buffer, size);
-
-  bool status = false;
-  /* Now we are ready to decode the message. */
-  switch (message_type) {
-    case cr_ReachMessageTypes_GET_DEVICE_INFO:
-        status = pb_decode(&is_stream, cr_DeviceInfoRequest_fields, data);
-        if (status) {
-            message_util_log_device_info_request((cr_DeviceInfoRequest*)data);
-        }
-        break;
-  case cr_ReachMessageTypes_PING:
-      status = pb_decode(&is_stream, cr_PingRequest_fields, data);
-      if (status) {
-          message_util_log_ping_request((cr_PingRequest *)data);
-      } 
-      break;
-#ifdef INCLUDE_PARAMETER_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_PARAMETERS:
-      status = pb_decode(&is_stream, cr_ParameterInfoRequest_fields, data);
-      if (status) {
-        message_util_log_param_info_request((cr_ParameterInfoRequest *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_DISCOVER_PARAM_EX:
-      status = pb_decode(&is_stream, cr_ParameterInfoRequest_fields, data);
-      if (status) {
-        message_util_log_param_info_request((cr_ParameterInfoRequest *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_READ_PARAMETERS:
-      status = pb_decode(&is_stream, cr_ParameterRead_fields, data);
-      if (status) {
-        message_util_log_read_param((cr_ParameterRead *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_WRITE_PARAMETERS:
-      status = pb_decode(&is_stream, cr_ParameterWrite_fields, data);
-      if (status) {
-        message_util_log_write_param((cr_ParameterWrite *)data);
-      }
-      break;
-   case cr_ReachMessageTypes_PARAM_ENABLE_NOTIFY:
-      status = pb_decode(&is_stream, cr_ParameterEnableNotifications_fields, data);
-      if (status) {
-        message_util_log_config_notify_param((cr_ParameterNotifyConfigResponse *)data);
-      }
-      break;
-   case cr_ReachMessageTypes_PARAM_DISABLE_NOTIFY:
-      status = pb_decode(&is_stream, cr_ParameterDisableNotifications_fields, data);
-      if (status) {
-        message_util_log_config_notify_param((cr_ParameterNotifyConfigResponse *)data);
-      }
-      break;
-    case cr_ReachMessageTypes_DISCOVER_NOTIFICATIONS:
-        status = pb_decode(&is_stream, cr_DiscoverParameterNotifications_fields, data);
-        if (status) {
-          message_util_log_discover_notifications((cr_DiscoverParameterNotifications *)data);
-        }
-        break;
-
-
-#endif  // def INCLUDE_PARAMETER_SERVICE
+  if (desc->decode_request)
+  {
+      if (!desc->decode_request(data, buffer, size))
+          return false;
+  }
+  else
+  {
+      /* Create a stream that reads from the buffer. */
+      pb_istream_t is_stream = pb_istream_from_buffer(buffer, size);
 
-#ifdef INCLUDE_FILE_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_FILES:
-      status = pb_decode(&is_stream, cr_DiscoverFiles_fields, data);
-      if (status) {
-        message_util_log_discover_files();
-      }
-      break;
-  case cr_ReachMessageTypes_TRANSFER_INIT:
-      status = pb_decode(&is_stream, cr_FileTransferRequest_fields, data);
-      if (status) {
-        message_util_log_file_transfer_request((cr_FileTransferRequest *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_TRANSFER_DATA:
-      status = pb_decode(&is_stream, cr_FileTransferData_fields, data);
-      if (status) 
+      if (!pb_decode(&is_stream, desc->request_fields, data))
       {
-          // cr_FileTransferData *ftd = (cr_FileTransferData*)data;
-          message_util_log_transfer_data((cr_FileTransferData *)data);
-          // LOG_DUMP_MASK(LOG_MASK_REACH, "Data Decoded", 
-          //                    ftd->message_data.bytes, ftd->message_data.size);
-      }
-      break;
-  case cr_ReachMessageTypes_TRANSFER_DATA_NOTIFICATION:
-      status =
-          pb_decode(&is_stream, cr_FileTransferDataNotification_fields, data);
-      if (status) {
-          message_util_log_transfer_data_notification(true,
-                      (cr_FileTransferDataNotification *)data);
+          LOG_ERROR("Decoding failed: %s\n", PB_GET_ERROR(&is_stream));
+          return false;
       }
-      break;
-    case cr_ReachMessageTypes_ERASE_FILE:
-        status =
-            pb_decode(&is_stream, cr_FileEraseRequest_fields, data);
-        if (status) {
-            message_util_log_file_erase_request((cr_FileEraseRequest *)data);
-        }
-        break;
-#endif // def INCLUDE_FILE_SERVICE
+  }
+  if (desc->log_request)
+      desc->log_request(data);
+  return true;
+}
 
-#ifdef INCLUDE_STREAM_SERVICE
-    case cr_ReachMessageTypes_DISCOVER_STREAMS:
-        status = pb_decode(&is_stream, cr_DiscoverStreamsResponse_fields, data);
-        if (status) {
-          message_util_log_discover_streams();
-        }
-        break;
-    case cr_ReachMessageTypes_OPEN_STREAM:
-        status = pb_decode(&is_stream, cr_StreamOpen_fields, data);
-        if (status) {
-          message_util_log_open_stream((cr_StreamOpen *)data);
-        }
-        break;
-    case cr_ReachMessageTypes_CLOSE_STREAM:
-        status = pb_decode(&is_stream, cr_StreamClose_fields, data);
-        if (status) {
-          message_util_log_close_stream((cr_StreamClose *)data);
-        }
-        break;
-    case cr_ReachMessageTypes_STREAM_DATA_NOTIFICATION:
-        status = pb_decode(&is_stream, cr_StreamData_fields, data);
-        if (status) {
-          message_util_log_receive_stream_notification((cr_StreamData *)data);
+/// @private
+/// Reads a varint of at most five bytes, enough for any 32 bit field.
+/// Returns the number of bytes read or zero if the varint is longer or
+/// is cut off.
+static size_t sDecodeReach_varint32(const uint8_t *buffer, size_t size, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t i=0; (i<size) && (i<5); i++)
+    {
+        result |= (uint64_t)(buffer[i] & 0x7F) << (7*i);
+        if ((buffer[i] & 0x80) == 0)
+        {
+            *value = result;
+            return i + 1;
         }
-      break;
-#endif  // def INCLUDE_STREAM_SERVICE
-
-#ifdef INCLUDE_COMMAND_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_COMMANDS:
-      status = pb_decode(&is_stream, cr_DiscoverCommands_fields, data);
-      if (status) {
-        message_util_log_discover_commands();
-      }
-      break;
-  case cr_ReachMessageTypes_SEND_COMMAND:
-      status = pb_decode(&is_stream, cr_SendCommand_fields, data);
-      if (status) {
-        message_util_log_send_command((cr_SendCommand *)data);
-      }
-      break;
-#endif  // def INCLUDE_COMMAND_SERVICE
-
-#ifdef INCLUDE_CLI_SERVICE
-  case cr_ReachMessageTypes_CLI_NOTIFICATION:
-      status = pb_decode(&is_stream, cr_CLIData_fields, data);
-      if (status) {
-        message_util_log_cli_notification(false, (cr_CLIData *)data);
-      }
-      break;
-#endif  // def INCLUDE_CLI_SERVICE
-
-#ifdef INCLUDE_TIME_SERVICE
-  case cr_ReachMessageTypes_GET_TIME:
-      status = pb_decode(&is_stream, cr_TimeGetRequest_fields, data);
-      if (status) {
-        message_util_log_time_get_request((cr_TimeGetRequest *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_SET_TIME:
-      status = pb_decode(&is_stream, cr_TimeSetRequest_fields, data);
-      if (status) {
-          message_util_log_time_set_request((cr_TimeSetRequest *)data);
-      }
-      break;
-#endif  // def INCLUDE_TIME_SERVICE
-
-
-#ifdef INCLUDE_WIFI_SERVICE
-  case cr_ReachMessageTypes_DISCOVER_WIFI:
-      status = pb_decode(&is_stream, cr_DiscoverWiFi_fields, data);
-      if (status) {
-        message_util_log_discover_wifi_request((cr_DiscoverWiFi *)data);
-      }
-      break;
-  case cr_ReachMessageTypes_WIFI_CONNECT:
-      status = pb_decode(&is_stream, cr_WiFiConnectionRequest_fields, data);
-      if (status) {
-        message_util_log_WiFi_connection_request((cr_WiFiConnectionRequest *)data);
-      }
-      break;
-#endif  // def INCLUDE_WIFI_SERVICE
+    }
+    return 0;
+}
 
-  default:
-      break;
-  }
+/**
+* @brief   decode_ahsoka_header
+* @details Decodes the Ahsoka header that precedes every payload without the
+*          generic nanopb field iterator.  Only the six known fields with 
+*          32 bit values are handled here.  Anything else, such as a 
+*          negative value or an unknown field, is left to pb_decode() so 
+*          that the result is always the same.
+* @param   header :  out:  decode to here
+* @param   buffer :  in:  encoded, after the two byte size prefix
+* @param   size :  in:  size of the encoded header
+* @return  true if no error.
+*/
+bool decode_ahsoka_header(cr_AhsokaMessageHeader *header,  // out: decoded
+                          const uint8_t *buffer,           // in:  encoded
+                          size_t size)                     // in:  encoded size
+{
+    memset(header, 0, sizeof(cr_AhsokaMessageHeader));
 
-  if (status)
-      return true;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        uint8_t  tag = buffer[pos++];
+        uint64_t value;
+        size_t   len;
+
+        if (tag == ((cr_AhsokaMessageHeader_client_id_tag << 3) | PB_WT_STRING))
+        {
+            if ((pos >= size) || (buffer[pos] > sizeof(header->client_id.bytes)) ||
+                (buffer[pos] > size - pos - 1))
+                goto slow_path;
+            header->client_id.size = buffer[pos];
+            memcpy(header->client_id.bytes, &buffer[pos+1], header->client_id.size);
+            pos += 1 + header->client_id.size;
+            continue;
+        }
+        // The rest are varints.
+        if ((tag & 7) != PB_WT_VARINT)
+            goto slow_path;
+        len = sDecodeReach_varint32(&buffer[pos], size - pos, &value);
+        if ((len == 0) || (value > UINT32_MAX))
+            goto slow_path;
+        pos += len;
+
+        // The signed fields are negative past INT32_MAX.  Leave those to nanopb.
+        if ((value > INT32_MAX) && ((tag >> 3) != cr_AhsokaMessageHeader_endpoint_id_tag))
+            goto slow_path;
+
+        switch (tag >> 3)
+        {
+        case cr_AhsokaMessageHeader_message_type_tag:
+            header->message_type = (int32_t)value;
+            break;
+        case cr_AhsokaMessageHeader_transaction_id_tag:
+            header->transaction_id = (int32_t)value;
+            break;
+        case cr_AhsokaMessageHeader_remaining_objects_tag:
+            header->remaining_objects = (int32_t)value;
+            break;
+        case cr_AhsokaMessageHeader_endpoint_id_tag:
+            header->endpoint_id = (uint32_t)value;
+            break;
+        case cr_AhsokaMessageHeader_is_message_compressed_tag:
+            header->is_message_compressed = (value != 0);
+            break;
+        default:
+            goto slow_path;
+        }
+    }
+    return true;
 
-  LOG_ERROR("Decoding failed: %s\n", PB_GET_ERROR(&is_stream));
-  return false;
+slow_path:
+    {
+        pb_istream_t is_stream = pb_istream_from_buffer(buffer, size);
+        memset(header, 0, sizeof(cr_AhsokaMessageHeader));
+        if (pb_decode(&is_stream, cr_AhsokaMessageHeader_fields, (void *)header))
+            return true;
+        LOG_ERROR("Ahsoka Header Decoding failed: %s\n", PB_GET_ERROR(&is_stream));
+    }
+    return false;
 }
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2023-2024 i3 Product Development
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file      prebuild_discovery.c
+ * @brief     A host program that writes the discovery responses of an
+ *            application as const, already encoded pages.
+ * @details   Build it on the host with the stack, nanopb, the application's
+ *            reach-server.h and the application files that implement the
+ *            parameter and command discovery callbacks and
+ *            crcb_compute_parameter_hash().  Do not link the transport, which
+ *            this program replaces, or a previously generated file.  For
+ *            example:
+ *
+ *              gcc -Iinclude -Ithird_party/nanopb -I<app> -o prebuild
+ *                  tools/prebuild_discovery.c <stack and nanopb sources>
+ *                  <application tables>
+ *              ./prebuild [-k challenge_key] > prebuilt_discovery.c
+ *
+ *            It asks the stack for each discovery as a client would, so the
+ *            pages are exactly those the device would encode, split to fit
+ *            CR_CODED_BUFFER_SIZE.  Compile the output into the application,
+ *            where its crcb_get_prebuilt_discovery() hands them to the stack.
+ *            The pages are used while crcb_compute_parameter_hash() returns
+ *            the value it had when they were generated.
+ *
+ *            What a client discovers can depend on its challenge key, so
+ *            the pages are generated for a client without a key and, given
+ *            -k, again for a client with that key.  Each set is only sent
+ *            to clients with the same key state.
+ *
+ * @copyright (c) Copyright 2023 i3 Product Development. All Rights Reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cr_stack.h"
+#include "pb_encode.h"
+#include "pb_decode.h"
+
+/// The client_id used to ask.
+#define PREBUILD_CLIENT_ID      0x50524542
+/// The most pages of one discovery.
+#define PREBUILD_MAX_PAGES      256
+/// The number of idle calls to cr_process() that end a discovery.
+#define PREBUILD_IDLE_CALLS     8
+
+/// The frames sent by the stack, captured by crcb_send_coded_response().
+static uint8_t  sFrames[PREBUILD_MAX_PAGES][CR_CODED_BUFFER_SIZE];
+static size_t   sFrameSize[PREBUILD_MAX_PAGES];
+static int      sNumFrames;
+static bool     sOverflow;
+
+int crcb_send_coded_response(const uint8_t *response, size_t len)
+{
+    if ((sNumFrames >= PREBUILD_MAX_PAGES) || (len > CR_CODED_BUFFER_SIZE))
+    {
+        sOverflow = true;
+        return cr_ErrorCodes_NO_RESOURCE;
+    }
+    memcpy(sFrames[sNumFrames], response, len);
+    sFrameSize[sNumFrames++] = len;
+    return cr_ErrorCodes_NO_ERROR;
+}
+
+/// Encodes a prompt with an Ahsoka header.  Returns its size or 0.
+static size_t make_prompt(uint8_t *buffer, size_t size,
+                          cr_ReachMessageTypes message_type,
+                          const pb_msgdesc_t *fields, const void *payload)
+{
+    cr_AhsokaMessageHeader hdr;
+    uint32_t client_id = PREBUILD_CLIENT_ID;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.message_type   = message_type;
+    hdr.transaction_id = 1;
+    hdr.client_id.size = sizeof(client_id);
+    memcpy(hdr.client_id.bytes, &client_id, sizeof(client_id));
+
+    pb_ostream_t hs = pb_ostream_from_buffer(&buffer[2], size - 2);
+    if (!pb_encode(&hs, cr_AhsokaMessageHeader_fields, &hdr))
+        return 0;
+    uint16_t header_size = hs.bytes_written;
+    memcpy(buffer, &header_size, sizeof(header_size));
+
+    pb_ostream_t ps = pb_ostream_from_buffer(&buffer[2 + header_size],
+                                             size - 2 - header_size);
+    if (!pb_encode(&ps, fields, payload))
+        return 0;
+    return 2 + header_size + ps.bytes_written;
+}
+
+/// Sends a prompt and runs the stack until it has nothing more to send.
+static int ask(cr_ReachMessageTypes message_type, const pb_msgdesc_t *fields,
+               const void *payload, uint32_t *ticks)
+{
+    uint8_t prompt[CR_CODED_BUFFER_SIZE];
+    size_t size = make_prompt(prompt, sizeof(prompt), message_type, fields, payload);
+    if (size == 0)
+        return cr_ErrorCodes_ENCODING_FAILED;
+
+    sNumFrames = 0;
+    sOverflow  = false;
+    int rval = cr_store_coded_prompt(prompt, size);
+    if (rval != cr_ErrorCodes_NO_ERROR)
+        return rval;
+
+    int idle = 0;
+    while (idle < PREBUILD_IDLE_CALLS)
+    {
+        int before = sNumFrames;
+        cr_process((*ticks)++);
+        idle = (sNumFrames == before) ? idle + 1 : 0;
+    }
+    return sOverflow ? cr_ErrorCodes_BUFFER_TOO_SMALL : cr_ErrorCodes_NO_ERROR;
+}
+
+/// Writes the captured responses of one discovery as C.  Returns the
+/// number of pages.
+static int write_discovery(FILE *out, const char *name,
+                           cr_ReachMessageTypes message_type, uint32_t hash,
+                           bool key_valid)
+{
+    int num_pages = 0;
+    uint32_t remaining[PREBUILD_MAX_PAGES];
+
+    for (int i=0; i<sNumFrames; i++)
+    {
+        uint16_t header_size;
+        memcpy(&header_size, sFrames[i], sizeof(header_size));
+        if ((size_t)header_size + 2 > sFrameSize[i])
+            continue;
+        cr_AhsokaMessageHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        pb_istream_t is = pb_istream_from_buffer(&sFrames[i][2], header_size);
+        if (!pb_decode(&is, cr_AhsokaMessageHeader_fields, &hdr) ||
+            (hdr.message_type != (int32_t)message_type))
+            continue;   // a notification or an error report
+
+        const uint8_t *payload = &sFrames[i][2 + header_size];
+        size_t size = sFrameSize[i] - 2 - header_size;
+        fprintf(out, "static const uint8_t s%s_%d[] = {", name, num_pages);
+        for (size_t j=0; j<size; j++)
+            fprintf(out, "%s0x%02X,", (j % 12) ? " " : "\n    ", payload[j]);
+        fprintf(out, "\n};\n\n");
+        remaining[num_pages++] = hdr.remaining_objects;
+    }
+    if (num_pages == 0)
+        return 0;
+
+    fprintf(out, "static const cr_EncodedPage s%s_pages[] = {\n", name);
+    for (int i=0; i<num_pages; i++)
+        fprintf(out, "    { s%s_%d, sizeof(s%s_%d), %u },\n",
+                name, i, name, i, (unsigned)remaining[i]);
+    fprintf(out, "};\n\n");
+    fprintf(out, "static const cr_PrebuiltDiscovery s%s = {\n", name);
+    fprintf(out, "    %d, 0x%08X, s%s_pages, %d, %s\n};\n\n",
+            message_type, (unsigned)hash, name, num_pages,
+            key_valid ? "true" : "false");
+    return num_pages;
+}
+
+/// The discoveries that are prebuilt.
+static const struct {
+    cr_ReachMessageTypes    message_type;
+    const char             *name;
+    const char             *type_name;
+} sDiscoveries[] = {
+    { cr_ReachMessageTypes_DISCOVER_PARAMETERS, "DiscoverParameters",
+      "cr_ReachMessageTypes_DISCOVER_PARAMETERS" },
+    { cr_ReachMessageTypes_DISCOVER_PARAM_EX,   "DiscoverParamEx",
+      "cr_ReachMessageTypes_DISCOVER_PARAM_EX" },
+    { cr_ReachMessageTypes_DISCOVER_COMMANDS,   "DiscoverCommands",
+      "cr_ReachMessageTypes_DISCOVER_COMMANDS" },
+};
+#define NUM_DISCOVERIES (sizeof(sDiscoveries) / sizeof(sDiscoveries[0]))
+
+/// Which discoveries were written, without and with the challenge key.
+static bool sFound[2][NUM_DISCOVERIES];
+/// Whether the discoveries were asked for without and with the key.
+static bool sWritten[2];
+
+/// Sets the challenge key state of the session, then writes every discovery
+/// as it is seen in that state.  Returns 0 or 1 on failure.
+static int write_discoveries(FILE *out, const char *challenge_key, uint32_t *ticks)
+{
+    cr_DeviceInfoRequest info_request;
+    memset(&info_request, 0, sizeof(info_request));
+    snprintf(info_request.client_protocol_version,
+             sizeof(info_request.client_protocol_version), "%s", cr_get_proto_version());
+    if (challenge_key != NULL)
+    {
+        info_request.has_challenge_key = true;
+        snprintf(info_request.challenge_key, sizeof(info_request.challenge_key), "%s", challenge_key);
+    }
+    if (ask(cr_ReachMessageTypes_GET_DEVICE_INFO, cr_DeviceInfoRequest_fields,
+            &info_request, ticks) != cr_ErrorCodes_NO_ERROR)
+    {
+        fprintf(stderr, "The device info request failed.\n");
+        return 1;
+    }
+    // The application decides what the key grants, which may be everything
+    // without a key or nothing with a wrong one.
+    bool key_valid = crcb_challenge_key_is_valid();
+    if ((challenge_key != NULL) && !key_valid)
+    {
+        fprintf(stderr, "The challenge key is not valid.\n");
+        return 1;
+    }
+    if (sWritten[key_valid])
+    {
+        fprintf(stderr, "Access is granted without the challenge key.\n");
+        return 0;
+    }
+
+  #ifdef INCLUDE_PARAMETER_SERVICE
+    uint32_t hash = crcb_compute_parameter_hash();
+  #else
+    uint32_t hash = 0;
+  #endif
+
+    for (size_t i=0; i<NUM_DISCOVERIES; i++)
+    {
+        // A request without IDs asks for everything.
+        union {
+            cr_ParameterInfoRequest param_info;
+            cr_DiscoverCommands     commands;
+        } request;
+        memset(&request, 0, sizeof(request));
+        const pb_msgdesc_t *fields =
+            (sDiscoveries[i].message_type == cr_ReachMessageTypes_DISCOVER_COMMANDS) ?
+                cr_DiscoverCommands_fields : cr_ParameterInfoRequest_fields;
+
+        int rval = ask(sDiscoveries[i].message_type, fields, &request, ticks);
+        if (rval != cr_ErrorCodes_NO_ERROR)
+        {
+            fprintf(stderr, "%s failed (%d).\n", sDiscoveries[i].name, rval);
+            return 1;
+        }
+        char name[40];
+        snprintf(name, sizeof(name), "%s%s", sDiscoveries[i].name, key_valid ? "Key" : "");
+        int pages = write_discovery(out, name, sDiscoveries[i].message_type,
+                                    hash, key_valid);
+        sFound[key_valid][i] = (pages != 0);
+        fprintf(stderr, "%s: %d pages.\n", name, pages);
+    }
+    sWritten[key_valid] = true;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *challenge_key = NULL;
+    uint32_t ticks = 1;
+    FILE *out = stdout;
+
+    if ((argc == 3) && !strcmp(argv[1], "-k"))
+    {
+        challenge_key = argv[2];
+    }
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [-k challenge_key] > prebuilt_discovery.c\n", argv[0]);
+        return 1;
+    }
+
+    cr_init();
+    cr_set_comm_link_connected(true);
+
+    fprintf(out, "// Discovery responses encoded by prebuild_discovery.  Do not edit.\n");
+    fprintf(out, "// Regenerate when the parameter or command tables change.\n\n");
+    fprintf(out, "#include \"cr_stack.h\"\n\n");
+
+    if (write_discoveries(out, NULL, &ticks) != 0)
+        return 1;
+    if ((challenge_key != NULL) && (write_discoveries(out, challenge_key, &ticks) != 0))
+        return 1;
+
+    fprintf(out, "const cr_PrebuiltDiscovery *crcb_get_prebuilt_discovery(cr_ReachMessageTypes message_type,\n");
+    fprintf(out, "                                                        bool challenge_key_valid)\n");
+    fprintf(out, "{\n    switch (message_type)\n    {\n");
+    for (size_t i=0; i<NUM_DISCOVERIES; i++)
+    {
+        if (!sFound[false][i] && !sFound[true][i])
+            continue;
+        fprintf(out, "    case %s:\n", sDiscoveries[i].type_name);
+        fprintf(out, "        if (challenge_key_valid)\n            return %s%s%s;\n",
+                sFound[true][i] ? "&s" : "NULL", sFound[true][i] ? sDiscoveries[i].name : "",
+                sFound[true][i] ? "Key" : "");
+        fprintf(out, "        return %s%s;\n",
+                sFound[false][i] ? "&s" : "NULL", sFound[false][i] ? sDiscoveries[i].name : "");
+    }
+    fprintf(out, "    default:\n        return NULL;\n    }\n}\n");
+    return 0;
+}